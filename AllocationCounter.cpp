@@ -0,0 +1,115 @@
+#include "AllocationCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    std::atomic<std::uint64_t> allocationCount{ 0 };
+
+    void* allocate(std::size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    void* allocateAligned(std::size_t size, std::size_t alignment)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        size = (size + alignment - 1) / alignment * alignment;
+#ifdef _MSC_VER
+        return _aligned_malloc(size == 0 ? alignment : size, alignment);
+#else
+        return std::aligned_alloc(alignment, size == 0 ? alignment : size);
+#endif
+    }
+
+    void freeAligned(void* memory)
+    {
+#ifdef _MSC_VER
+        _aligned_free(memory);
+#else
+        std::free(memory);
+#endif
+    }
+}
+
+std::uint64_t AllocationCounter::getCount()
+{
+    return allocationCount.load(std::memory_order_relaxed);
+}
+
+// the replaceable allocation functions, every other form of new and delete forwards to these
+
+void* operator new(std::size_t size)
+{
+    if (void* memory = allocate(size)) return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (void* memory = allocateAligned(size, static_cast<std::size_t>(alignment))) return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept
+{
+    freeAligned(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept
+{
+    freeAligned(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept
+{
+    freeAligned(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept
+{
+    freeAligned(memory);
+}
\ No newline at end of file
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+
+// process wide count of heap allocations, kept by the replacements of the global operator new in AllocationCounter.cpp
+// one relaxed atomic increment per allocation; used to check that the steady state of a frame does not touch the heap
+namespace AllocationCounter
+{
+    // allocations on every thread since the start of the process
+    std::uint64_t getCount();
+}
\ No newline at end of file
@@ -0,0 +1,408 @@
+#include "Checkpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char magic[8] = { 'N', 'B', 'O', 'D', 'Y', 'C', 'K', 'P' };
+    const std::size_t headerSize = 256;
+    const std::size_t arrayAlignment = 64;
+    const std::size_t arrayCount = 9;
+
+    // byte offsets of the header fields
+    const std::size_t versionOffset = 8;
+    const std::size_t headerSizeOffset = 12;
+    const std::size_t particleCountOffset = 16;
+    const std::size_t simulationTimeOffset = 24;
+    const std::size_t randomStateOffset = 32;
+    const std::size_t forceEngineOffset = 40;
+    const std::size_t integratorOffset = 44;
+    const std::size_t broadPhaseOffset = 48;
+    const std::size_t instructionSetOffset = 52;
+    const std::size_t openingAngleOffset = 56;
+    const std::size_t expansionOrderOffset = 60;
+    const std::size_t timestepBinCountOffset = 64;
+    const std::size_t timestepAccuracyOffset = 68;
+    const std::size_t forceErrorSampleCountOffset = 72;
+    const std::size_t accelerationsCurrentOffset = 80;
+    const std::size_t accelerationsBeginOffset = 88;
+    const std::size_t accelerationsEndOffset = 96;
+    const std::size_t arrayOffsetsOffset = 104;
+    const std::size_t fileSizeOffset = arrayOffsetsOffset + 8 * arrayCount;
+    const std::size_t meshSizeOffset = fileSizeOffset + 8;
+    const std::size_t meshAssignmentOffset = meshSizeOffset + 4;
+    const std::size_t meshSofteningOffset = meshAssignmentOffset + 4;
+    const std::size_t precisionOffset = meshSofteningOffset + 4;
+    const std::size_t softeningOffset = precisionOffset + 4;
+    const std::size_t softeningLengthOffset = softeningOffset + 4;
+    const std::size_t gravitationalConstantOffset = softeningLengthOffset + 4;
+
+    bool isLittleEndian()
+    {
+        const std::uint16_t probe = 1;
+        unsigned char firstByte = 0;
+        std::memcpy(&firstByte, &probe, 1);
+        return firstByte == 1;
+    }
+
+    template <typename T>
+    void store(unsigned char* destination, const T value)
+    {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        if (!isLittleEndian()) std::reverse(bytes, bytes + sizeof(T));
+        std::memcpy(destination, bytes, sizeof(T));
+    }
+
+    template <typename T>
+    T load(const unsigned char* source)
+    {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, source, sizeof(T));
+        if (!isLittleEndian()) std::reverse(bytes, bytes + sizeof(T));
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    std::size_t alignUp(const std::size_t offset)
+    {
+        return (offset + arrayAlignment - 1) / arrayAlignment * arrayAlignment;
+    }
+
+    // the float arrays in file order; active is written last
+    const std::vector<float>* getFloatArray(const ParticleStore& particles, const std::size_t a)
+    {
+        const std::vector<float>* arrays[8] = {
+            &particles.x, &particles.y, &particles.vx, &particles.vy,
+            &particles.ax, &particles.ay, &particles.mass, &particles.radius
+        };
+        return arrays[a];
+    }
+
+    std::size_t getElementSize(const std::size_t a)
+    {
+        return a + 1 < arrayCount ? sizeof(float) : sizeof(std::uint8_t);
+    }
+
+    // read-only mapping of a whole file, unmapped when destroyed
+    class MappedFile
+    {
+    private:
+
+        const unsigned char* data;
+        std::size_t size;
+#ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+#endif
+
+    public:
+
+        MappedFile() : data{ nullptr }, size{ 0 }
+#ifdef _WIN32
+            , file{ INVALID_HANDLE_VALUE }, mapping{ nullptr }
+#endif
+        {}
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if (this->data) UnmapViewOfFile(this->data);
+            if (this->mapping) CloseHandle(this->mapping);
+            if (this->file != INVALID_HANDLE_VALUE) CloseHandle(this->file);
+#else
+            if (this->data) munmap(const_cast<unsigned char*>(this->data), this->size);
+#endif
+        }
+
+        bool open(const std::string& path, std::string& error)
+        {
+#ifdef _WIN32
+            this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            LARGE_INTEGER fileSize{};
+            if (this->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(this->file, &fileSize))
+            {
+                error = "cannot open " + path;
+                return false;
+            }
+            this->size = static_cast<std::size_t>(fileSize.QuadPart);
+            if (this->size == 0) return true;
+
+            this->mapping = CreateFileMappingA(this->file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (this->mapping) this->data = static_cast<const unsigned char*>(MapViewOfFile(this->mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+            const int descriptor = ::open(path.c_str(), O_RDONLY);
+            struct stat status {};
+            if (descriptor < 0 || fstat(descriptor, &status) != 0)
+            {
+                if (descriptor >= 0) ::close(descriptor);
+                error = "cannot open " + path;
+                return false;
+            }
+            this->size = static_cast<std::size_t>(status.st_size);
+            if (this->size == 0)
+            {
+                ::close(descriptor);
+                return true;
+            }
+
+            void* mapped = mmap(nullptr, this->size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            ::close(descriptor);
+            if (mapped != MAP_FAILED)
+            {
+                // the arrays are read once front to back
+                madvise(mapped, this->size, MADV_SEQUENTIAL | MADV_WILLNEED);
+                this->data = static_cast<const unsigned char*>(mapped);
+            }
+#endif
+            if (!this->data)
+            {
+                error = "cannot map " + path;
+                return false;
+            }
+            return true;
+        }
+
+        const unsigned char* getData() const
+        {
+            return this->data;
+        }
+
+        std::size_t getSize() const
+        {
+            return this->size;
+        }
+    };
+
+    // flushes the file to disk and closes it
+    bool syncAndClose(std::FILE* file)
+    {
+        bool synced = std::fflush(file) == 0;
+#ifdef _WIN32
+        synced = synced && _commit(_fileno(file)) == 0;
+#else
+        synced = synced && fsync(fileno(file)) == 0;
+#endif
+        return std::fclose(file) == 0 && synced;
+    }
+
+    bool replaceFile(const std::string& source, const std::string& destination)
+    {
+#ifdef _WIN32
+        return MoveFileExA(source.c_str(), destination.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+        if (std::rename(source.c_str(), destination.c_str()) != 0) return false;
+
+        // persist the rename itself
+        const std::size_t slash = destination.find_last_of('/');
+        const std::string directory = slash == std::string::npos ? "." : (slash == 0 ? "/" : destination.substr(0, slash));
+        const int descriptor = ::open(directory.c_str(), O_RDONLY);
+        if (descriptor >= 0)
+        {
+            fsync(descriptor);
+            ::close(descriptor);
+        }
+        return true;
+#endif
+    }
+}
+
+bool Checkpoint::write(const std::string& path, const Header& header, const ParticleStore& particles, std::string& error)
+{
+    const std::size_t n = particles.size();
+
+    // array offsets, then the header
+    std::uint64_t arrayOffsets[arrayCount];
+    std::size_t offset = headerSize;
+    for (std::size_t a = 0; a < arrayCount; ++a)
+    {
+        offset = alignUp(offset);
+        arrayOffsets[a] = offset;
+        offset += n * getElementSize(a);
+    }
+    const std::size_t fileSize = offset;
+
+    unsigned char bytes[headerSize] = {};
+    std::memcpy(bytes, magic, sizeof(magic));
+    store<std::uint32_t>(bytes + versionOffset, version);
+    store<std::uint32_t>(bytes + headerSizeOffset, static_cast<std::uint32_t>(headerSize));
+    store<std::uint64_t>(bytes + particleCountOffset, n);
+    store<double>(bytes + simulationTimeOffset, header.simulationTime);
+    store<std::uint64_t>(bytes + randomStateOffset, header.randomState);
+    store<std::uint32_t>(bytes + forceEngineOffset, header.forceEngine);
+    store<std::uint32_t>(bytes + integratorOffset, header.integrator);
+    store<std::uint32_t>(bytes + broadPhaseOffset, header.collisionBroadPhase);
+    store<std::uint32_t>(bytes + instructionSetOffset, header.instructionSet);
+    store<float>(bytes + openingAngleOffset, header.openingAngle);
+    store<std::uint32_t>(bytes + expansionOrderOffset, header.expansionOrder);
+    store<std::uint32_t>(bytes + timestepBinCountOffset, header.timestepBinCount);
+    store<float>(bytes + timestepAccuracyOffset, header.timestepAccuracy);
+    store<std::uint64_t>(bytes + forceErrorSampleCountOffset, header.forceErrorSampleCount);
+    store<std::uint8_t>(bytes + accelerationsCurrentOffset, header.accelerationsCurrent ? 1 : 0);
+    store<std::uint64_t>(bytes + accelerationsBeginOffset, header.accelerationsBegin);
+    store<std::uint64_t>(bytes + accelerationsEndOffset, header.accelerationsEnd);
+    for (std::size_t a = 0; a < arrayCount; ++a)
+        store<std::uint64_t>(bytes + arrayOffsetsOffset + 8 * a, arrayOffsets[a]);
+    store<std::uint64_t>(bytes + fileSizeOffset, fileSize);
+    store<std::uint32_t>(bytes + meshSizeOffset, header.meshSize);
+    store<std::uint32_t>(bytes + meshAssignmentOffset, header.meshAssignment);
+    store<float>(bytes + meshSofteningOffset, header.meshSoftening);
+    store<std::uint32_t>(bytes + precisionOffset, header.precision);
+    store<std::uint32_t>(bytes + softeningOffset, header.softening);
+    store<float>(bytes + softeningLengthOffset, header.softeningLength);
+    store<float>(bytes + gravitationalConstantOffset, header.gravitationalConstant);
+
+    const std::string temporaryPath = path + ".tmp";
+    std::FILE* file = std::fopen(temporaryPath.c_str(), "wb");
+    if (!file)
+    {
+        error = "cannot create " + temporaryPath;
+        return false;
+    }
+
+    bool written = std::fwrite(bytes, 1, headerSize, file) == headerSize;
+    std::size_t position = headerSize;
+    const unsigned char padding[arrayAlignment] = {};
+    std::vector<float> swapped;
+    for (std::size_t a = 0; written && a < arrayCount; ++a)
+    {
+        const std::size_t paddingSize = static_cast<std::size_t>(arrayOffsets[a]) - position;
+        written = std::fwrite(padding, 1, paddingSize, file) == paddingSize;
+        position += paddingSize + n * getElementSize(a);
+        if (!written || n == 0) continue;
+
+        if (a + 1 == arrayCount)
+        {
+            written = std::fwrite(particles.active.data(), 1, n, file) == n;
+        }
+        else if (isLittleEndian())
+        {
+            written = std::fwrite(getFloatArray(particles, a)->data(), sizeof(float), n, file) == n;
+        }
+        else
+        {
+            swapped.resize(n);
+            for (std::size_t i = 0; i < n; ++i)
+                store<float>(reinterpret_cast<unsigned char*>(&swapped[i]), (*getFloatArray(particles, a))[i]);
+            written = std::fwrite(swapped.data(), sizeof(float), n, file) == n;
+        }
+    }
+
+    // never leave a partial snapshot behind, and never touch path unless the new one is complete
+    if (!syncAndClose(file) || !written)
+    {
+        std::remove(temporaryPath.c_str());
+        error = "cannot write " + temporaryPath;
+        return false;
+    }
+    if (!replaceFile(temporaryPath, path))
+    {
+        std::remove(temporaryPath.c_str());
+        error = "cannot rename " + temporaryPath + " to " + path;
+        return false;
+    }
+    return true;
+}
+
+bool Checkpoint::read(const std::string& path, Header& header, ParticleStore& particles, std::string& error)
+{
+    MappedFile file;
+    if (!file.open(path, error)) return false;
+
+    const unsigned char* bytes = file.getData();
+    const std::size_t size = file.getSize();
+    if (size < fileSizeOffset + 8 || std::memcmp(bytes, magic, sizeof(magic)) != 0)
+    {
+        error = path + " is not a checkpoint";
+        return false;
+    }
+
+    const std::uint32_t fileVersion = load<std::uint32_t>(bytes + versionOffset);
+    if (fileVersion != version)
+    {
+        error = "unsupported checkpoint version " + std::to_string(fileVersion) + " in " + path;
+        return false;
+    }
+
+    const std::uint64_t n = load<std::uint64_t>(bytes + particleCountOffset);
+    if (load<std::uint32_t>(bytes + headerSizeOffset) != headerSize || load<std::uint64_t>(bytes + fileSizeOffset) != size || n > size)
+    {
+        error = "truncated or corrupt checkpoint " + path;
+        return false;
+    }
+
+    // every array must be aligned, after the header and inside the file
+    std::uint64_t arrayOffsets[arrayCount];
+    for (std::size_t a = 0; a < arrayCount; ++a)
+    {
+        arrayOffsets[a] = load<std::uint64_t>(bytes + arrayOffsetsOffset + 8 * a);
+        if (arrayOffsets[a] < headerSize || arrayOffsets[a] % arrayAlignment != 0 || arrayOffsets[a] > size
+            || n * getElementSize(a) > size - arrayOffsets[a])
+        {
+            error = "truncated or corrupt checkpoint " + path;
+            return false;
+        }
+    }
+
+    header.simulationTime = load<double>(bytes + simulationTimeOffset);
+    header.randomState = load<std::uint64_t>(bytes + randomStateOffset);
+    header.forceEngine = load<std::uint32_t>(bytes + forceEngineOffset);
+    header.integrator = load<std::uint32_t>(bytes + integratorOffset);
+    header.collisionBroadPhase = load<std::uint32_t>(bytes + broadPhaseOffset);
+    header.instructionSet = load<std::uint32_t>(bytes + instructionSetOffset);
+    header.openingAngle = load<float>(bytes + openingAngleOffset);
+    header.expansionOrder = load<std::uint32_t>(bytes + expansionOrderOffset);
+    header.timestepBinCount = load<std::uint32_t>(bytes + timestepBinCountOffset);
+    header.timestepAccuracy = load<float>(bytes + timestepAccuracyOffset);
+    header.forceErrorSampleCount = load<std::uint64_t>(bytes + forceErrorSampleCountOffset);
+    header.accelerationsCurrent = load<std::uint8_t>(bytes + accelerationsCurrentOffset) != 0;
+    header.accelerationsBegin = load<std::uint64_t>(bytes + accelerationsBeginOffset);
+    header.accelerationsEnd = load<std::uint64_t>(bytes + accelerationsEndOffset);
+    header.meshSize = load<std::uint32_t>(bytes + meshSizeOffset);
+    header.meshAssignment = load<std::uint32_t>(bytes + meshAssignmentOffset);
+    header.meshSoftening = load<float>(bytes + meshSofteningOffset);
+    header.precision = load<std::uint32_t>(bytes + precisionOffset);
+    header.softening = load<std::uint32_t>(bytes + softeningOffset);
+    header.softeningLength = load<float>(bytes + softeningLengthOffset);
+    header.gravitationalConstant = load<float>(bytes + gravitationalConstantOffset);
+
+    // the arrays are stored exactly as in memory on little-endian machines => one block copy each, no parsing
+    const std::size_t count = static_cast<std::size_t>(n);
+    std::vector<float>* floatArrays[8] = {
+        &particles.x, &particles.y, &particles.vx, &particles.vy,
+        &particles.ax, &particles.ay, &particles.mass, &particles.radius
+    };
+    for (std::size_t a = 0; a + 1 < arrayCount; ++a)
+    {
+        const float* source = reinterpret_cast<const float*>(bytes + arrayOffsets[a]);
+        floatArrays[a]->assign(source, source + count);
+        if (!isLittleEndian())
+        {
+            for (float& value : *floatArrays[a])
+                value = load<float>(reinterpret_cast<const unsigned char*>(&value));
+        }
+    }
+    const std::uint8_t* active = bytes + arrayOffsets[arrayCount - 1];
+    particles.active.assign(active, active + count);
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <cstdint>
+
+#include "ParticleStore.h"
+
+// versioned little-endian snapshot of a particle system
+// layout: a fixed 256 byte header, then the SoA arrays (x, y, vx, vy, ax, ay, mass, radius as float32, active as uint8),
+// each starting at a 64 byte aligned offset recorded in the header, so a mapped file can be copied array by array
+namespace Checkpoint
+{
+    const std::uint32_t version = 1;
+
+    // everything besides the particles; enums are stored as their underlying values
+    struct Header
+    {
+        double simulationTime = 0.0;
+        std::uint64_t randomState = 0;
+
+        std::uint32_t forceEngine = 0;
+        std::uint32_t integrator = 0;
+        std::uint32_t collisionBroadPhase = 0;
+        std::uint32_t instructionSet = 0;
+        float openingAngle = 0.f;
+        std::uint32_t expansionOrder = 0;
+        std::uint32_t timestepBinCount = 0;
+        float timestepAccuracy = 0.f;
+        std::uint64_t forceErrorSampleCount = 0;
+
+        // accelerations cached by the kick-drift-kick integrators
+        bool accelerationsCurrent = false;
+        std::uint64_t accelerationsBegin = 0;
+        std::uint64_t accelerationsEnd = 0;
+
+        // particle-mesh parameters, 0 in files written before they were added
+        std::uint32_t meshSize = 0;
+        std::uint32_t meshAssignment = 0;
+        float meshSoftening = 0.f;
+
+        // pair interaction, G = 0 in files written before it was added
+        std::uint32_t precision = 0;
+        std::uint32_t softening = 0;
+        float softeningLength = 0.f;
+        float gravitationalConstant = 0.f;
+    };
+
+    // writes the snapshot to path + ".tmp", flushes it to disk and renames it over path,
+    // so path always holds either the previous or the new complete snapshot
+    bool write(const std::string& path, const Header& header, const ParticleStore& particles, std::string& error);
+
+    // maps the file, validates the header and the array bounds, then copies every array in one block
+    // particles is only modified once the whole file has been validated
+    bool read(const std::string& path, Header& header, ParticleStore& particles, std::string& error);
+}
\ No newline at end of file
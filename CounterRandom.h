@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+
+// counter based random numbers: draw k of item i is a hash of (seed, i, k) instead of the next state of a sequence,
+// so items can be generated in any order and on any number of threads with identical results
+// the functions are defined here so the generator loops can inline them
+class CounterRandom
+{
+private:
+
+    std::uint64_t key;
+
+    // splitmix64 finalizer, a bijection with full avalanche
+    static std::uint64_t mix(std::uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+public:
+
+    // one step of the sequential splitmix64 generator: advances state and returns the next number
+    // ParticleSystem draws its random numbers, the seeds of its generators included, from this sequence
+    static std::uint64_t next(std::uint64_t& state)
+    {
+        return mix(state += 0x9E3779B97F4A7C15ull);
+    }
+
+    explicit CounterRandom(const std::uint64_t seed) : key{ mix(seed + 0x9E3779B97F4A7C15ull) } {}
+
+    std::uint64_t operator()(const std::uint64_t item, const std::uint64_t draw) const
+    {
+        return mix(mix(this->key + item * 0x9E3779B97F4A7C15ull) + draw * 0xD1B54A32D192ED03ull);
+    }
+
+    // in [0, 1) with a 2^-24 spacing
+    float uniform(const std::uint64_t item, const std::uint64_t draw) const
+    {
+        return static_cast<float>((*this)(item, draw) >> 40) / 16777216.f;
+    }
+
+    // in (0, 1], safe to take the logarithm of
+    float positive(const std::uint64_t item, const std::uint64_t draw) const
+    {
+        return static_cast<float>(((*this)(item, draw) >> 40) + 1) / 16777216.f;
+    }
+};
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include "DistributedSimulation.h"
+
+namespace
+{
+    // x, y, vx, vy, mass
+    const std::size_t floatsPerParticle = 5;
+}
+
+DistributedSimulation::DistributedSimulation(ParticleSystem& particleSystem, MPI_Comm communicator)
+    : particleSystem{ particleSystem }, communicator{ communicator }, rank{ 0 }, rankCount{ 1 }, statistics{}
+{
+    MPI_Comm_rank(this->communicator, &this->rank);
+    MPI_Comm_size(this->communicator, &this->rankCount);
+
+    // kick-drift-kick schemes evaluate forces after a drift, which needs the drifted slices of every rank
+    this->particleSystem.setSynchronizationCallback([this]() {
+        sf::Clock clock;
+        this->exchangeSlices();
+        this->stageCommunicationTime += clock.getElapsedTime();
+    });
+}
+
+DistributedSimulation::~DistributedSimulation()
+{
+    this->particleSystem.setSynchronizationCallback(nullptr);
+}
+
+std::size_t DistributedSimulation::getSliceStart(const int ofRank, const std::size_t n) const
+{
+    return n * static_cast<std::size_t>(ofRank) / static_cast<std::size_t>(this->rankCount);
+}
+
+int DistributedSimulation::getRank() const
+{
+    return this->rank;
+}
+
+int DistributedSimulation::getRankCount() const
+{
+    return this->rankCount;
+}
+
+const DistributedSimulation::Statistics& DistributedSimulation::getStatistics() const
+{
+    return this->statistics;
+}
+
+std::size_t DistributedSimulation::getOwnedBegin() const
+{
+    return this->getSliceStart(this->rank, this->particleSystem.getParticleCount());
+}
+
+std::size_t DistributedSimulation::getOwnedEnd() const
+{
+    return this->getSliceStart(this->rank + 1, this->particleSystem.getParticleCount());
+}
+
+void DistributedSimulation::exchangeSlices()
+{
+    ParticleStore& p = this->particleSystem.getParticles();
+    const std::size_t n = p.size();
+    const std::size_t begin = this->getOwnedBegin();
+    const std::size_t end = this->getOwnedEnd();
+
+    // pack the owned slice
+    this->sendBuffer.resize((end - begin) * floatsPerParticle);
+    for (std::size_t i = begin, k = 0; i < end; ++i)
+    {
+        this->sendBuffer[k++] = p.x[i];
+        this->sendBuffer[k++] = p.y[i];
+        this->sendBuffer[k++] = p.vx[i];
+        this->sendBuffer[k++] = p.vy[i];
+        this->sendBuffer[k++] = p.mass[i];
+    }
+
+    // slices are contiguous and ordered by rank, so the gathered buffer is already in particle order
+    this->receiveCounts.resize(this->rankCount);
+    this->displacements.resize(this->rankCount);
+    for (int r = 0; r < this->rankCount; ++r)
+    {
+        const std::size_t sliceBegin = this->getSliceStart(r, n);
+        this->receiveCounts[r] = static_cast<int>((this->getSliceStart(r + 1, n) - sliceBegin) * floatsPerParticle);
+        this->displacements[r] = static_cast<int>(sliceBegin * floatsPerParticle);
+    }
+    this->receiveBuffer.resize(n * floatsPerParticle);
+
+    MPI_Allgatherv(this->sendBuffer.data(), static_cast<int>(this->sendBuffer.size()), MPI_FLOAT,
+        this->receiveBuffer.data(), this->receiveCounts.data(), this->displacements.data(), MPI_FLOAT, this->communicator);
+
+    // unpack every slice (the own one is unchanged by the round trip)
+    for (std::size_t i = 0, k = 0; i < n; ++i)
+    {
+        p.x[i] = this->receiveBuffer[k++];
+        p.y[i] = this->receiveBuffer[k++];
+        p.vx[i] = this->receiveBuffer[k++];
+        p.vy[i] = this->receiveBuffer[k++];
+        if (p.mass[i] != this->receiveBuffer[k]) p.setMass(i, this->receiveBuffer[k]);
+        ++k;
+    }
+}
+
+void DistributedSimulation::step(sf::Time deltaTime, bool collisions)
+{
+    // identical replicas => identical sort, merges and removals on every rank
+    this->statistics.collisionTime = sf::Time::Zero;
+    if (collisions)
+    {
+        this->particleSystem.handleCollisions();
+        this->statistics.collisionTime = this->particleSystem.getStatistics().collisionTime;
+    }
+
+    this->stageCommunicationTime = sf::Time::Zero;
+    sf::Clock clock;
+    this->particleSystem.updateRange(deltaTime, this->getOwnedBegin(), this->getOwnedEnd());
+    this->statistics.computeTime = clock.restart() - this->stageCommunicationTime;
+
+    this->exchangeSlices();
+    this->statistics.communicationTime = clock.getElapsedTime() + this->stageCommunicationTime;
+}
\ No newline at end of file
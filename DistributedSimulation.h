@@ -0,0 +1,68 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <mpi.h>
+#include <vector>
+
+#include "ParticleSystem.h"
+
+// MPI driver: every rank keeps a full replica of the particle system but only computes and integrates its own slice
+// after integration the slices are exchanged with one allgather, so every replica is identical again and the
+// collision phase can run on each rank with the exact same merges
+// this needs a merge that only depends on the particles, not on the thread count or on which worker found a pair
+// (ParticleSystem::outranks): a replica that picks another survivor compacts its particles into another order, and
+// the next allgather writes the slices of the other ranks over particles they no longer describe
+class DistributedSimulation
+{
+public:
+
+    // timings of the last step, local to this rank
+    struct Statistics
+    {
+        sf::Time collisionTime;
+        sf::Time computeTime;
+        sf::Time communicationTime;
+    };
+
+private:
+
+    ParticleSystem& particleSystem;
+    MPI_Comm communicator;
+    int rank;
+    int rankCount;
+
+    // packed x, y, vx, vy, mass of the owned slice and of the whole system
+    std::vector<float> sendBuffer;
+    std::vector<float> receiveBuffer;
+    std::vector<int> receiveCounts;
+    std::vector<int> displacements;
+
+    Statistics statistics;
+    // time spent in the exchanges between the stages of multi-stage integrators during the current step
+    sf::Time stageCommunicationTime;
+
+    // first particle owned by the given rank for n particles (rank == rankCount gives n)
+    std::size_t getSliceStart(const int ofRank, const std::size_t n) const;
+
+    void exchangeSlices();
+
+public:
+
+    // every rank must pass a system set up the same way (same particles in the same order)
+    // the system exchanges the slices through this driver between integrator stages until it is destroyed
+    DistributedSimulation(ParticleSystem& particleSystem, MPI_Comm communicator = MPI_COMM_WORLD);
+    ~DistributedSimulation();
+
+    DistributedSimulation(const DistributedSimulation&) = delete;
+    DistributedSimulation& operator=(const DistributedSimulation&) = delete;
+
+    int getRank() const;
+    int getRankCount() const;
+    const Statistics& getStatistics() const;
+
+    // range of particles computed and integrated by this rank
+    std::size_t getOwnedBegin() const;
+    std::size_t getOwnedEnd() const;
+
+    // handleCollisions on the replica (unless disabled), forces and integration of the owned slice, then the slice exchange
+    void step(sf::Time deltaTime, bool collisions = true);
+};
\ No newline at end of file
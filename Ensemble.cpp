@@ -0,0 +1,393 @@
+#include "Ensemble.h"
+#include "CounterRandom.h"
+
+#include <algorithm>
+#include <cmath>
+
+Ensemble::Ensemble()
+    : particles{}, systemCount{ 0 }, capacity{ 0 }, batchCounts{}, accelerationsCurrent{}, systems{}, interaction{},
+    instructionSet{ ForceKernels::detectInstructionSet() }, kernel{ ForceKernels::selectKernel(instructionSet, interaction) },
+    integrator{ ParticleSystem::Integrator::SemiImplicitEuler }, threadPool{}, workerScratch{}, statistics{}
+{
+    this->resizeScratch();
+}
+
+std::size_t Ensemble::getIndex(const std::size_t system, const std::size_t body) const
+{
+    const std::size_t lanes = ForceKernels::laneCount;
+    return ((system / lanes) * this->capacity + body) * lanes + system % lanes;
+}
+
+void Ensemble::resizeScratch()
+{
+    // sized up front so the steps never allocate
+    this->workerScratch.resize(this->threadPool.getThreadCount());
+    for (WorkerScratch& scratch : this->workerScratch)
+    {
+        scratch.order.resize(this->capacity);
+        scratch.parent.resize(this->capacity);
+        scratch.mass.resize(this->capacity);
+    }
+}
+
+void Ensemble::distributeSystems(const ParticleSystem::Distribution distribution, const std::size_t newSystemCount,
+    const std::size_t particleCount, const float scale, const std::uint64_t firstSeed)
+{
+    const std::size_t lanes = ForceKernels::laneCount;
+    const std::size_t batchCount = (newSystemCount + lanes - 1) / lanes;
+    this->systemCount = newSystemCount;
+    this->capacity = particleCount;
+
+    // every slot starts as padding, the members overwrite theirs
+    this->particles.resize(batchCount * this->capacity * lanes);
+    std::fill(this->particles.vx.begin(), this->particles.vx.end(), 0.f);
+    std::fill(this->particles.vy.begin(), this->particles.vy.end(), 0.f);
+    std::fill(this->particles.ax.begin(), this->particles.ax.end(), 0.f);
+    std::fill(this->particles.ay.begin(), this->particles.ay.end(), 0.f);
+    std::fill(this->particles.mass.begin(), this->particles.mass.end(), 0.f);
+    std::fill(this->particles.radius.begin(), this->particles.radius.end(), 0.f);
+    std::fill(this->particles.active.begin(), this->particles.active.end(), 0);
+
+    this->batchCounts.assign(batchCount, particleCount);
+    this->accelerationsCurrent.assign(batchCount, 0);
+    this->systems.assign(newSystemCount, SystemStatistics{});
+    this->resizeScratch();
+
+    // one member per task, generated serially into a contiguous store and scattered into its slots
+    this->threadPool.run(newSystemCount, [&](std::size_t system, std::size_t) {
+        ParticleStore bodies;
+        bodies.resize(particleCount);
+        ThreadPool serial(1);
+        const std::uint64_t seed = firstSeed + system;
+        // the first draw of ParticleSystem::randomNumber after setRandomSeed(seed), the one distributeParticles takes
+        std::uint64_t state = seed;
+        ParticleSystem::generateParticles(bodies, 0, particleCount, distribution, scale,
+            CounterRandom(CounterRandom::next(state)), serial);
+
+        ParticleStore& p = this->particles;
+        for (std::size_t k = 0; k < particleCount; ++k)
+        {
+            const std::size_t i = this->getIndex(system, k);
+            p.x[i] = bodies.x[k];
+            p.y[i] = bodies.y[k];
+            p.vx[i] = bodies.vx[k];
+            p.vy[i] = bodies.vy[k];
+            p.mass[i] = bodies.mass[k];
+            p.radius[i] = bodies.radius[k];
+            p.active[i] = 1;
+        }
+
+        SystemStatistics& statistics = this->systems[system];
+        statistics.seed = seed;
+        statistics.initialParticleCount = particleCount;
+        statistics.particleCount = particleCount;
+    });
+}
+
+bool Ensemble::handleCollisions(const std::size_t system, WorkerScratch& scratch)
+{
+    const std::size_t count = this->systems[system].particleCount;
+    if (count < 2) return false;
+    ParticleStore& p = this->particles;
+
+    // bodies sorted by the left end of their interval on the OX axis
+    std::size_t* order = scratch.order.data();
+    for (std::size_t k = 0; k < count; ++k) order[k] = k;
+    std::sort(order, order + count, [&](std::size_t k1, std::size_t k2) {
+        const std::size_t i1 = this->getIndex(system, k1), i2 = this->getIndex(system, k2);
+        return p.x[i1] - p.radius[i1] < p.x[i2] - p.radius[i2];
+    });
+
+    std::size_t* parent = scratch.parent.data();
+    for (std::size_t k = 0; k < count; ++k) parent[k] = k;
+
+    // iterative find with path halving
+    auto find = [&](std::size_t x) {
+        while (parent[x] != x)
+        {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    };
+
+    // sweep: the bodies after a in the order overlap its interval until the first that starts past its end
+    bool merged = false;
+    for (std::size_t a = 0; a + 1 < count; ++a)
+    {
+        const std::size_t i = this->getIndex(system, order[a]);
+        const float end = p.x[i] + p.radius[i];
+        for (std::size_t b = a + 1; b < count; ++b)
+        {
+            const std::size_t j = this->getIndex(system, order[b]);
+            if (p.x[j] - p.radius[j] > end) break;
+
+            // same test as ParticleSystem::intersects
+            const float diffX = p.x[j] - p.x[i];
+            const float diffY = p.y[j] - p.y[i];
+            if (std::sqrt(diffX * diffX + diffY * diffY) > p.radius[i] + p.radius[j]) continue;
+
+            // the rule of ParticleSystem::outranks: the heavier representative stays, equal masses keep the smaller body
+            const std::size_t reprX = find(order[a]);
+            const std::size_t reprY = find(order[b]);
+            if (reprX == reprY) continue;
+            const float massX = p.mass[this->getIndex(system, reprX)];
+            const float massY = p.mass[this->getIndex(system, reprY)];
+            if (massX > massY || (massX == massY && reprX < reprY))
+                parent[reprY] = reprX;
+            else
+                parent[reprX] = reprY;
+            merged = true;
+        }
+    }
+
+    if (!merged) return false;
+
+    // masses of the representatives, summed in body order
+    float* mass = scratch.mass.data();
+    std::fill(mass, mass + count, 0.f);
+    for (std::size_t k = 0; k < count; ++k)
+        mass[find(k)] += p.mass[this->getIndex(system, k)];
+
+    // the representatives move to the front of the slots in body order, a slot is only written once it was read
+    std::size_t kept = 0;
+    for (std::size_t k = 0; k < count; ++k)
+    {
+        if (find(k) != k) continue;
+
+        const std::size_t from = this->getIndex(system, k);
+        const std::size_t to = this->getIndex(system, kept++);
+        p.x[to] = p.x[from];
+        p.y[to] = p.y[from];
+        p.vx[to] = p.vx[from];
+        p.vy[to] = p.vy[from];
+        p.ax[to] = p.ax[from];
+        p.ay[to] = p.ay[from];
+        p.mass[to] = p.mass[from];
+        p.radius[to] = p.radius[from];
+        if (mass[k] != p.mass[to]) p.setMass(to, mass[k]);
+        p.active[to] = 1;
+    }
+
+    // the freed slots become padding: no mass, no motion
+    for (std::size_t k = kept; k < count; ++k)
+    {
+        const std::size_t i = this->getIndex(system, k);
+        p.vx[i] = p.vy[i] = p.ax[i] = p.ay[i] = 0.f;
+        p.mass[i] = p.radius[i] = 0.f;
+        p.active[i] = 0;
+    }
+
+    this->systems[system].particleCount = kept;
+    return true;
+}
+
+void Ensemble::computeForces(const std::size_t batch)
+{
+    // the slots of the batch below its count, every lane at once
+    const std::size_t begin = batch * this->capacity * ForceKernels::laneCount;
+    const std::size_t end = begin + this->batchCounts[batch] * ForceKernels::laneCount;
+    ParticleStore& p = this->particles;
+    std::fill(p.ax.begin() + begin, p.ax.begin() + end, 0.f);
+    std::fill(p.ay.begin() + begin, p.ay.begin() + end, 0.f);
+    this->kernel.lanes(p.x.data() + begin, p.y.data() + begin, p.mass.data() + begin, this->batchCounts[batch],
+        this->interaction, p.ax.data() + begin, p.ay.data() + begin);
+}
+
+void Ensemble::stepBatch(const std::size_t batch, const float dt, const bool collisions, WorkerScratch& scratch)
+{
+    const std::size_t lanes = ForceKernels::laneCount;
+    const std::size_t firstSystem = batch * lanes;
+    const std::size_t lastSystem = std::min(firstSystem + lanes, this->systemCount);
+    StepStatistics& statistics = scratch.statistics;
+    sf::Clock clock;
+
+    if (collisions)
+    {
+        bool merged = false;
+        for (std::size_t system = firstSystem; system < lastSystem; ++system)
+            merged = this->handleCollisions(system, scratch) || merged;
+
+        // merged bodies change the forces, and the batch may have shrunk
+        if (merged)
+        {
+            std::size_t count = 0;
+            for (std::size_t system = firstSystem; system < lastSystem; ++system)
+                count = std::max(count, this->systems[system].particleCount);
+            this->batchCounts[batch] = count;
+            this->accelerationsCurrent[batch] = 0;
+        }
+        statistics.collisionTime += clock.restart();
+    }
+
+    // pairs of one force evaluation of the batch, counted per evaluation like ParticleSystem::integrate
+    std::size_t pairCount = 0;
+    for (std::size_t system = firstSystem; system < lastSystem; ++system)
+    {
+        const std::size_t count = this->systems[system].particleCount;
+        pairCount += count > 0 ? count * (count - 1) / 2 : 0;
+    }
+
+    ParticleStore& p = this->particles;
+    const std::size_t begin = batch * this->capacity * lanes;
+    const std::size_t end = begin + this->batchCounts[batch] * lanes;
+    auto kick = [&](const float step) {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            if (!p.active[i]) continue;
+            p.vx[i] += p.ax[i] * step;
+            p.vy[i] += p.ay[i] * step;
+        }
+    };
+    auto drift = [&](const float step) {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            if (!p.active[i]) continue;
+            p.x[i] += p.vx[i] * step;
+            p.y[i] += p.vy[i] * step;
+        }
+    };
+    auto evaluateForces = [&]() {
+        statistics.integrationTime += clock.restart();
+        this->computeForces(batch);
+        statistics.forceTime += clock.restart();
+        statistics.interactionCount += pairCount;
+    };
+
+    // the integrators of ParticleSystem::integrate, on the slots of the batch
+    if (this->integrator == ParticleSystem::Integrator::SemiImplicitEuler)
+    {
+        evaluateForces();
+        kick(dt);
+        drift(dt);
+        this->accelerationsCurrent[batch] = 0;
+        statistics.integrationTime += clock.restart();
+        return;
+    }
+
+    const float cubeRoot = static_cast<float>(std::cbrt(2.0));
+    const float yoshidaWeights[3] = { 1.f / (2.f - cubeRoot), -cubeRoot / (2.f - cubeRoot), 1.f / (2.f - cubeRoot) };
+    const float leapfrogWeights[1] = { 1.f };
+    const bool yoshida = this->integrator == ParticleSystem::Integrator::Yoshida;
+    const float* weights = yoshida ? yoshidaWeights : leapfrogWeights;
+    const std::size_t stageCount = yoshida ? 3 : 1;
+
+    // first same as last, unless merges or a parameter change made the stored accelerations stale
+    if (!this->accelerationsCurrent[batch]) evaluateForces();
+    for (std::size_t stage = 0; stage < stageCount; ++stage)
+    {
+        const float stageStep = weights[stage] * dt;
+        kick(stageStep / 2.f);
+        drift(stageStep);
+        evaluateForces();
+        kick(stageStep / 2.f);
+    }
+    this->accelerationsCurrent[batch] = 1;
+    statistics.integrationTime += clock.restart();
+}
+
+void Ensemble::step(sf::Time deltaTime, const bool collisions)
+{
+    const float dt = deltaTime.asSeconds();
+    for (WorkerScratch& scratch : this->workerScratch)
+        scratch.statistics = StepStatistics{};
+
+    // batches are independent, one per task
+    this->threadPool.run(this->batchCounts.size(), [&](std::size_t batch, std::size_t workerIndex) {
+        this->stepBatch(batch, dt, collisions, this->workerScratch[workerIndex]);
+    });
+
+    this->statistics = StepStatistics{};
+    for (const WorkerScratch& scratch : this->workerScratch)
+    {
+        this->statistics.collisionTime += scratch.statistics.collisionTime;
+        this->statistics.forceTime += scratch.statistics.forceTime;
+        this->statistics.integrationTime += scratch.statistics.integrationTime;
+        this->statistics.interactionCount += scratch.statistics.interactionCount;
+    }
+}
+
+void Ensemble::measureEnergies(const bool initial)
+{
+    this->threadPool.run(this->systemCount, [&](std::size_t system, std::size_t) {
+        const ParticleStore& p = this->particles;
+        const std::size_t count = this->systems[system].particleCount;
+
+        // the pairs of ParticleSystem::computeEnergy, each counted from both sides
+        ParticleSystem::Energy energy;
+        for (std::size_t k = 0; k < count; ++k)
+        {
+            const std::size_t i = this->getIndex(system, k);
+            energy.kinetic += 0.5 * p.mass[i] * (static_cast<double>(p.vx[i]) * p.vx[i] + static_cast<double>(p.vy[i]) * p.vy[i]);
+
+            for (std::size_t l = 0; l < count; ++l)
+            {
+                if (l == k) continue;
+                const std::size_t j = this->getIndex(system, l);
+                const double diffX = static_cast<double>(p.x[j]) - p.x[i];
+                const double diffY = static_cast<double>(p.y[j]) - p.y[i];
+                const double magnitude = std::sqrt(diffX * diffX + diffY * diffY);
+
+                energy.potential += 0.5 * p.mass[i] * p.mass[j] * ForceKernels::pairPotential(this->interaction, magnitude);
+            }
+        }
+
+        if (initial)
+            this->systems[system].initialEnergy = energy;
+        else
+            this->systems[system].finalEnergy = energy;
+    });
+}
+
+std::size_t Ensemble::getSystemCount() const
+{
+    return this->systemCount;
+}
+
+std::size_t Ensemble::getParticleCount() const
+{
+    std::size_t count = 0;
+    for (const SystemStatistics& system : this->systems)
+        count += system.particleCount;
+    return count;
+}
+
+const std::vector<Ensemble::SystemStatistics>& Ensemble::getSystems() const
+{
+    return this->systems;
+}
+
+const Ensemble::StepStatistics& Ensemble::getStatistics() const
+{
+    return this->statistics;
+}
+
+void Ensemble::setThreadCount(const std::size_t newCount)
+{
+    this->threadPool.setThreadCount(newCount);
+    this->resizeScratch();
+}
+
+void Ensemble::setInteraction(const ForceKernels::Interaction& newInteraction)
+{
+    this->interaction = newInteraction;
+    this->kernel = ForceKernels::selectKernel(this->instructionSet, this->interaction);
+    std::fill(this->accelerationsCurrent.begin(), this->accelerationsCurrent.end(), 0);
+}
+
+void Ensemble::setInstructionSet(const ForceKernels::InstructionSet newInstructionSet)
+{
+    this->instructionSet = newInstructionSet;
+    this->kernel = ForceKernels::selectKernel(this->instructionSet, this->interaction);
+}
+
+void Ensemble::setIntegrator(const ParticleSystem::Integrator newIntegrator)
+{
+    this->integrator = newIntegrator;
+    std::fill(this->accelerationsCurrent.begin(), this->accelerationsCurrent.end(), 0);
+}
+
+ForceKernels::InstructionSet Ensemble::getInstructionSet() const
+{
+    return this->kernel.laneInstructionSet;
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <vector>
+#include <cstdint>
+
+#include "ForceKernels.h"
+#include "ParticleStore.h"
+#include "ParticleSystem.h"
+#include "ThreadPool.h"
+
+// many independent small systems stepped together, for parameter sweeps over thousands of 50 - 500 body runs
+// all members live in one store, in batches of ForceKernels::laneCount systems interleaved body by body: body k of
+// system s is at (s / laneCount * capacity + k) * laneCount + s % laneCount, so one vector instruction evaluates the
+// same pair in every system of a batch; the batches are distributed over the thread pool, one batch per task
+// every member is simulated like a ParticleSystem with direct summation, shared timesteps and merging collisions
+class Ensemble
+{
+public:
+
+    // diagnostics of one member
+    struct SystemStatistics
+    {
+        std::uint64_t seed = 0;
+        std::size_t initialParticleCount = 0;
+        std::size_t particleCount = 0;
+        ParticleSystem::Energy initialEnergy;
+        ParticleSystem::Energy finalEnergy;
+    };
+
+    // phases of the last step, summed over the batches (so over the workers); what step took is the wall time
+    struct StepStatistics
+    {
+        sf::Time collisionTime;
+        sf::Time forceTime;
+        sf::Time integrationTime;
+        std::size_t interactionCount = 0;
+    };
+
+private:
+
+    ParticleStore particles;
+    std::size_t systemCount;
+    // body slots per system, padded with inactive zero masses where a member has fewer (or lost some to merges)
+    std::size_t capacity;
+    // the slots of every lane of batch b below batchCounts[b] hold the active bodies, merges shrink it
+    std::vector<std::size_t> batchCounts;
+    // the accelerations in the store are the ones of the current positions (kick-drift-kick reuses them)
+    std::vector<std::uint8_t> accelerationsCurrent;
+    std::vector<SystemStatistics> systems;
+
+    ForceKernels::Interaction interaction;
+    ForceKernels::InstructionSet instructionSet;
+    ForceKernels::Kernel kernel;
+    ParticleSystem::Integrator integrator;
+
+    ThreadPool threadPool;
+
+    // per worker scratch of the collisions and the batch timings, sized when the thread count or the capacity changes
+    struct WorkerScratch
+    {
+        std::vector<std::size_t> order;
+        std::vector<std::size_t> parent;
+        std::vector<float> mass;
+        StepStatistics statistics;
+    };
+    std::vector<WorkerScratch> workerScratch;
+    StepStatistics statistics;
+
+    std::size_t getIndex(const std::size_t system, const std::size_t body) const;
+    void resizeScratch();
+
+    // merges the touching bodies of one member (sweep and prune on the OX axis, union-find like the active groups of
+    // ParticleSystem), then compacts its active bodies to the front of its slots; true if anything merged
+    bool handleCollisions(const std::size_t system, WorkerScratch& scratch);
+    void computeForces(const std::size_t batch);
+    void stepBatch(const std::size_t batch, const float dt, const bool collisions, WorkerScratch& scratch);
+
+public:
+
+    Ensemble();
+
+    Ensemble(const Ensemble&) = delete;
+    Ensemble& operator=(const Ensemble&) = delete;
+
+    // replaces the members with systemCount systems of particleCount bodies, member s seeded with firstSeed + s
+    // member s starts from the same bodies as ParticleSystem::distributeParticles after setRandomSeed(firstSeed + s)
+    void distributeSystems(const ParticleSystem::Distribution distribution, const std::size_t systemCount,
+        const std::size_t particleCount, const float scale, const std::uint64_t firstSeed);
+
+    // one shared step of every member: collisions (if enabled), then the integrator
+    void step(sf::Time deltaTime, const bool collisions);
+
+    // O(n^2) per member on the thread pool, stored as the initial or the final energy of every member
+    void measureEnergies(const bool initial);
+
+    std::size_t getSystemCount() const;
+    // active bodies of all members together
+    std::size_t getParticleCount() const;
+    const std::vector<SystemStatistics>& getSystems() const;
+    const StepStatistics& getStatistics() const;
+
+    void setThreadCount(const std::size_t newCount);
+    void setInteraction(const ForceKernels::Interaction& newInteraction);
+    void setInstructionSet(const ForceKernels::InstructionSet newInstructionSet);
+    void setIntegrator(const ParticleSystem::Integrator newIntegrator);
+    ForceKernels::InstructionSet getInstructionSet() const;
+};
\ No newline at end of file
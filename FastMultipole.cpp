@@ -0,0 +1,488 @@
+#include "FastMultipole.h"
+
+#include <cmath>
+#include <algorithm>
+
+FastMultipole::FastMultipole(std::size_t leafCapacity, std::size_t maxDepth)
+    : cells{}, positionsX{ nullptr }, positionsY{ nullptr }, order{ 0 }, coefficientCount{ 1 },
+    leafCapacity{ std::max<std::size_t>(leafCapacity, 1) }, maxDepth{ std::min<std::size_t>(maxDepth, 64) } {}
+
+std::size_t FastMultipole::getIndex(const std::size_t a, const std::size_t b)
+{
+    // coefficients ordered by total degree, then by the power of y
+    return (a + b) * (a + b + 1) / 2 + b;
+}
+
+std::size_t FastMultipole::getOrder() const
+{
+    return this->order;
+}
+
+std::size_t FastMultipole::getCellCount() const
+{
+    return this->cells.size();
+}
+
+std::size_t FastMultipole::getTaskCount() const
+{
+    return this->taskCells.size();
+}
+
+void FastMultipole::buildCell(std::size_t cellIndex, std::size_t depth)
+{
+    const std::size_t begin = this->cells[cellIndex].bodyBegin;
+    const std::size_t end = this->cells[cellIndex].bodyEnd;
+    if (end - begin <= this->leafCapacity || depth >= this->maxDepth) return;
+
+    const double centerX = this->cells[cellIndex].centerX;
+    const double centerY = this->cells[cellIndex].centerY;
+    const double quarterSize = this->cells[cellIndex].halfSize / 2.0;
+
+    // split the bodies into quadrants: first on the OY axis, then each half on the OX axis
+    auto first = this->bodyIndices.begin() + begin;
+    auto last = this->bodyIndices.begin() + end;
+    auto middleY = std::partition(first, last, [&](std::size_t body) { return this->positionsY[body] < centerY; });
+    auto middleTop = std::partition(first, middleY, [&](std::size_t body) { return this->positionsX[body] < centerX; });
+    auto middleBottom = std::partition(middleY, last, [&](std::size_t body) { return this->positionsX[body] < centerX; });
+
+    const std::size_t bounds[5] = {
+        begin,
+        static_cast<std::size_t>(middleTop - this->bodyIndices.begin()),
+        static_cast<std::size_t>(middleY - this->bodyIndices.begin()),
+        static_cast<std::size_t>(middleBottom - this->bodyIndices.begin()),
+        end
+    };
+    const double offsets[4][2] = { { -1.0, -1.0 }, { 1.0, -1.0 }, { -1.0, 1.0 }, { 1.0, 1.0 } };
+
+    // adaptive: only the non-empty quadrants become children, stored contiguously
+    const std::size_t childBegin = this->cells.size();
+    for (std::size_t q = 0; q < 4; ++q)
+    {
+        if (bounds[q] == bounds[q + 1]) continue;
+
+        Cell child{};
+        child.centerX = centerX + offsets[q][0] * quarterSize;
+        child.centerY = centerY + offsets[q][1] * quarterSize;
+        child.halfSize = quarterSize;
+        child.bodyBegin = bounds[q];
+        child.bodyEnd = bounds[q + 1];
+        this->cells.push_back(child);
+    }
+    const std::size_t childEnd = this->cells.size();
+    this->cells[cellIndex].childBegin = childBegin;
+    this->cells[cellIndex].childEnd = childEnd;
+
+    // don't hold references into cells while it grows
+    for (std::size_t child = childBegin; child < childEnd; ++child)
+        this->buildCell(child, depth + 1);
+}
+
+void FastMultipole::build(const float* x, const float* y, const float* m, std::size_t count, std::size_t begin, std::size_t end,
+    const std::uint8_t* targets, std::size_t newOrder, std::size_t taskCountHint)
+{
+    this->positionsX = x;
+    this->positionsY = y;
+
+    newOrder = std::min(std::max<std::size_t>(newOrder, 1), maxOrder);
+    if (newOrder != this->order)
+    {
+        this->order = newOrder;
+        this->coefficientCount = (newOrder + 1) * (newOrder + 2) / 2;
+
+        // pascal's triangle
+        this->binomial.assign(newOrder + 1, std::vector<double>(newOrder + 1, 0.0));
+        for (std::size_t n = 0; n <= newOrder; ++n)
+        {
+            this->binomial[n][0] = 1.0;
+            for (std::size_t k = 1; k <= n; ++k)
+                this->binomial[n][k] = this->binomial[n - 1][k - 1] + (k < n ? this->binomial[n - 1][k] : 0.0);
+        }
+    }
+
+    this->cells.clear();
+    this->taskCells.clear();
+    this->upperCells.clear();
+    this->bodyIndices.resize(count);
+    for (std::size_t i = 0; i < count; ++i) this->bodyIndices[i] = i;
+
+    if (count == 0) return;
+
+    // square bounds around every body
+    float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        minX = std::min(minX, x[i]);
+        maxX = std::max(maxX, x[i]);
+        minY = std::min(minY, y[i]);
+        maxY = std::max(maxY, y[i]);
+    }
+
+    Cell root{};
+    root.centerX = (static_cast<double>(minX) + maxX) / 2.0;
+    root.centerY = (static_cast<double>(minY) + maxY) / 2.0;
+    // slightly enlarged so bodies on the edge still fall inside
+    root.halfSize = std::max<double>(maxX - minX, maxY - minY) / 2.0 * 1.001 + 1e-3;
+    root.bodyBegin = 0;
+    root.bodyEnd = count;
+    this->cells.push_back(root);
+    this->buildCell(0, 0);
+
+    // copy the bodies in tree order so the leaves are contiguous in memory
+    this->bodyX.resize(count);
+    this->bodyY.resize(count);
+    this->bodyMass.resize(count);
+    this->isTarget.resize(count);
+    this->directX.assign(count, 0.0);
+    this->directY.assign(count, 0.0);
+    for (std::size_t k = 0; k < count; ++k)
+    {
+        const std::size_t body = this->bodyIndices[k];
+        this->bodyX[k] = x[body];
+        this->bodyY[k] = y[body];
+        this->bodyMass[k] = m[body];
+        this->isTarget[k] = body >= begin && body < end && (!targets || targets[body]);
+    }
+
+    // children always come after their parent => one backward pass counts the targets bottom up
+    for (std::size_t c = this->cells.size(); c-- > 0;)
+    {
+        Cell& cell = this->cells[c];
+        cell.targetCount = 0;
+        if (cell.childBegin == cell.childEnd)
+        {
+            for (std::size_t k = cell.bodyBegin; k < cell.bodyEnd; ++k)
+                cell.targetCount += this->isTarget[k];
+        }
+        else
+        {
+            for (std::size_t child = cell.childBegin; child < cell.childEnd; ++child)
+                cell.targetCount += this->cells[child].targetCount;
+        }
+    }
+
+    this->multipoles.assign(this->cells.size() * this->coefficientCount, 0.0);
+    this->locals.assign(this->cells.size() * this->coefficientCount, 0.0);
+
+    // open the tree level by level until there are enough independent subtrees
+    this->taskCells.push_back(0);
+    std::vector<std::size_t>& frontier = this->frontierCells;
+    bool opened = true;
+    while (opened && this->taskCells.size() < taskCountHint)
+    {
+        // a cell with a single child opens without adding tasks, so count the opened cells, not the tasks
+        opened = false;
+        frontier.clear();
+        for (std::size_t c : this->taskCells)
+        {
+            if (this->cells[c].childBegin == this->cells[c].childEnd)
+            {
+                frontier.push_back(c);
+                continue;
+            }
+            opened = true;
+            this->upperCells.push_back(c);
+            for (std::size_t child = this->cells[c].childBegin; child < this->cells[c].childEnd; ++child)
+                frontier.push_back(child);
+        }
+        this->taskCells.swap(frontier);
+    }
+}
+
+void FastMultipole::computeCellMultipole(std::size_t cellIndex)
+{
+    Cell& cell = this->cells[cellIndex];
+    double* multipole = &this->multipoles[cellIndex * this->coefficientCount];
+    const std::size_t p = this->order;
+
+    double powersX[maxOrder + 1];
+    double powersY[maxOrder + 1];
+    powersX[0] = powersY[0] = 1.0;
+
+    cell.radius = 0.0;
+    if (cell.childBegin == cell.childEnd)
+    {
+        // P2M: M(a, b) = sum of m * dx^a * dy^b
+        for (std::size_t k = cell.bodyBegin; k < cell.bodyEnd; ++k)
+        {
+            const double dx = this->bodyX[k] - cell.centerX;
+            const double dy = this->bodyY[k] - cell.centerY;
+            cell.radius = std::max(cell.radius, std::sqrt(dx * dx + dy * dy));
+
+            for (std::size_t i = 1; i <= p; ++i)
+            {
+                powersX[i] = powersX[i - 1] * dx;
+                powersY[i] = powersY[i - 1] * dy;
+            }
+            for (std::size_t n = 0; n <= p; ++n)
+                for (std::size_t b = 0; b <= n; ++b)
+                    multipole[getIndex(n - b, b)] += this->bodyMass[k] * powersX[n - b] * powersY[b];
+        }
+        return;
+    }
+
+    // M2M: shifting by t = child center - center turns dx^a into sum of C(a, i) * t^(a - i) * dx^i
+    for (std::size_t child = cell.childBegin; child < cell.childEnd; ++child)
+    {
+        const double* childMultipole = &this->multipoles[child * this->coefficientCount];
+        const double tx = this->cells[child].centerX - cell.centerX;
+        const double ty = this->cells[child].centerY - cell.centerY;
+        cell.radius = std::max(cell.radius, std::sqrt(tx * tx + ty * ty) + this->cells[child].radius);
+
+        for (std::size_t i = 1; i <= p; ++i)
+        {
+            powersX[i] = powersX[i - 1] * tx;
+            powersY[i] = powersY[i - 1] * ty;
+        }
+        for (std::size_t n = 0; n <= p; ++n)
+        {
+            for (std::size_t b = 0; b <= n; ++b)
+            {
+                const std::size_t a = n - b;
+                double sum = 0.0;
+                for (std::size_t i = 0; i <= a; ++i)
+                    for (std::size_t j = 0; j <= b; ++j)
+                        sum += this->binomial[a][i] * this->binomial[b][j] * powersX[a - i] * powersY[b - j] * childMultipole[getIndex(i, j)];
+                multipole[getIndex(a, b)] += sum;
+            }
+        }
+    }
+}
+
+void FastMultipole::computeSubtreeMultipoles(std::size_t cellIndex)
+{
+    for (std::size_t child = this->cells[cellIndex].childBegin; child < this->cells[cellIndex].childEnd; ++child)
+        this->computeSubtreeMultipoles(child);
+    this->computeCellMultipole(cellIndex);
+}
+
+void FastMultipole::computeMultipoles(std::size_t task)
+{
+    this->computeSubtreeMultipoles(this->taskCells[task]);
+}
+
+void FastMultipole::computeUpperMultipoles()
+{
+    // upperCells lists parents before children
+    for (std::size_t k = this->upperCells.size(); k-- > 0;)
+        this->computeCellMultipole(this->upperCells[k]);
+}
+
+void FastMultipole::computeDerivatives(double rx, double ry, double* derivatives) const
+{
+    // recurrence of the taylor coefficients D(m) of 1 / |R|, with n = |m|:
+    // n * R^2 * D(m) = -(2n - 1) * (rx * D(m - ex) + ry * D(m - ey)) - (n - 1) * (D(m - 2ex) + D(m - 2ey))
+    const double rSquared = rx * rx + ry * ry;
+    derivatives[0] = 1.0 / std::sqrt(rSquared);
+
+    for (std::size_t n = 1; n <= this->order; ++n)
+    {
+        const double scale = 1.0 / (n * rSquared);
+        for (std::size_t b = 0; b <= n; ++b)
+        {
+            const std::size_t a = n - b;
+            double first = 0.0, second = 0.0;
+            if (a >= 1) first += rx * derivatives[getIndex(a - 1, b)];
+            if (b >= 1) first += ry * derivatives[getIndex(a, b - 1)];
+            if (a >= 2) second += derivatives[getIndex(a - 2, b)];
+            if (b >= 2) second += derivatives[getIndex(a, b - 2)];
+            derivatives[getIndex(a, b)] = -(scale * ((2.0 * n - 1.0) * first + (n - 1.0) * second));
+        }
+    }
+}
+
+void FastMultipole::translateMultipoleToLocal(std::size_t target, std::size_t source, double G, double* derivatives)
+{
+    // with R = target center - source center, a target offset h and a source offset s:
+    // 1 / |R + h - s| = sum over k, n of C(k + n, k) * (-1)^|n| * D(k + n) * h^k * s^n
+    // so the potential -G * sum m / r has local coefficients L(k) = -G * sum over n of C(k + n, k) * (-1)^|n| * D(k + n) * M(n)
+    const Cell& targetCell = this->cells[target];
+    const Cell& sourceCell = this->cells[source];
+    this->computeDerivatives(targetCell.centerX - sourceCell.centerX, targetCell.centerY - sourceCell.centerY, derivatives);
+
+    const double* multipole = &this->multipoles[source * this->coefficientCount];
+    double* local = &this->locals[target * this->coefficientCount];
+    const std::size_t p = this->order;
+
+    for (std::size_t kn = 0; kn <= p; ++kn)
+    {
+        for (std::size_t kb = 0; kb <= kn; ++kb)
+        {
+            const std::size_t ka = kn - kb;
+            double sum = 0.0;
+            for (std::size_t nn = 0; nn + kn <= p; ++nn)
+            {
+                double degreeSum = 0.0;
+                for (std::size_t nb = 0; nb <= nn; ++nb)
+                {
+                    const std::size_t na = nn - nb;
+                    degreeSum += this->binomial[ka + na][ka] * this->binomial[kb + nb][kb]
+                        * derivatives[getIndex(ka + na, kb + nb)] * multipole[getIndex(na, nb)];
+                }
+                sum += nn % 2 == 0 ? degreeSum : -degreeSum;
+            }
+            local[getIndex(ka, kb)] -= G * sum;
+        }
+    }
+}
+
+void FastMultipole::sumDirectly(std::size_t target, std::size_t source, double G, double magnitudeThreshold)
+{
+    const Cell& targetCell = this->cells[target];
+    const Cell& sourceCell = this->cells[source];
+
+    for (std::size_t k = targetCell.bodyBegin; k < targetCell.bodyEnd; ++k)
+    {
+        if (!this->isTarget[k]) continue;
+
+        const double x = this->bodyX[k], y = this->bodyY[k];
+        double accelerationX = 0.0, accelerationY = 0.0;
+        for (std::size_t l = sourceCell.bodyBegin; l < sourceCell.bodyEnd; ++l)
+        {
+            // same softening as the direct summation; coincident bodies (and the body itself) exert nothing
+            const double diffX = this->bodyX[l] - x;
+            const double diffY = this->bodyY[l] - y;
+            const double magnitude_squared = diffX * diffX + diffY * diffY;
+            if (magnitude_squared == 0.0) continue;
+
+            const double magnitude = std::sqrt(magnitude_squared);
+            const double tmp = G * this->bodyMass[l] / (std::max(magnitude_squared, magnitudeThreshold) * magnitude);
+            accelerationX += tmp * diffX;
+            accelerationY += tmp * diffY;
+        }
+        this->directX[k] += accelerationX;
+        this->directY[k] += accelerationY;
+    }
+}
+
+void FastMultipole::interact(std::size_t target, std::size_t source, double theta, double G, double magnitudeThreshold,
+    double* derivatives, std::size_t& interactions)
+{
+    const Cell& targetCell = this->cells[target];
+    const Cell& sourceCell = this->cells[source];
+    if (targetCell.targetCount == 0) return;
+
+    const double diffX = targetCell.centerX - sourceCell.centerX;
+    const double diffY = targetCell.centerY - sourceCell.centerY;
+    const double radii = targetCell.radius + sourceCell.radius;
+    if (radii * radii < theta * theta * (diffX * diffX + diffY * diffY))
+    {
+        // well separated => the whole source acts on the whole target through one translation
+        ++interactions;
+        this->translateMultipoleToLocal(target, source, G, derivatives);
+        return;
+    }
+
+    const bool targetIsLeaf = targetCell.childBegin == targetCell.childEnd;
+    const bool sourceIsLeaf = sourceCell.childBegin == sourceCell.childEnd;
+    if (targetIsLeaf && sourceIsLeaf)
+    {
+        interactions += targetCell.targetCount * (sourceCell.bodyEnd - sourceCell.bodyBegin);
+        this->sumDirectly(target, source, G, magnitudeThreshold);
+        return;
+    }
+
+    // open the larger of the two cells
+    if (sourceIsLeaf || (!targetIsLeaf && targetCell.radius >= sourceCell.radius))
+    {
+        for (std::size_t child = targetCell.childBegin; child < targetCell.childEnd; ++child)
+            this->interact(child, source, theta, G, magnitudeThreshold, derivatives, interactions);
+    }
+    else
+    {
+        for (std::size_t child = sourceCell.childBegin; child < sourceCell.childEnd; ++child)
+            this->interact(target, child, theta, G, magnitudeThreshold, derivatives, interactions);
+    }
+}
+
+void FastMultipole::evaluateLocals(std::size_t cellIndex, float* ax, float* ay)
+{
+    const Cell& cell = this->cells[cellIndex];
+    if (cell.targetCount == 0) return;
+
+    const double* local = &this->locals[cellIndex * this->coefficientCount];
+    const std::size_t p = this->order;
+
+    double powersX[maxOrder + 1];
+    double powersY[maxOrder + 1];
+    powersX[0] = powersY[0] = 1.0;
+
+    if (cell.childBegin != cell.childEnd)
+    {
+        // L2L: re-expanding about t = child center - center gives L'(j) = sum over k >= j of C(k, j) * t^(k - j) * L(k)
+        for (std::size_t child = cell.childBegin; child < cell.childEnd; ++child)
+        {
+            double* childLocal = &this->locals[child * this->coefficientCount];
+            const double tx = this->cells[child].centerX - cell.centerX;
+            const double ty = this->cells[child].centerY - cell.centerY;
+            for (std::size_t i = 1; i <= p; ++i)
+            {
+                powersX[i] = powersX[i - 1] * tx;
+                powersY[i] = powersY[i - 1] * ty;
+            }
+
+            for (std::size_t jn = 0; jn <= p; ++jn)
+            {
+                for (std::size_t jb = 0; jb <= jn; ++jb)
+                {
+                    const std::size_t ja = jn - jb;
+                    double sum = 0.0;
+                    for (std::size_t kn = jn; kn <= p; ++kn)
+                    {
+                        for (std::size_t kb = jb; kb <= kn; ++kb)
+                        {
+                            const std::size_t ka = kn - kb;
+                            if (ka < ja) continue;
+                            sum += this->binomial[ka][ja] * this->binomial[kb][jb] * powersX[ka - ja] * powersY[kb - jb] * local[getIndex(ka, kb)];
+                        }
+                    }
+                    childLocal[getIndex(ja, jb)] += sum;
+                }
+            }
+
+            this->evaluateLocals(child, ax, ay);
+        }
+        return;
+    }
+
+    // L2P: the acceleration is minus the gradient of the local expansion
+    for (std::size_t k = cell.bodyBegin; k < cell.bodyEnd; ++k)
+    {
+        if (!this->isTarget[k]) continue;
+
+        const double hx = this->bodyX[k] - cell.centerX;
+        const double hy = this->bodyY[k] - cell.centerY;
+        for (std::size_t i = 1; i <= p; ++i)
+        {
+            powersX[i] = powersX[i - 1] * hx;
+            powersY[i] = powersY[i - 1] * hy;
+        }
+
+        double gradientX = 0.0, gradientY = 0.0;
+        for (std::size_t n = 1; n <= p; ++n)
+        {
+            for (std::size_t b = 0; b <= n; ++b)
+            {
+                const std::size_t a = n - b;
+                const double coefficient = local[getIndex(a, b)];
+                if (a >= 1) gradientX += coefficient * a * powersX[a - 1] * powersY[b];
+                if (b >= 1) gradientY += coefficient * b * powersX[a] * powersY[b - 1];
+            }
+        }
+
+        const std::size_t body = this->bodyIndices[k];
+        ax[body] += static_cast<float>(this->directX[k] - gradientX);
+        ay[body] += static_cast<float>(this->directY[k] - gradientY);
+    }
+}
+
+std::size_t FastMultipole::evaluate(std::size_t task, float theta, float G, float magnitudeThreshold, float* ax, float* ay)
+{
+    const std::size_t taskCell = this->taskCells[task];
+    if (this->cells[taskCell].targetCount == 0) return 0;
+
+    double derivatives[maxCoefficientCount];
+    std::size_t interactions = 0;
+    this->interact(taskCell, 0, theta, G, magnitudeThreshold, derivatives, interactions);
+    this->evaluateLocals(taskCell, ax, ay);
+    return interactions;
+}
\ No newline at end of file
@@ -0,0 +1,117 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// fast multipole method for the planar 1 / r potential of the simulation, rebuilt from scratch every step
+// cells of an adaptive quadtree carry multipole and local expansions of order p in the offsets from their center
+// (cartesian monomials dx^a * dy^b with a + b <= p), well separated cells interact through one M2L translation
+// and only neighbouring leaves are summed directly => O(n) for a fixed order and separation
+//
+// the work is split into independent subtrees ("tasks") so the caller can spread the passes over its threads:
+// build -> computeMultipoles(task) for every task -> computeUpperMultipoles -> evaluate(task) for every task
+class FastMultipole
+{
+public:
+
+    static const std::size_t maxOrder = 16;
+    static const std::size_t maxCoefficientCount = (maxOrder + 1) * (maxOrder + 2) / 2;
+
+private:
+
+    struct Cell
+    {
+        // square bounds of the cell, the expansions are taken about its center
+        double centerX;
+        double centerY;
+        double halfSize;
+
+        // distance from the center to the farthest body inside
+        double radius;
+
+        // range of the children (empty for leaves) and of the bodies inside (indices into the tree order)
+        std::size_t childBegin;
+        std::size_t childEnd;
+        std::size_t bodyBegin;
+        std::size_t bodyEnd;
+
+        // bodies inside that belong to the evaluated range
+        std::size_t targetCount;
+    };
+
+    std::vector<Cell> cells;
+
+    // input positions, only used by build
+    const float* positionsX;
+    const float* positionsY;
+
+    // bodies in tree order and their index in the input arrays
+    std::vector<std::size_t> bodyIndices;
+    std::vector<double> bodyX;
+    std::vector<double> bodyY;
+    std::vector<double> bodyMass;
+    std::vector<std::uint8_t> isTarget;
+
+    // near field accelerations of the bodies, accumulated by sumDirectly before evaluateLocals adds the far field
+    std::vector<double> directX;
+    std::vector<double> directY;
+
+    // coefficientCount coefficients per cell
+    std::vector<double> multipoles;
+    std::vector<double> locals;
+
+    // roots of the task subtrees and the cells above them (parents before children)
+    std::vector<std::size_t> taskCells;
+    std::vector<std::size_t> upperCells;
+    // next level of taskCells while the tree is opened, kept so rebuilding does not allocate
+    std::vector<std::size_t> frontierCells;
+
+    std::size_t order;
+    std::size_t coefficientCount;
+    std::size_t leafCapacity;
+    std::size_t maxDepth;
+
+    // binomial[n][k] = n choose k for n <= order
+    std::vector<std::vector<double>> binomial;
+
+    static std::size_t getIndex(const std::size_t a, const std::size_t b);
+
+    void buildCell(std::size_t cellIndex, std::size_t depth);
+    void computeCellMultipole(std::size_t cellIndex);
+    void computeSubtreeMultipoles(std::size_t cellIndex);
+
+    // taylor coefficients of 1 / |R + u| in u, i.e. derivatives of 1 / |R| divided by the factorials
+    void computeDerivatives(double rx, double ry, double* derivatives) const;
+
+    // one sided dual tree walk: adds the effect of every body in source to the bodies in target
+    void interact(std::size_t target, std::size_t source, double theta, double G, double magnitudeThreshold,
+        double* derivatives, std::size_t& interactions);
+    void translateMultipoleToLocal(std::size_t target, std::size_t source, double G, double* derivatives);
+    void sumDirectly(std::size_t target, std::size_t source, double G, double magnitudeThreshold);
+
+    // pushes the locals down to the leaves and evaluates them at the target bodies
+    void evaluateLocals(std::size_t cellIndex, float* ax, float* ay);
+
+public:
+
+    FastMultipole(std::size_t leafCapacity = 16, std::size_t maxDepth = 48);
+
+    std::size_t getOrder() const;
+    std::size_t getCellCount() const;
+    std::size_t getTaskCount() const;
+
+    // builds the tree over every body and splits it into about taskCountHint subtrees
+    // only bodies in [begin, end) (and with targets[i] set, if targets is given) get accelerations
+    // the bodies are copied, so the arrays may change afterwards
+    void build(const float* x, const float* y, const float* m, std::size_t count, std::size_t begin, std::size_t end,
+        const std::uint8_t* targets, std::size_t newOrder, std::size_t taskCountHint);
+
+    // upward pass: P2M at the leaves and M2M towards the root of the task subtree, then of the cells above the tasks
+    void computeMultipoles(std::size_t task);
+    void computeUpperMultipoles();
+
+    // walks the tree for the task subtree and adds the accelerations of its target bodies to ax, ay
+    // cells are well separated when (radius1 + radius2) < theta * distance between their centers
+    // returns the number of M2L translations and body-body interactions
+    std::size_t evaluate(std::size_t task, float theta, float G, float magnitudeThreshold, float* ax, float* ay);
+};
\ No newline at end of file
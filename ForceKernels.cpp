@@ -0,0 +1,591 @@
+#include "ForceKernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NBODY_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// msvc emits any intrinsic without flags, gcc and clang need the target enabled per function
+#if defined(_MSC_VER) && !defined(__clang__)
+#define NBODY_TARGET(features)
+#else
+#define NBODY_TARGET(features) __attribute__((target(features)))
+#endif
+
+namespace
+{
+    using ForceKernels::Interaction;
+    using ForceKernels::Kernel;
+    using ForceKernels::Softening;
+
+    // one pair interaction with every model decision made at compile time
+    template <typename Scalar, Softening softening, bool unitG>
+    struct PairKernel
+    {
+        Scalar G;
+        Scalar softeningSquared;
+        // spline support h = 2.8 eps
+        Scalar splineInverse;
+        Scalar splineInverseCubed;
+
+        explicit PairKernel(const Interaction& interaction)
+            : G{ static_cast<Scalar>(interaction.G) },
+            softeningSquared{ static_cast<Scalar>(interaction.softeningLength) * static_cast<Scalar>(interaction.softeningLength) },
+            splineInverse{ Scalar(1) / (Scalar(2.8) * static_cast<Scalar>(interaction.softeningLength)) },
+            splineInverseCubed{ splineInverse * splineInverse * splineInverse } {}
+
+        // f with a_i += f * m_j * (x_j - x_i), magnitudeSquared > 0
+        Scalar acceleration(const Scalar magnitudeSquared) const
+        {
+            Scalar factor;
+            if constexpr (softening == Softening::Clamp)
+            {
+                factor = Scalar(1) / (std::max(magnitudeSquared, this->softeningSquared) * std::sqrt(magnitudeSquared));
+            }
+            else if constexpr (softening == Softening::Plummer)
+            {
+                const Scalar softened = magnitudeSquared + this->softeningSquared;
+                factor = Scalar(1) / (softened * std::sqrt(softened));
+            }
+            else
+            {
+                // u = r / h, the kernel of springel (2005) with the force written per unit separation
+                const Scalar magnitude = std::sqrt(magnitudeSquared);
+                const Scalar u = magnitude * this->splineInverse;
+                if (u >= Scalar(1))
+                    factor = Scalar(1) / (magnitudeSquared * magnitude);
+                else if (u < Scalar(0.5))
+                    factor = this->splineInverseCubed * (Scalar(32) / 3 + u * u * (Scalar(32) * u - Scalar(38.4)));
+                else
+                    factor = this->splineInverseCubed * (Scalar(64) / 3 + u * (Scalar(-48) + u * (Scalar(38.4) - Scalar(32) / 3 * u)))
+                        - Scalar(1) / (Scalar(15) * magnitudeSquared * magnitude);
+            }
+
+            if constexpr (unitG) return factor;
+            else return this->G * factor;
+        }
+
+        // pair potential per unit mass product, its derivative d/dr is acceleration(r^2) * r (the pull towards the source)
+        Scalar potential(const Scalar magnitude) const
+        {
+            Scalar value;
+            if constexpr (softening == Softening::Clamp)
+            {
+                // -1 / r outside the softening length, continued linearly inside where the force is constant
+                const Scalar softeningLength = std::sqrt(this->softeningSquared);
+                value = magnitude >= softeningLength
+                    ? -Scalar(1) / magnitude
+                    : magnitude / this->softeningSquared - Scalar(2) / softeningLength;
+            }
+            else if constexpr (softening == Softening::Plummer)
+            {
+                value = -Scalar(1) / std::sqrt(magnitude * magnitude + this->softeningSquared);
+            }
+            else
+            {
+                const Scalar u = magnitude * this->splineInverse;
+                if (u >= Scalar(1))
+                    value = -Scalar(1) / magnitude;
+                else if (u < Scalar(0.5))
+                    value = this->splineInverse * (Scalar(-2.8) + u * u * (Scalar(16) / 3 + u * u * (Scalar(6.4) * u - Scalar(9.6))));
+                else
+                    value = this->splineInverse * (Scalar(-3.2) + Scalar(1) / (Scalar(15) * u)
+                        + u * u * (Scalar(32) / 3 + u * (Scalar(-16) + u * (Scalar(9.6) - Scalar(32) / 15 * u))));
+            }
+
+            if constexpr (unitG) return value;
+            else return this->G * value;
+        }
+    };
+
+    // columns [jBegin, n) of row i, also the tail of a row that does not fill a whole register
+    template <typename Scalar, Softening softening, bool unitG>
+    void accumulateRowScalar(const float* x, const float* y, const float* m, std::size_t jBegin, std::size_t n,
+        std::size_t i, const PairKernel<Scalar, softening, unitG>& kernel, Scalar& accelerationX, Scalar& accelerationY)
+    {
+        const Scalar x1 = x[i], y1 = y[i];
+        for (std::size_t j = jBegin; j < n; ++j)
+        {
+            const Scalar diffX = x[j] - x1;
+            const Scalar diffY = y[j] - y1;
+            const Scalar magnitude_squared = diffX * diffX + diffY * diffY;
+            if (magnitude_squared == Scalar(0)) continue;
+
+            const Scalar tmp = kernel.acceleration(magnitude_squared) * m[j];
+            accelerationX += tmp * diffX;
+            accelerationY += tmp * diffY;
+        }
+    }
+
+    template <typename Scalar, Softening softening, bool unitG>
+    void accumulateRowsScalar(const float* x, const float* y, const float* m, std::size_t n,
+        std::size_t begin, std::size_t end, const Interaction& interaction, float* ax, float* ay)
+    {
+        const PairKernel<Scalar, softening, unitG> kernel(interaction);
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            Scalar accelerationX = 0, accelerationY = 0;
+            accumulateRowScalar(x, y, m, 0, n, i, kernel, accelerationX, accelerationY);
+            ax[i] += static_cast<float>(accelerationX);
+            ay[i] += static_cast<float>(accelerationY);
+        }
+    }
+
+    template <Softening softening, bool unitG>
+    void accumulateTriangle(const float* x, const float* y, const float* m, std::size_t n,
+        std::size_t begin, std::size_t end, const Interaction& interaction, float* ax, float* ay)
+    {
+        const PairKernel<float, softening, unitG> kernel(interaction);
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            const float x1 = x[i], y1 = y[i], mass1 = m[i];
+            float accelerationX = 0.f, accelerationY = 0.f;
+            for (std::size_t j = i + 1; j < n; ++j)
+            {
+                float diffX = x[j] - x1;
+                float diffY = y[j] - y1;
+                float magnitude_squared = diffX * diffX + diffY * diffY;
+                if (magnitude_squared == 0.f) continue;
+                float tmp = kernel.acceleration(magnitude_squared);
+
+                accelerationX += m[j] * tmp * diffX;
+                accelerationY += m[j] * tmp * diffY;
+                ax[j] -= mass1 * tmp * diffX;
+                ay[j] -= mass1 * tmp * diffY;
+            }
+            ax[i] += accelerationX;
+            ay[i] += accelerationY;
+        }
+    }
+
+    // the same pair (i, j) of laneCount interleaved systems, lane by lane
+    template <typename Scalar, Softening softening, bool unitG>
+    void accumulateLanesScalar(const float* x, const float* y, const float* m, std::size_t n,
+        const Interaction& interaction, float* ax, float* ay)
+    {
+        constexpr std::size_t lanes = ForceKernels::laneCount;
+        const PairKernel<Scalar, softening, unitG> kernel(interaction);
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            for (std::size_t lane = 0; lane < lanes; ++lane)
+            {
+                const std::size_t row = i * lanes + lane;
+                const Scalar x1 = x[row], y1 = y[row];
+                Scalar accelerationX = 0, accelerationY = 0;
+                for (std::size_t column = lane; column < n * lanes; column += lanes)
+                {
+                    const Scalar diffX = x[column] - x1;
+                    const Scalar diffY = y[column] - y1;
+                    const Scalar magnitude_squared = diffX * diffX + diffY * diffY;
+                    if (magnitude_squared == Scalar(0)) continue;
+
+                    const Scalar tmp = kernel.acceleration(magnitude_squared) * m[column];
+                    accelerationX += tmp * diffX;
+                    accelerationY += tmp * diffY;
+                }
+                ax[row] += static_cast<float>(accelerationX);
+                ay[row] += static_cast<float>(accelerationY);
+            }
+        }
+    }
+
+#ifdef NBODY_X86
+
+#ifdef _MSC_VER
+    void cpuid(int info[4], int leaf, int subleaf) { __cpuidex(info, leaf, subleaf); }
+    unsigned long long xgetbv() { return _xgetbv(0); }
+#else
+    void cpuid(int info[4], int leaf, int subleaf)
+    {
+        __asm__ __volatile__("cpuid" : "=a"(info[0]), "=b"(info[1]), "=c"(info[2]), "=d"(info[3]) : "a"(leaf), "c"(subleaf));
+    }
+    unsigned long long xgetbv()
+    {
+        unsigned int low, high;
+        __asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+        return (static_cast<unsigned long long>(high) << 32) | low;
+    }
+#endif
+
+    bool cpuSupportsAVX2()
+    {
+        int info[4];
+        cpuid(info, 0, 0);
+        if (info[0] < 7) return false;
+
+        // osxsave + avx + fma, and the os saves the ymm registers
+        cpuid(info, 1, 0);
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!fma || !osxsave || !avx || (xgetbv() & 0x6) != 0x6) return false;
+
+        cpuid(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }
+
+    bool cpuSupportsAVX512()
+    {
+        if (!cpuSupportsAVX2()) return false;
+
+        // avx512f, and the os saves the opmask and zmm registers
+        int info[4];
+        cpuid(info, 7, 0);
+        if ((info[1] & (1 << 16)) == 0) return false;
+        return (xgetbv() & 0xe6) == 0xe6;
+    }
+
+    // PairKernel on 8 pairs at once, shared by the row and the lane kernels
+    template <Softening softening, bool unitG>
+    struct PairKernelAVX2
+    {
+        __m256 half;
+        __m256 one;
+        __m256 threeHalves;
+        __m256 softeningSquared;
+        __m256 inverseThreshold;
+        __m256 splineInverse;
+        __m256 splineInverseCubed;
+        __m256 G;
+
+        NBODY_TARGET("avx2,fma")
+        explicit PairKernelAVX2(const PairKernel<float, softening, unitG>& kernel)
+            : half{ _mm256_set1_ps(0.5f) },
+            one{ _mm256_set1_ps(1.f) },
+            threeHalves{ _mm256_set1_ps(1.5f) },
+            softeningSquared{ _mm256_set1_ps(kernel.softeningSquared) },
+            inverseThreshold{ _mm256_set1_ps(1.f / kernel.softeningSquared) },
+            splineInverse{ _mm256_set1_ps(kernel.splineInverse) },
+            splineInverseCubed{ _mm256_set1_ps(kernel.splineInverseCubed) },
+            G{ _mm256_set1_ps(kernel.G) } {}
+
+        // f of every lane, inf/nan where magnitudeSquared == 0 (the callers mask those out)
+        NBODY_TARGET("avx2,fma")
+        __m256 acceleration(const __m256 magnitudeSquared) const
+        {
+            // ~12 bit reciprocal square root, one newton step brings it to ~23 bits
+            const __m256 root = softening == Softening::Plummer ? _mm256_add_ps(magnitudeSquared, this->softeningSquared) : magnitudeSquared;
+            __m256 inverse = _mm256_rsqrt_ps(root);
+            const __m256 correction = _mm256_fnmadd_ps(_mm256_mul_ps(this->half, root), _mm256_mul_ps(inverse, inverse), this->threeHalves);
+            inverse = _mm256_mul_ps(inverse, correction);
+
+            __m256 factor;
+            if constexpr (softening == Softening::Clamp)
+            {
+                // 1 / (max(r^2, threshold) * r) == 1/r * min(1/r^2, 1/threshold)
+                factor = _mm256_mul_ps(inverse, _mm256_min_ps(_mm256_mul_ps(inverse, inverse), this->inverseThreshold));
+            }
+            else if constexpr (softening == Softening::Plummer)
+            {
+                factor = _mm256_mul_ps(inverse, _mm256_mul_ps(inverse, inverse));
+            }
+            else
+            {
+                // every branch of the spline, then a blend by u
+                const __m256 newtonian = _mm256_mul_ps(inverse, _mm256_mul_ps(inverse, inverse));
+                const __m256 u = _mm256_mul_ps(_mm256_mul_ps(magnitudeSquared, inverse), this->splineInverse);
+                const __m256 inner = _mm256_mul_ps(this->splineInverseCubed, _mm256_fmadd_ps(_mm256_mul_ps(u, u),
+                    _mm256_fmsub_ps(_mm256_set1_ps(32.f), u, _mm256_set1_ps(38.4f)), _mm256_set1_ps(32.f / 3.f)));
+                __m256 outer = _mm256_fmadd_ps(_mm256_set1_ps(-32.f / 3.f), u, _mm256_set1_ps(38.4f));
+                outer = _mm256_fmadd_ps(outer, u, _mm256_set1_ps(-48.f));
+                outer = _mm256_fmadd_ps(outer, u, _mm256_set1_ps(64.f / 3.f));
+                outer = _mm256_fmsub_ps(this->splineInverseCubed, outer, _mm256_mul_ps(_mm256_set1_ps(1.f / 15.f), newtonian));
+                factor = _mm256_blendv_ps(outer, inner, _mm256_cmp_ps(u, this->half, _CMP_LT_OQ));
+                factor = _mm256_blendv_ps(factor, newtonian, _mm256_cmp_ps(u, this->one, _CMP_GE_OQ));
+            }
+
+            if constexpr (unitG) return factor;
+            else return _mm256_mul_ps(factor, this->G);
+        }
+    };
+
+    template <Softening softening, bool unitG>
+    NBODY_TARGET("avx2,fma")
+    void accumulateRowsAVX2(const float* x, const float* y, const float* m, std::size_t n,
+        std::size_t begin, std::size_t end, const Interaction& interaction, float* ax, float* ay)
+    {
+        const PairKernel<float, softening, unitG> kernel(interaction);
+        const PairKernelAVX2<softening, unitG> vectorKernel(kernel);
+        const __m256 zero = _mm256_setzero_ps();
+        const std::size_t vectorEnd = n - n % 8;
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            const __m256 x1 = _mm256_set1_ps(x[i]);
+            const __m256 y1 = _mm256_set1_ps(y[i]);
+            __m256 accelerationX = zero;
+            __m256 accelerationY = zero;
+
+            for (std::size_t j = 0; j < vectorEnd; j += 8)
+            {
+                __m256 diffX = _mm256_sub_ps(_mm256_loadu_ps(x + j), x1);
+                __m256 diffY = _mm256_sub_ps(_mm256_loadu_ps(y + j), y1);
+                __m256 magnitudeSquared = _mm256_fmadd_ps(diffX, diffX, _mm256_mul_ps(diffY, diffY));
+
+                __m256 factor = vectorKernel.acceleration(magnitudeSquared);
+                factor = _mm256_mul_ps(factor, _mm256_loadu_ps(m + j));
+
+                // coincident bodies (and i itself) produce inf/nan, mask them out
+                factor = _mm256_and_ps(factor, _mm256_cmp_ps(magnitudeSquared, zero, _CMP_GT_OQ));
+
+                accelerationX = _mm256_fmadd_ps(factor, diffX, accelerationX);
+                accelerationY = _mm256_fmadd_ps(factor, diffY, accelerationY);
+            }
+
+            alignas(32) float lanesX[8], lanesY[8];
+            _mm256_store_ps(lanesX, accelerationX);
+            _mm256_store_ps(lanesY, accelerationY);
+            float sumX = 0.f, sumY = 0.f;
+            for (std::size_t k = 0; k < 8; ++k)
+            {
+                sumX += lanesX[k];
+                sumY += lanesY[k];
+            }
+
+            accumulateRowScalar(x, y, m, vectorEnd, n, i, kernel, sumX, sumY);
+            ax[i] += sumX;
+            ay[i] += sumY;
+        }
+    }
+
+    template <Softening softening, bool unitG>
+    NBODY_TARGET("avx512f")
+    void accumulateRowsAVX512(const float* x, const float* y, const float* m, std::size_t n,
+        std::size_t begin, std::size_t end, const Interaction& interaction, float* ax, float* ay)
+    {
+        const PairKernel<float, softening, unitG> kernel(interaction);
+        const __m512 zero = _mm512_setzero_ps();
+        const __m512 half = _mm512_set1_ps(0.5f);
+        const __m512 one = _mm512_set1_ps(1.f);
+        const __m512 threeHalves = _mm512_set1_ps(1.5f);
+        const __m512 softeningSquared = _mm512_set1_ps(kernel.softeningSquared);
+        const __m512 inverseThreshold = _mm512_set1_ps(1.f / kernel.softeningSquared);
+        const __m512 splineInverse = _mm512_set1_ps(kernel.splineInverse);
+        const __m512 splineInverseCubed = _mm512_set1_ps(kernel.splineInverseCubed);
+        const __m512 gravity = _mm512_set1_ps(kernel.G);
+        const std::size_t vectorEnd = n - n % 16;
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            const __m512 x1 = _mm512_set1_ps(x[i]);
+            const __m512 y1 = _mm512_set1_ps(y[i]);
+            __m512 accelerationX = zero;
+            __m512 accelerationY = zero;
+
+            for (std::size_t j = 0; j < vectorEnd; j += 16)
+            {
+                __m512 diffX = _mm512_sub_ps(_mm512_loadu_ps(x + j), x1);
+                __m512 diffY = _mm512_sub_ps(_mm512_loadu_ps(y + j), y1);
+                __m512 magnitudeSquared = _mm512_fmadd_ps(diffX, diffX, _mm512_mul_ps(diffY, diffY));
+
+                // ~14 bit reciprocal square root, one newton step brings it to full precision
+                __m512 root = softening == Softening::Plummer ? _mm512_add_ps(magnitudeSquared, softeningSquared) : magnitudeSquared;
+                __m512 inverse = _mm512_rsqrt14_ps(root);
+                __m512 correction = _mm512_fnmadd_ps(_mm512_mul_ps(half, root), _mm512_mul_ps(inverse, inverse), threeHalves);
+                inverse = _mm512_mul_ps(inverse, correction);
+
+                __m512 factor;
+                if constexpr (softening == Softening::Clamp)
+                {
+                    // 1 / (max(r^2, threshold) * r) == 1/r * min(1/r^2, 1/threshold)
+                    factor = _mm512_mul_ps(inverse, _mm512_min_ps(_mm512_mul_ps(inverse, inverse), inverseThreshold));
+                }
+                else if constexpr (softening == Softening::Plummer)
+                {
+                    factor = _mm512_mul_ps(inverse, _mm512_mul_ps(inverse, inverse));
+                }
+                else
+                {
+                    // every branch of the spline, then a blend by u
+                    const __m512 newtonian = _mm512_mul_ps(inverse, _mm512_mul_ps(inverse, inverse));
+                    const __m512 u = _mm512_mul_ps(_mm512_mul_ps(magnitudeSquared, inverse), splineInverse);
+                    const __m512 inner = _mm512_mul_ps(splineInverseCubed, _mm512_fmadd_ps(_mm512_mul_ps(u, u),
+                        _mm512_fmsub_ps(_mm512_set1_ps(32.f), u, _mm512_set1_ps(38.4f)), _mm512_set1_ps(32.f / 3.f)));
+                    __m512 outer = _mm512_fmadd_ps(_mm512_set1_ps(-32.f / 3.f), u, _mm512_set1_ps(38.4f));
+                    outer = _mm512_fmadd_ps(outer, u, _mm512_set1_ps(-48.f));
+                    outer = _mm512_fmadd_ps(outer, u, _mm512_set1_ps(64.f / 3.f));
+                    outer = _mm512_fmsub_ps(splineInverseCubed, outer, _mm512_mul_ps(_mm512_set1_ps(1.f / 15.f), newtonian));
+                    factor = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(u, half, _CMP_LT_OQ), outer, inner);
+                    factor = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(u, one, _CMP_GE_OQ), factor, newtonian);
+                }
+                if constexpr (!unitG) factor = _mm512_mul_ps(factor, gravity);
+
+                // coincident bodies (and i itself) produce inf/nan, mask them out
+                __mmask16 valid = _mm512_cmp_ps_mask(magnitudeSquared, zero, _CMP_GT_OQ);
+                factor = _mm512_maskz_mul_ps(valid, factor, _mm512_loadu_ps(m + j));
+
+                accelerationX = _mm512_fmadd_ps(factor, diffX, accelerationX);
+                accelerationY = _mm512_fmadd_ps(factor, diffY, accelerationY);
+            }
+
+            float sumX = _mm512_reduce_add_ps(accelerationX);
+            float sumY = _mm512_reduce_add_ps(accelerationY);
+
+            accumulateRowScalar(x, y, m, vectorEnd, n, i, kernel, sumX, sumY);
+            ax[i] += sumX;
+            ay[i] += sumY;
+        }
+    }
+
+    // one register holds body i of all 8 interleaved systems, so every instruction evaluates the pair (i, j) of each
+    template <Softening softening, bool unitG>
+    NBODY_TARGET("avx2,fma")
+    void accumulateLanesAVX2(const float* x, const float* y, const float* m, std::size_t n,
+        const Interaction& interaction, float* ax, float* ay)
+    {
+        static_assert(ForceKernels::laneCount == 8, "one avx2 register per body of the lanes");
+        const PairKernel<float, softening, unitG> kernel(interaction);
+        const PairKernelAVX2<softening, unitG> vectorKernel(kernel);
+        const __m256 zero = _mm256_setzero_ps();
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            const __m256 x1 = _mm256_loadu_ps(x + 8 * i);
+            const __m256 y1 = _mm256_loadu_ps(y + 8 * i);
+            __m256 accelerationX = zero;
+            __m256 accelerationY = zero;
+
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                __m256 diffX = _mm256_sub_ps(_mm256_loadu_ps(x + 8 * j), x1);
+                __m256 diffY = _mm256_sub_ps(_mm256_loadu_ps(y + 8 * j), y1);
+                __m256 magnitudeSquared = _mm256_fmadd_ps(diffX, diffX, _mm256_mul_ps(diffY, diffY));
+
+                __m256 factor = vectorKernel.acceleration(magnitudeSquared);
+                factor = _mm256_mul_ps(factor, _mm256_loadu_ps(m + 8 * j));
+
+                // i itself and coincident bodies (padding included) produce inf/nan, mask them out
+                factor = _mm256_and_ps(factor, _mm256_cmp_ps(magnitudeSquared, zero, _CMP_GT_OQ));
+
+                accelerationX = _mm256_fmadd_ps(factor, diffX, accelerationX);
+                accelerationY = _mm256_fmadd_ps(factor, diffY, accelerationY);
+            }
+
+            _mm256_storeu_ps(ax + 8 * i, _mm256_add_ps(_mm256_loadu_ps(ax + 8 * i), accelerationX));
+            _mm256_storeu_ps(ay + 8 * i, _mm256_add_ps(_mm256_loadu_ps(ay + 8 * i), accelerationY));
+        }
+    }
+
+#endif
+
+    // every instantiation of one softening model, picked by the remaining parameters
+    template <Softening softening>
+    Kernel selectKernel(const ForceKernels::InstructionSet instructionSet, const Interaction& interaction)
+    {
+        const bool unitG = interaction.G == 1.f;
+        Kernel kernel;
+        if (interaction.precision == ForceKernels::Precision::Double)
+        {
+            kernel.rows = unitG ? &accumulateRowsScalar<double, softening, true> : &accumulateRowsScalar<double, softening, false>;
+            kernel.lanes = unitG ? &accumulateLanesScalar<double, softening, true> : &accumulateLanesScalar<double, softening, false>;
+            return kernel;
+        }
+
+        kernel.rows = unitG ? &accumulateRowsScalar<float, softening, true> : &accumulateRowsScalar<float, softening, false>;
+        kernel.triangle = unitG ? &accumulateTriangle<softening, true> : &accumulateTriangle<softening, false>;
+        kernel.lanes = unitG ? &accumulateLanesScalar<float, softening, true> : &accumulateLanesScalar<float, softening, false>;
+#ifdef NBODY_X86
+        if (instructionSet != ForceKernels::InstructionSet::Scalar && ForceKernels::isSupported(ForceKernels::InstructionSet::AVX2))
+        {
+            kernel.lanes = unitG ? &accumulateLanesAVX2<softening, true> : &accumulateLanesAVX2<softening, false>;
+            kernel.laneInstructionSet = ForceKernels::InstructionSet::AVX2;
+        }
+        if (instructionSet == ForceKernels::InstructionSet::AVX512 && ForceKernels::isSupported(instructionSet))
+        {
+            kernel.rows = unitG ? &accumulateRowsAVX512<softening, true> : &accumulateRowsAVX512<softening, false>;
+            kernel.instructionSet = instructionSet;
+        }
+        else if (instructionSet == ForceKernels::InstructionSet::AVX2 && ForceKernels::isSupported(instructionSet))
+        {
+            kernel.rows = unitG ? &accumulateRowsAVX2<softening, true> : &accumulateRowsAVX2<softening, false>;
+            kernel.instructionSet = instructionSet;
+        }
+#endif
+        return kernel;
+    }
+}
+
+ForceKernels::InstructionSet ForceKernels::detectInstructionSet()
+{
+    if (isSupported(InstructionSet::AVX512)) return InstructionSet::AVX512;
+    if (isSupported(InstructionSet::AVX2)) return InstructionSet::AVX2;
+    return InstructionSet::Scalar;
+}
+
+bool ForceKernels::isSupported(const InstructionSet instructionSet)
+{
+#ifdef NBODY_X86
+    // cpuid is only queried once
+    static const bool avx2 = cpuSupportsAVX2();
+    static const bool avx512 = cpuSupportsAVX512();
+    switch (instructionSet)
+    {
+    case InstructionSet::AVX2: return avx2;
+    case InstructionSet::AVX512: return avx512;
+    default: return true;
+    }
+#else
+    return instructionSet == InstructionSet::Scalar;
+#endif
+}
+
+const char* ForceKernels::getName(const InstructionSet instructionSet)
+{
+    switch (instructionSet)
+    {
+    case InstructionSet::AVX2: return "avx2";
+    case InstructionSet::AVX512: return "avx512";
+    default: return "scalar";
+    }
+}
+
+const char* ForceKernels::getName(const Precision precision)
+{
+    return precision == Precision::Double ? "double" : "single";
+}
+
+const char* ForceKernels::getName(const Softening softening)
+{
+    switch (softening)
+    {
+    case Softening::Plummer: return "plummer";
+    case Softening::Spline: return "spline";
+    default: return "clamp";
+    }
+}
+
+ForceKernels::Kernel ForceKernels::selectKernel(const InstructionSet instructionSet, const Interaction& interaction)
+{
+    switch (interaction.softening)
+    {
+    case Softening::Plummer: return ::selectKernel<Softening::Plummer>(instructionSet, interaction);
+    case Softening::Spline: return ::selectKernel<Softening::Spline>(instructionSet, interaction);
+    default: return ::selectKernel<Softening::Clamp>(instructionSet, interaction);
+    }
+}
+
+double ForceKernels::pairAcceleration(const Interaction& interaction, const double magnitudeSquared)
+{
+    switch (interaction.softening)
+    {
+    case Softening::Plummer: return PairKernel<double, Softening::Plummer, false>(interaction).acceleration(magnitudeSquared);
+    case Softening::Spline: return PairKernel<double, Softening::Spline, false>(interaction).acceleration(magnitudeSquared);
+    default: return PairKernel<double, Softening::Clamp, false>(interaction).acceleration(magnitudeSquared);
+    }
+}
+
+double ForceKernels::pairPotential(const Interaction& interaction, const double magnitude)
+{
+    switch (interaction.softening)
+    {
+    case Softening::Plummer: return PairKernel<double, Softening::Plummer, false>(interaction).potential(magnitude);
+    case Softening::Spline: return PairKernel<double, Softening::Spline, false>(interaction).potential(magnitude);
+    default: return PairKernel<double, Softening::Clamp, false>(interaction).potential(magnitude);
+    }
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstddef>
+
+// all-pairs gravity kernels, specialized at compile time for every combination of scalar type, softening model and
+// unit G, and selected once per configuration (instruction set included) instead of branching inside the pair loops
+namespace ForceKernels
+{
+    enum class InstructionSet
+    {
+        Scalar,
+        AVX2,   // 8 bodies per instruction
+        AVX512  // 16 bodies per instruction
+    };
+
+    // scalar type of the pair arithmetic and of the sums; positions and masses are stored as float either way
+    enum class Precision
+    {
+        Single,
+        Double  // for accuracy runs: scalar instantiations only, and full rows instead of the symmetric triangle
+    };
+
+    // short range modification of the 1 / r potential, eps is the softening length
+    enum class Softening
+    {
+        Clamp,      // constant force inside eps: G m r / (max(|r|^2, eps^2) |r|), the original model
+        Plummer,    // potential -G m / sqrt(r^2 + eps^2)
+        Spline      // cubic spline of support 2.8 eps, exactly newtonian outside it (Monaghan & Lattanzio 1985)
+    };
+
+    // physical parameters of the pair interaction
+    struct Interaction
+    {
+        Precision precision = Precision::Single;
+        Softening softening = Softening::Clamp;
+        float G = 1.f;
+        float softeningLength = 0.1f;
+    };
+
+    // for every row i in [begin, end) adds to (ax[i], ay[i]) the acceleration exerted by all bodies in [0, n)
+    // coincident bodies (r == 0, including i itself) contribute nothing
+    // rows are independent, so disjoint row ranges can be computed concurrently
+    using RowKernel = void (*)(const float* x, const float* y, const float* m, std::size_t n,
+        std::size_t begin, std::size_t end, const Interaction& interaction, float* ax, float* ay);
+
+    // upper triangle of rows [begin, end): every pair (i, j > i) is evaluated once, adds the acceleration of j on i to
+    // ax[i] and the opposite one of i on j to ax[j], so the caller needs private buffers to run ranges concurrently
+    using TriangleKernel = void (*)(const float* x, const float* y, const float* m, std::size_t n,
+        std::size_t begin, std::size_t end, const Interaction& interaction, float* ax, float* ay);
+
+    // systems evaluated together by a lane kernel
+    constexpr std::size_t laneCount = 8;
+
+    // laneCount independent systems of n bodies interleaved body by body (body k of system l at k * laneCount + l):
+    // adds to every body the acceleration exerted by the bodies of its own system; zero masses pad the smaller ones
+    using LaneKernel = void (*)(const float* x, const float* y, const float* m, std::size_t n,
+        const Interaction& interaction, float* ax, float* ay);
+
+    struct Kernel
+    {
+        RowKernel rows = nullptr;
+        // null in double precision, whose sums would be rounded to float on the j side
+        TriangleKernel triangle = nullptr;
+        // one avx2 register holds a pair of every lane, so the avx512 instruction set uses the avx2 instantiation
+        LaneKernel lanes = nullptr;
+        InstructionSet laneInstructionSet = InstructionSet::Scalar;
+        // instruction set the rows actually use: the vector kernels are single precision only
+        InstructionSet instructionSet = InstructionSet::Scalar;
+    };
+
+    // best instruction set supported by both the cpu and the operating system
+    InstructionSet detectInstructionSet();
+
+    bool isSupported(const InstructionSet instructionSet);
+
+    const char* getName(const InstructionSet instructionSet);
+    const char* getName(const Precision precision);
+    const char* getName(const Softening softening);
+
+    // the instantiation matching the interaction; unsupported instruction sets fall back to scalar
+    Kernel selectKernel(const InstructionSet instructionSet, const Interaction& interaction);
+
+    // single pair in double precision for the diagnostics (error reference, energy), same model as the kernels:
+    // acceleration factor f with a = f * m * (x_j - x_i) for r^2 > 0, and potential per unit mass product
+    double pairAcceleration(const Interaction& interaction, double magnitudeSquared);
+    double pairPotential(const Interaction& interaction, double magnitude);
+}
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "FourierTransform.h"
+
+#include <cmath>
+#include <utility>
+
+FourierTransform::FourierTransform(std::size_t size) : size{ 0 }
+{
+    if (size > 0) this->plan(size);
+}
+
+void FourierTransform::plan(std::size_t newSize)
+{
+    if (newSize == this->size) return;
+
+    const double PI = 3.14159265358979323846;
+    this->size = newSize;
+    this->twiddles.resize(newSize / 2);
+    for (std::size_t k = 0; k < newSize / 2; ++k)
+    {
+        const double angle = -2.0 * PI * static_cast<double>(k) / static_cast<double>(newSize);
+        this->twiddles[k] = { std::cos(angle), std::sin(angle) };
+    }
+}
+
+std::size_t FourierTransform::getSize() const
+{
+    return this->size;
+}
+
+void FourierTransform::transform(std::complex<double>* data, std::size_t count, bool inverse) const
+{
+    // bit reversal permutation
+    for (std::size_t i = 1, j = 0; i < count; ++i)
+    {
+        std::size_t bit = count >> 1;
+        for (; j & bit; bit >>= 1) j ^= bit;
+        j ^= bit;
+        if (i < j) std::swap(data[i], data[j]);
+    }
+
+    // butterflies of length 2, 4, ..., count; twiddle k of a length l butterfly is exp(-2 pi i k / l)
+    for (std::size_t length = 2; length <= count; length <<= 1)
+    {
+        const std::size_t half = length / 2;
+        const std::size_t twiddleStride = this->size / length;
+        for (std::size_t start = 0; start < count; start += length)
+        {
+            for (std::size_t k = 0; k < half; ++k)
+            {
+                const std::complex<double> twiddle = inverse ? std::conj(this->twiddles[k * twiddleStride]) : this->twiddles[k * twiddleStride];
+                const std::complex<double> even = data[start + k];
+                const std::complex<double> odd = data[start + k + half] * twiddle;
+                data[start + k] = even + odd;
+                data[start + k + half] = even - odd;
+            }
+        }
+    }
+}
+
+void FourierTransform::forward(std::complex<double>* data) const
+{
+    this->transform(data, this->size, false);
+}
+
+void FourierTransform::inverse(std::complex<double>* data) const
+{
+    this->transform(data, this->size, true);
+}
+
+void FourierTransform::forwardReal(const double* input, std::complex<double>* output) const
+{
+    const std::size_t half = this->size / 2;
+    for (std::size_t k = 0; k < half; ++k) output[k] = { input[2 * k], input[2 * k + 1] };
+    this->transform(output, half, false);
+
+    // with Z the transform of the packed sequence, the even and odd samples transform into
+    // E[k] = (Z[k] + conj(Z[half - k])) / 2 and O[k] = -i (Z[k] - conj(Z[half - k])) / 2, and X[k] = E[k] + w^k O[k]
+    // k and half - k are unpacked together since each needs the other's Z
+    const std::complex<double> first = output[0];
+    output[0] = first.real() + first.imag();
+    output[half] = first.real() - first.imag();
+    for (std::size_t k = 1; k <= half / 2; ++k)
+    {
+        const std::complex<double> a = output[k];
+        const std::complex<double> b = output[half - k];
+        const std::complex<double> even = 0.5 * (a + std::conj(b));
+        const std::complex<double> odd = std::complex<double>{ 0.0, -0.5 } * (a - std::conj(b));
+        const std::complex<double> twiddledOdd = this->twiddles[k] * odd;
+
+        // E[half - k] = conj(E[k]), O[half - k] = conj(O[k]) and w^(half - k) = -conj(w^k)
+        output[k] = even + twiddledOdd;
+        output[half - k] = std::conj(even - twiddledOdd);
+    }
+}
+
+void FourierTransform::inverseReal(std::complex<double>* data, double* output) const
+{
+    const std::size_t half = this->size / 2;
+
+    // the inverse of the unpacking (times 2, which makes the result size * x like the complex transforms)
+    const std::complex<double> first = data[0];
+    const std::complex<double> last = data[half];
+    data[0] = (first + std::conj(last)) + std::complex<double>{ 0.0, 1.0 } * (first - std::conj(last));
+    for (std::size_t k = 1; k <= half / 2; ++k)
+    {
+        const std::complex<double> a = data[k];
+        const std::complex<double> b = data[half - k];
+        const std::complex<double> even = a + std::conj(b);
+        const std::complex<double> odd = (a - std::conj(b)) * std::conj(this->twiddles[k]);
+
+        data[k] = even + std::complex<double>{ 0.0, 1.0 } * odd;
+        data[half - k] = std::conj(even) + std::complex<double>{ 0.0, 1.0 } * std::conj(odd);
+    }
+
+    this->transform(data, half, true);
+    for (std::size_t k = 0; k < half; ++k)
+    {
+        output[2 * k] = data[k].real();
+        output[2 * k + 1] = data[k].imag();
+    }
+}
\ No newline at end of file
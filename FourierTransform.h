@@ -0,0 +1,38 @@
+#pragma once
+#include <complex>
+#include <vector>
+#include <cstddef>
+
+// iterative radix-2 fast fourier transform planned for one power of two size n
+// the transforms are unnormalized: inverse(forward(x)) = n * x
+// a real sequence of length n is transformed as one complex sequence of length n / 2 (even samples as the real part,
+// odd samples as the imaginary part) and unpacked into its n / 2 + 1 non-redundant coefficients
+class FourierTransform
+{
+private:
+
+    std::size_t size;
+
+    // exp(-2 pi i k / size) for k < size / 2, the transforms of size / 2 use every second one
+    std::vector<std::complex<double>> twiddles;
+
+    // in place transform of the first count values, count is size or size / 2
+    void transform(std::complex<double>* data, std::size_t count, bool inverse) const;
+
+public:
+
+    explicit FourierTransform(std::size_t size = 0);
+
+    // size must be a power of two, at least 4
+    void plan(std::size_t newSize);
+    std::size_t getSize() const;
+
+    // in place transform of size values
+    void forward(std::complex<double>* data) const;
+    void inverse(std::complex<double>* data) const;
+
+    // size real values -> size / 2 + 1 coefficients (the others are their complex conjugates)
+    void forwardReal(const double* input, std::complex<double>* output) const;
+    // size / 2 + 1 coefficients of a real sequence -> size real values; data is used as scratch and overwritten
+    void inverseReal(std::complex<double>* data, double* output) const;
+};
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <new>
+
+FrameArena::FrameArena()
+    : current{ nullptr }, capacity{ 0 }, retiredUsage{ 0 }, peakUsage{ 0 }
+{
+
+}
+
+FrameArena::~FrameArena()
+{
+    this->releaseBlocks();
+}
+
+FrameArena::Block* FrameArena::createBlock(std::size_t size, Block* previous)
+{
+    // the header is padded to the granule so the data of every block starts aligned
+    const std::size_t headerSize = (sizeof(Block) + granule - 1) / granule * granule;
+    void* memory = ::operator new(headerSize + size, std::align_val_t{ granule });
+    Block* block = new (memory) Block;
+    block->previous = previous;
+    block->size = size;
+    block->used.store(0, std::memory_order_relaxed);
+    return block;
+}
+
+char* FrameArena::getData(Block* block)
+{
+    const std::size_t headerSize = (sizeof(Block) + granule - 1) / granule * granule;
+    return reinterpret_cast<char*>(block) + headerSize;
+}
+
+void FrameArena::releaseBlocks()
+{
+    Block* block = this->current.load(std::memory_order_relaxed);
+    while (block)
+    {
+        Block* previous = block->previous;
+        block->~Block();
+        ::operator delete(block, std::align_val_t{ granule });
+        block = previous;
+    }
+    this->current.store(nullptr, std::memory_order_relaxed);
+    this->capacity = 0;
+}
+
+void* FrameArena::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+    // alignments above the granule reserve enough room to move the start up by hand
+    const std::size_t padding = alignment > granule ? alignment - granule : 0;
+    const std::size_t reserved = std::max((bytes + padding + granule - 1) / granule * granule, granule);
+
+    while (true)
+    {
+        Block* block = this->current.load(std::memory_order_acquire);
+        if (block)
+        {
+            // once an add overshoots the block, every later one does too, so a block is never handed out twice
+            const std::size_t offset = block->used.fetch_add(reserved, std::memory_order_relaxed);
+            if (offset + reserved <= block->size)
+            {
+                const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(getData(block) + offset);
+                return reinterpret_cast<void*>(padding ? (address + alignment - 1) & ~(alignment - 1) : address);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(this->growthMutex);
+        // another thread may have grown the arena in the meantime
+        if (this->current.load(std::memory_order_relaxed) != block) continue;
+
+        // at least as large as every block before it, so a step needs O(log) blocks before the next reset merges them
+        const std::size_t size = std::max({ this->capacity, minBlockSize, reserved });
+        if (block) this->retiredUsage += block->size;
+        this->capacity += size;
+        this->current.store(createBlock(size, block), std::memory_order_release);
+    }
+}
+
+void FrameArena::do_deallocate(void*, std::size_t, std::size_t)
+{
+    // released by reset
+}
+
+bool FrameArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+void FrameArena::reset()
+{
+    this->peakUsage = std::max(this->peakUsage, this->getUsage());
+    this->retiredUsage = 0;
+
+    Block* block = this->current.load(std::memory_order_relaxed);
+    if (!block) return;
+
+    if (block->previous)
+    {
+        // the step outgrew the first block => a single one of the whole capacity from now on
+        const std::size_t size = this->capacity;
+        this->releaseBlocks();
+        this->current.store(createBlock(size, nullptr), std::memory_order_relaxed);
+        this->capacity = size;
+    }
+    else
+    {
+        block->used.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::size_t FrameArena::getUsage() const
+{
+    const Block* block = this->current.load(std::memory_order_relaxed);
+    if (!block) return 0;
+
+    // full blocks count whole, including the tail nothing fit into
+    return this->retiredUsage + std::min(block->used.load(std::memory_order_relaxed), block->size);
+}
+
+std::size_t FrameArena::getPeakUsage() const
+{
+    return std::max(this->peakUsage, this->getUsage());
+}
+
+std::size_t FrameArena::getCapacity() const
+{
+    return this->capacity;
+}
\ No newline at end of file
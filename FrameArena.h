@@ -0,0 +1,61 @@
+#pragma once
+#include <memory_resource>
+#include <atomic>
+#include <mutex>
+#include <cstddef>
+
+// bump allocator for the scratch memory of one simulation step, used through the std::pmr containers
+// deallocation does nothing, reset releases everything at once; the blocks stay allocated between steps (merged into
+// one when the step needed several), so once the arena has grown to the largest step it no longer touches the heap
+// allocation is a single atomic add, so the workers of the thread pool can fill containers from it concurrently
+// containers drawn from the arena must not outlive the next reset
+class FrameArena : public std::pmr::memory_resource
+{
+private:
+
+    // header at the start of every block, the memory handed out follows it
+    struct Block
+    {
+        Block* previous;
+        std::size_t size;
+        std::atomic<std::size_t> used;
+    };
+
+    // allocations are rounded up to the granule, so fundamental alignments never need padding
+    static constexpr std::size_t granule = 16;
+    static constexpr std::size_t minBlockSize = 64 * 1024;
+
+    std::atomic<Block*> current;
+    // serializes the growth, the bump itself is lock free
+    std::mutex growthMutex;
+    // sum of the block sizes
+    std::size_t capacity;
+    // bytes handed out by the blocks retired since the last reset
+    std::size_t retiredUsage;
+    std::size_t peakUsage;
+
+    static Block* createBlock(std::size_t size, Block* previous);
+    static char* getData(Block* block);
+    void releaseBlocks();
+
+    void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+    void do_deallocate(void* memory, std::size_t bytes, std::size_t alignment) override;
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+public:
+
+    FrameArena();
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // starts a new step: everything allocated so far becomes invalid; not safe against concurrent allocations
+    void reset();
+
+    // bytes handed out since the last reset (including the padding of the granule)
+    std::size_t getUsage() const;
+    // largest usage of any step and bytes currently held by the blocks
+    std::size_t getPeakUsage() const;
+    std::size_t getCapacity() const;
+};
\ No newline at end of file
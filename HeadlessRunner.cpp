@@ -0,0 +1,648 @@
+#include "HeadlessRunner.h"
+#include "AllocationCounter.h"
+#include "DistributedSimulation.h"
+#include "Profiler.h"
+
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    template <typename Unsigned>
+    bool parseUnsigned(const std::string& text, Unsigned& value)
+    {
+        // strtoull skips spaces and wraps negative numbers around, only plain digits are a count
+        if (text.empty() || text[0] < '0' || text[0] > '9') return false;
+        char* end = nullptr;
+        errno = 0;
+        unsigned long long parsed = std::strtoull(text.c_str(), &end, 10);
+        if (*end != '\0' || errno == ERANGE || parsed > std::numeric_limits<Unsigned>::max()) return false;
+        value = static_cast<Unsigned>(parsed);
+        return true;
+    }
+
+    // finite values only, strtof also reads inf and nan (and overflows to inf)
+    bool parseFloat(const std::string& text, float& value)
+    {
+        char* end = nullptr;
+        float parsed = std::strtof(text.c_str(), &end);
+        if (text.empty() || *end != '\0' || !std::isfinite(parsed)) return false;
+        value = parsed;
+        return true;
+    }
+
+    bool parseFlag(const std::string& text, bool& value)
+    {
+        if (text != "0" && text != "1") return false;
+        value = text == "1";
+        return true;
+    }
+
+    double toMilliseconds(sf::Time time)
+    {
+        return time.asMicroseconds() / 1000.0;
+    }
+
+    // fnv-1a over the bits of the positions, velocities and masses of the active particles in index order
+    std::uint64_t hashState(const ParticleStore& p)
+    {
+        std::uint64_t hash = 0xCBF29CE484222325ull;
+        auto add = [&](const float value) {
+            std::uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            for (std::size_t k = 0; k < 4; ++k)
+            {
+                hash ^= (bits >> (8 * k)) & 0xFF;
+                hash *= 0x100000001B3ull;
+            }
+        };
+        for (std::size_t i = 0; i < p.size(); ++i)
+        {
+            if (!p.active[i]) continue;
+            for (const float value : { p.x[i], p.y[i], p.vx[i], p.vy[i], p.mass[i] }) add(value);
+        }
+        return hash;
+    }
+
+    void accumulateStatistics(HeadlessRunner::Result& result, const ParticleSystem::StepStatistics& statistics,
+        const std::size_t step)
+    {
+        result.collisionTime += statistics.collisionTime;
+        result.forceTime += statistics.forceTime;
+        result.integrationTime += statistics.integrationTime;
+        result.interactionCount += statistics.interactionCount;
+        result.substepCount += statistics.substepCount;
+        result.forceEvaluationCount += statistics.forceEvaluationCount;
+        result.sharedStepEvaluationCount += statistics.sharedStepEvaluationCount;
+        result.timestepBinCounts = statistics.timestepBinCounts;
+
+        const std::uint64_t allocationCount = statistics.collisionAllocationCount + statistics.updateAllocationCount;
+        if (step == 0)
+            result.firstStepAllocationCount = allocationCount;
+        else
+            result.steadyStateAllocationCount = std::max(result.steadyStateAllocationCount, allocationCount);
+        result.frameArenaPeakUsage = statistics.frameArenaPeakUsage;
+        result.frameArenaCapacity = statistics.frameArenaCapacity;
+
+        if (statistics.forceErrorSampleCount > 0)
+        {
+            ++result.forceErrorStepCount;
+            result.forceErrorSum += statistics.forceError;
+            result.forceErrorMax = std::max<double>(result.forceErrorMax, statistics.forceError);
+        }
+    }
+
+    void submitFrame(HeadlessRunner::Result& result, TrajectoryWriter& trajectory, const ParticleSystem& particleSystem,
+        const std::size_t step)
+    {
+        if (!trajectory.isOpen()) return;
+
+        sf::Clock clock;
+        trajectory.submit(particleSystem.getParticles(), step, particleSystem.getSimulationTime());
+        result.trajectorySubmitTime += clock.getElapsedTime();
+    }
+
+    // closes the profiler frame of the step and prints the rolling summary every summaryInterval steps
+    void endProfiledStep(const HeadlessRunner::Config& config, const std::size_t step)
+    {
+        if (!Profiler::isEnabled()) return;
+
+        Profiler::endFrame();
+        if (config.summaryInterval > 0 && (step + 1) % config.summaryInterval == 0)
+            std::fprintf(stderr, "step %zu\n%s", step + 1, Profiler::getSummary().c_str());
+    }
+
+    HeadlessRunner::Result runDistributed(HeadlessRunner::Result& result, ParticleSystem& particleSystem,
+        TrajectoryWriter& trajectory)
+    {
+        DistributedSimulation simulation(particleSystem);
+        HeadlessRunner::RankTiming local;
+
+        const sf::Time deltaTime = sf::seconds(result.config.deltaTime);
+        sf::Clock clock;
+        for (std::size_t step = 0; step < result.config.stepCount; ++step)
+        {
+            simulation.step(deltaTime, result.config.collisions);
+            accumulateStatistics(result, particleSystem.getStatistics(), step);
+            submitFrame(result, trajectory, particleSystem, step);
+            if (simulation.getRank() == 0) endProfiledStep(result.config, step);
+
+            local.computeTime += simulation.getStatistics().computeTime;
+            local.communicationTime += simulation.getStatistics().communicationTime;
+        }
+        result.totalTime = clock.getElapsedTime();
+        result.finalParticleCount = particleSystem.getParticleCount();
+
+        // the replicas must still be identical, a merge that differed between ranks would have corrupted them silently
+        unsigned long long localHash = hashState(particleSystem.getParticles()), lowestHash = 0, highestHash = 0;
+        MPI_Allreduce(&localHash, &lowestHash, 1, MPI_UNSIGNED_LONG_LONG, MPI_MIN, MPI_COMM_WORLD);
+        MPI_Allreduce(&localHash, &highestHash, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+        if (lowestHash != highestHash && result.error.empty()) result.error = "the replicas of the ranks diverged";
+
+        // every rank evaluates its own share of the interactions
+        unsigned long long localInteractions = result.interactionCount, totalInteractions = 0;
+        MPI_Reduce(&localInteractions, &totalInteractions, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+        result.interactionCount = static_cast<std::size_t>(totalInteractions);
+
+        // gather (compute, communication) microseconds of every rank on rank 0
+        long long localTimes[2] = { local.computeTime.asMicroseconds(), local.communicationTime.asMicroseconds() };
+        std::vector<long long> allTimes(2 * simulation.getRankCount());
+        MPI_Gather(localTimes, 2, MPI_LONG_LONG, allTimes.data(), 2, MPI_LONG_LONG, 0, MPI_COMM_WORLD);
+        if (simulation.getRank() == 0)
+        {
+            for (int r = 0; r < simulation.getRankCount(); ++r)
+                result.rankTimings.push_back({ sf::microseconds(allTimes[2 * r]), sf::microseconds(allTimes[2 * r + 1]) });
+        }
+
+        return result;
+    }
+
+    HeadlessRunner::Result runEnsemble(const HeadlessRunner::Config& config)
+    {
+        HeadlessRunner::Result result;
+        result.config = config;
+
+        // the members are spread over the threads of one process, not over ranks
+        int mpiInitialized = 0;
+        int rankCount = 1;
+        MPI_Initialized(&mpiInitialized);
+        if (mpiInitialized) MPI_Comm_size(MPI_COMM_WORLD, &rankCount);
+        if (rankCount > 1)
+        {
+            result.error = "--ensemble runs in a single process";
+            return result;
+        }
+
+        Ensemble ensemble;
+        ensemble.setThreadCount(config.threadCount);
+        ensemble.setInstructionSet(config.instructionSet);
+        ensemble.setInteraction(config.interaction);
+        ensemble.setIntegrator(config.integrator);
+        ensemble.distributeSystems(config.distribution, config.ensembleSize, config.particleCount, config.distributionScale, config.seed);
+
+        // report what actually ran (the lanes are avx2 or scalar, the members sweep their own bodies and are not
+        // sampled against a reference, direct summation has no error to sample)
+        result.config.instructionSet = ensemble.getInstructionSet();
+        result.config.collisionBroadPhase = ParticleSystem::CollisionBroadPhase::SweepAndPrune;
+        result.config.errorSampleCount = 0;
+
+        if (config.measureEnergy) ensemble.measureEnergies(true);
+
+        const sf::Time deltaTime = sf::seconds(config.deltaTime);
+        sf::Clock clock;
+        for (std::size_t step = 0; step < config.stepCount; ++step)
+        {
+            const std::uint64_t allocationCount = AllocationCounter::getCount();
+            ensemble.step(deltaTime, config.collisions);
+            const std::uint64_t stepAllocationCount = AllocationCounter::getCount() - allocationCount;
+            if (step == 0)
+                result.firstStepAllocationCount = stepAllocationCount;
+            else
+                result.steadyStateAllocationCount = std::max(result.steadyStateAllocationCount, stepAllocationCount);
+
+            const Ensemble::StepStatistics& statistics = ensemble.getStatistics();
+            result.ensembleCollisionWorkerTime += statistics.collisionTime;
+            result.ensembleForceWorkerTime += statistics.forceTime;
+            result.ensembleIntegrationWorkerTime += statistics.integrationTime;
+            result.interactionCount += statistics.interactionCount;
+        }
+        result.totalTime = clock.getElapsedTime();
+        result.finalParticleCount = ensemble.getParticleCount();
+        result.simulationTime = config.stepCount * static_cast<double>(config.deltaTime);
+
+        if (config.measureEnergy)
+        {
+            ensemble.measureEnergies(false);
+            for (const Ensemble::SystemStatistics& system : ensemble.getSystems())
+            {
+                result.initialEnergy.kinetic += system.initialEnergy.kinetic;
+                result.initialEnergy.potential += system.initialEnergy.potential;
+                result.finalEnergy.kinetic += system.finalEnergy.kinetic;
+                result.finalEnergy.potential += system.finalEnergy.potential;
+            }
+        }
+        result.ensembleSystems = ensemble.getSystems();
+
+        return result;
+    }
+}
+
+double HeadlessRunner::Result::getStepsPerSecond() const
+{
+    const double seconds = this->totalTime.asMicroseconds() / 1e6;
+    return seconds > 0.0 ? this->config.stepCount / seconds : 0.0;
+}
+
+double HeadlessRunner::Result::getSystemStepsPerSecond() const
+{
+    return this->getStepsPerSecond() * std::max<std::size_t>(this->config.ensembleSize, 1);
+}
+
+double HeadlessRunner::Result::getInteractionsPerSecond() const
+{
+    const double seconds = (this->config.ensembleSize > 0 ? this->totalTime : this->forceTime).asMicroseconds() / 1e6;
+    return seconds > 0.0 ? this->interactionCount / seconds : 0.0;
+}
+
+bool HeadlessRunner::parseArguments(const std::vector<std::string>& arguments, Config& config, std::string& error)
+{
+    for (std::size_t i = 0; i < arguments.size(); ++i)
+    {
+        const std::string& name = arguments[i];
+        if (i + 1 >= arguments.size())
+        {
+            error = "missing value for " + name;
+            return false;
+        }
+        const std::string& value = arguments[++i];
+
+        bool valid = true;
+        if (name == "--particles") valid = parseUnsigned(value, config.particleCount);
+        else if (name == "--distribution") valid = ParticleSystem::parseDistribution(value, config.distribution);
+        else if (name == "--scale") valid = parseFloat(value, config.distributionScale) && config.distributionScale >= 0.f;
+        else if (name == "--steps") valid = parseUnsigned(value, config.stepCount);
+        else if (name == "--dt") valid = parseFloat(value, config.deltaTime) && config.deltaTime > 0.f;
+        else if (name == "--threads") valid = parseUnsigned(value, config.threadCount) && config.threadCount > 0;
+        else if (name == "--engine") valid = ParticleSystem::parseForceEngine(value, config.forceEngine);
+        else if (name == "--theta") valid = parseFloat(value, config.openingAngle) && config.openingAngle >= 0.f;
+        else if (name == "--order") valid = parseUnsigned(value, config.expansionOrder) && config.expansionOrder > 0;
+        else if (name == "--mesh-size") valid = parseUnsigned(value, config.meshSize) && config.meshSize > 0;
+        else if (name == "--mesh-assignment") valid = ParticleMesh::parseAssignment(value, config.meshAssignment);
+        else if (name == "--mesh-softening") valid = parseFloat(value, config.meshSoftening) && config.meshSoftening > 0.f;
+        else if (name == "--error-samples") valid = parseUnsigned(value, config.errorSampleCount);
+        else if (name == "--timestep-bins") valid = parseUnsigned(value, config.timestepBinCount) && config.timestepBinCount > 0;
+        else if (name == "--integrator") valid = ParticleSystem::parseIntegrator(value, config.integrator);
+        else if (name == "--collisions") valid = parseFlag(value, config.collisions);
+        else if (name == "--energy") valid = parseFlag(value, config.measureEnergy);
+        else if (name == "--timestep-accuracy") valid = parseFloat(value, config.timestepAccuracy) && config.timestepAccuracy > 0.f;
+        else if (name == "--restart") config.restartPath = value;
+        else if (name == "--checkpoint") config.checkpointPath = value;
+        else if (name == "--trajectory") config.trajectoryPath = value;
+        else if (name == "--trajectory-slots") valid = parseUnsigned(value, config.trajectorySlotCount) && config.trajectorySlotCount >= 2;
+        else if (name == "--trajectory-quantum") valid = parseFloat(value, config.trajectoryQuantum) && config.trajectoryQuantum > 0.f;
+        else if (name == "--trajectory-blocking") valid = parseFlag(value, config.trajectoryBlocking);
+        else if (name == "--trace") config.tracePath = value;
+        else if (name == "--summary-interval") valid = parseUnsigned(value, config.summaryInterval);
+        else if (name == "--ensemble") valid = parseUnsigned(value, config.ensembleSize);
+        else if (name == "--broad-phase") valid = ParticleSystem::parseCollisionBroadPhase(value, config.collisionBroadPhase);
+        else if (name == "--seed") valid = parseUnsigned(value, config.seed);
+        else if (name == "--simd")
+        {
+            valid = false;
+            for (auto candidate : { ForceKernels::InstructionSet::Scalar, ForceKernels::InstructionSet::AVX2, ForceKernels::InstructionSet::AVX512 })
+            {
+                if (value == ForceKernels::getName(candidate))
+                {
+                    config.instructionSet = candidate;
+                    valid = true;
+                }
+            }
+        }
+        else if (name == "--precision")
+        {
+            valid = false;
+            for (auto candidate : { ForceKernels::Precision::Single, ForceKernels::Precision::Double })
+            {
+                if (value == ForceKernels::getName(candidate))
+                {
+                    config.interaction.precision = candidate;
+                    valid = true;
+                }
+            }
+        }
+        else if (name == "--softening")
+        {
+            valid = false;
+            for (auto candidate : { ForceKernels::Softening::Clamp, ForceKernels::Softening::Plummer, ForceKernels::Softening::Spline })
+            {
+                if (value == ForceKernels::getName(candidate))
+                {
+                    config.interaction.softening = candidate;
+                    valid = true;
+                }
+            }
+        }
+        else if (name == "--softening-length")
+            valid = parseFloat(value, config.interaction.softeningLength) && config.interaction.softeningLength >= 0.f;
+        else if (name == "--gravitational-constant")
+            valid = parseFloat(value, config.interaction.G) && config.interaction.G > 0.f;
+        else
+        {
+            error = "unknown option " + name;
+            return false;
+        }
+
+        if (!valid)
+        {
+            error = "invalid value '" + value + "' for " + name;
+            return false;
+        }
+    }
+
+    // the members of an ensemble are direct summation systems with shared steps, stepped without the extras of run
+    if (config.ensembleSize > 0 && (config.forceEngine != ParticleSystem::ForceEngine::DirectSum || config.timestepBinCount > 1
+        || config.collisionBroadPhase != ParticleSystem::CollisionBroadPhase::SweepAndPrune || !config.restartPath.empty() || !config.checkpointPath.empty() || !config.trajectoryPath.empty()
+        || !config.tracePath.empty() || config.summaryInterval > 0))
+    {
+        error = "--ensemble only runs direct summation with shared steps and sweep and prune collisions, without checkpoints, trajectory or profiling";
+        return false;
+    }
+    return true;
+}
+
+HeadlessRunner::Result HeadlessRunner::run(const Config& config)
+{
+    if (config.ensembleSize > 0) return runEnsemble(config);
+
+    Result result;
+    result.config = config;
+
+    ParticleSystem particleSystem;
+    particleSystem.setRandomSeed(config.seed);
+    particleSystem.setThreadCount(config.threadCount);
+    particleSystem.setForceEngine(config.forceEngine);
+    particleSystem.setOpeningAngle(config.openingAngle);
+    particleSystem.setExpansionOrder(config.expansionOrder);
+    particleSystem.setMeshSize(config.meshSize);
+    particleSystem.setMeshAssignment(config.meshAssignment);
+    particleSystem.setMeshSoftening(config.meshSoftening);
+    particleSystem.setForceErrorSampleCount(config.errorSampleCount);
+    particleSystem.setTimestepBinCount(config.timestepBinCount);
+    particleSystem.setTimestepAccuracy(config.timestepAccuracy);
+    particleSystem.setIntegrator(config.integrator);
+    particleSystem.setInstructionSet(config.instructionSet);
+    particleSystem.setPrecision(config.interaction.precision);
+    particleSystem.setSoftening(config.interaction.softening);
+    particleSystem.setSofteningLength(config.interaction.softeningLength);
+    particleSystem.setGravitationalConstant(config.interaction.G);
+    particleSystem.setCollisionBroadPhase(config.collisionBroadPhase);
+
+    int mpiInitialized = 0;
+    int rankCount = 1;
+    int rank = 0;
+    MPI_Initialized(&mpiInitialized);
+    if (mpiInitialized)
+    {
+        MPI_Comm_size(MPI_COMM_WORLD, &rankCount);
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    }
+
+    if (config.restartPath.empty())
+    {
+        particleSystem.distributeParticles(config.distribution, config.particleCount, config.distributionScale);
+    }
+    else
+    {
+        sf::Clock restartClock;
+        int loaded = particleSystem.loadCheckpoint(config.restartPath, result.error) ? 1 : 0;
+        result.restartTime = restartClock.getElapsedTime();
+
+        // every rank loads its own copy, they all give up together if any of them failed
+        if (rankCount > 1) MPI_Allreduce(MPI_IN_PLACE, &loaded, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (!loaded)
+        {
+            if (result.error.empty()) result.error = "another rank failed to load '" + config.restartPath + "'";
+            return result;
+        }
+
+        result.config.particleCount = particleSystem.getParticleCount();
+        result.config.forceEngine = particleSystem.getForceEngine();
+        result.config.openingAngle = particleSystem.getOpeningAngle();
+        result.config.errorSampleCount = particleSystem.getForceErrorSampleCount();
+        result.config.timestepAccuracy = particleSystem.getTimestepAccuracy();
+        result.config.integrator = particleSystem.getIntegrator();
+        result.config.collisionBroadPhase = particleSystem.getCollisionBroadPhase();
+    }
+
+    // report what actually ran (unsupported instruction sets fall back to scalar)
+    result.config.instructionSet = particleSystem.getInstructionSet();
+    result.config.expansionOrder = particleSystem.getExpansionOrder();
+    result.config.meshSize = particleSystem.getMeshSize();
+    result.config.meshAssignment = particleSystem.getMeshAssignment();
+    result.config.meshSoftening = particleSystem.getMeshSoftening();
+    result.config.interaction.precision = particleSystem.getPrecision();
+    result.config.interaction.softening = particleSystem.getSoftening();
+    result.config.interaction.softeningLength = particleSystem.getSofteningLength();
+    result.config.interaction.G = particleSystem.getGravitationalConstant();
+    result.config.timestepBinCount = particleSystem.getTimestepBinCount();
+
+    if (config.measureEnergy) result.initialEnergy = particleSystem.computeEnergy();
+
+    // only rank 0 profiles, the ranks run the same phases
+    const bool profiling = rank == 0 && (!config.tracePath.empty() || config.summaryInterval > 0);
+    if (profiling)
+    {
+        Profiler::reset();
+        Profiler::setSummaryWindow(std::max<std::size_t>(config.summaryInterval, 1));
+        Profiler::setTracing(!config.tracePath.empty());
+        Profiler::setEnabled(true);
+    }
+
+    // the replicas are identical after every exchange, rank 0 streams for everyone
+    // (a failed open is reported after the run, returning early would leave the other ranks waiting)
+    TrajectoryWriter trajectory;
+    if (!config.trajectoryPath.empty() && rank == 0)
+        trajectory.open(config.trajectoryPath, config.trajectorySlotCount, config.trajectoryQuantum, 32,
+            config.trajectoryBlocking, result.error);
+
+    if (rankCount > 1)
+    {
+        runDistributed(result, particleSystem, trajectory);
+    }
+    else
+    {
+        const sf::Time deltaTime = sf::seconds(config.deltaTime);
+        sf::Clock clock;
+        for (std::size_t step = 0; step < config.stepCount; ++step)
+        {
+            if (config.collisions) particleSystem.handleCollisions();
+            if (config.threadCount > 1)
+                particleSystem.update(deltaTime, config.threadCount);
+            else
+                particleSystem.update(deltaTime);
+            accumulateStatistics(result, particleSystem.getStatistics(), step);
+            submitFrame(result, trajectory, particleSystem, step);
+            endProfiledStep(config, step);
+        }
+        result.totalTime = clock.getElapsedTime();
+        result.finalParticleCount = particleSystem.getParticleCount();
+    }
+    result.simulationTime = particleSystem.getSimulationTime();
+    result.stateHash = hashState(particleSystem.getParticles());
+    if (trajectory.isOpen())
+    {
+        trajectory.close(result.error);
+        result.trajectoryStatistics = trajectory.getStatistics();
+    }
+    if (config.measureEnergy) result.finalEnergy = particleSystem.computeEnergy();
+
+    if (profiling)
+    {
+        if (!config.tracePath.empty()) Profiler::writeTrace(config.tracePath, result.error);
+        Profiler::setEnabled(false);
+        Profiler::setTracing(false);
+        Profiler::reset();
+    }
+
+    if (!config.checkpointPath.empty() && rank == 0)
+    {
+        sf::Clock checkpointClock;
+        particleSystem.saveCheckpoint(config.checkpointPath, result.error);
+        result.checkpointTime = checkpointClock.getElapsedTime();
+    }
+
+    return result;
+}
+
+std::string HeadlessRunner::toJson(const Result& result)
+{
+    const Config& config = result.config;
+    const double steps = static_cast<double>(std::max<std::size_t>(config.stepCount, 1));
+
+    std::ostringstream json;
+    json << "{"
+        << "\"config\": {"
+        << "\"particles\": " << config.particleCount
+        << ", \"distribution\": \"" << ParticleSystem::getDistributionName(config.distribution) << "\""
+        << ", \"steps\": " << config.stepCount
+        << ", \"dt\": " << config.deltaTime
+        << ", \"threads\": " << config.threadCount
+        << ", \"engine\": \"" << ParticleSystem::getForceEngineName(config.forceEngine) << "\""
+        << ", \"theta\": " << config.openingAngle
+        << ", \"order\": " << config.expansionOrder
+        << ", \"mesh_size\": " << config.meshSize
+        << ", \"mesh_assignment\": \"" << ParticleMesh::getAssignmentName(config.meshAssignment) << "\""
+        << ", \"mesh_softening\": " << config.meshSoftening
+        << ", \"timestep_bins\": " << config.timestepBinCount
+        << ", \"timestep_accuracy\": " << config.timestepAccuracy
+        << ", \"integrator\": \"" << ParticleSystem::getIntegratorName(config.integrator) << "\""
+        << ", \"collisions\": " << (config.collisions ? "true" : "false")
+        << ", \"simd\": \"" << ForceKernels::getName(config.instructionSet) << "\""
+        << ", \"precision\": \"" << ForceKernels::getName(config.interaction.precision) << "\""
+        << ", \"softening\": \"" << ForceKernels::getName(config.interaction.softening) << "\""
+        << ", \"softening_length\": " << config.interaction.softeningLength
+        << ", \"G\": " << config.interaction.G
+        << ", \"broad_phase\": \"" << ParticleSystem::getCollisionBroadPhaseName(config.collisionBroadPhase) << "\""
+        << ", \"seed\": " << config.seed
+        << ", \"ensemble\": " << config.ensembleSize
+        << "}, \"simulation_time\": " << result.simulationTime
+        << ", \"final_particles\": " << result.finalParticleCount
+        << ", \"state_hash\": \"" << std::hex << std::setw(16) << std::setfill('0') << result.stateHash << std::dec << std::setfill(' ') << "\""
+        << ", \"phases_ms\": {"
+        << "\"collisions\": {\"total\": " << toMilliseconds(result.collisionTime) << ", \"per_step\": " << toMilliseconds(result.collisionTime) / steps << "}"
+        << ", \"forces\": {\"total\": " << toMilliseconds(result.forceTime) << ", \"per_step\": " << toMilliseconds(result.forceTime) / steps << "}"
+        << ", \"integration\": {\"total\": " << toMilliseconds(result.integrationTime) << ", \"per_step\": " << toMilliseconds(result.integrationTime) / steps << "}"
+        << ", \"total\": " << toMilliseconds(result.totalTime)
+        << "}, \"throughput\": {"
+        << "\"steps_per_second\": " << result.getStepsPerSecond()
+        << ", \"pair_interactions\": " << result.interactionCount
+        << ", \"pair_interactions_per_second\": " << result.getInteractionsPerSecond()
+        << "}";
+
+    // aggregate throughput and the diagnostics of every member
+    if (config.ensembleSize > 0)
+    {
+        json << ", \"ensemble\": {\"systems\": " << config.ensembleSize
+            << ", \"system_steps_per_second\": " << result.getSystemStepsPerSecond()
+            << ", \"worker_phases_ms\": {"
+            << "\"collisions\": " << toMilliseconds(result.ensembleCollisionWorkerTime)
+            << ", \"forces\": " << toMilliseconds(result.ensembleForceWorkerTime)
+            << ", \"integration\": " << toMilliseconds(result.ensembleIntegrationWorkerTime)
+            << "}, \"members\": [";
+        for (std::size_t s = 0; s < result.ensembleSystems.size(); ++s)
+        {
+            const Ensemble::SystemStatistics& system = result.ensembleSystems[s];
+            json << (s == 0 ? "" : ", ")
+                << "{\"seed\": " << system.seed
+                << ", \"initial_particles\": " << system.initialParticleCount
+                << ", \"final_particles\": " << system.particleCount;
+            if (config.measureEnergy)
+            {
+                const double initial = system.initialEnergy.kinetic + system.initialEnergy.potential;
+                const double final = system.finalEnergy.kinetic + system.finalEnergy.potential;
+                json << ", \"energy\": {\"initial\": " << initial
+                    << ", \"final\": " << final
+                    << ", \"relative_drift\": " << (initial != 0.0 ? (final - initial) / std::abs(initial) : 0.0) << "}";
+            }
+            json << "}";
+        }
+        json << "]}";
+    }
+
+    // evaluations per unit of simulated time vs a shared step as fine as the finest bin that was needed
+    json << ", \"timesteps\": {\"bin_counts\": [";
+    for (std::size_t bin = 0; bin < result.timestepBinCounts.size(); ++bin)
+        json << (bin == 0 ? "" : ", ") << result.timestepBinCounts[bin];
+    json << "], \"substeps\": " << result.substepCount
+        << ", \"force_evaluations\": " << result.forceEvaluationCount
+        << ", \"shared_step_evaluations\": " << result.sharedStepEvaluationCount
+        << ", \"evaluations_per_time\": " << result.forceEvaluationCount / (steps * config.deltaTime)
+        << ", \"saving\": " << (result.forceEvaluationCount > 0
+            ? static_cast<double>(result.sharedStepEvaluationCount) / result.forceEvaluationCount : 0.0)
+        << "}";
+
+    json << ", \"heap_allocations\": {\"first_step\": " << result.firstStepAllocationCount
+        << ", \"steady_state_max\": " << result.steadyStateAllocationCount
+        << ", \"frame_arena_peak_bytes\": " << result.frameArenaPeakUsage
+        << ", \"frame_arena_capacity_bytes\": " << result.frameArenaCapacity << "}";
+
+    if (config.measureEnergy)
+    {
+        const double initial = result.initialEnergy.kinetic + result.initialEnergy.potential;
+        const double final = result.finalEnergy.kinetic + result.finalEnergy.potential;
+        json << ", \"energy\": {\"initial\": " << initial
+            << ", \"final\": " << final
+            << ", \"relative_drift\": " << (initial != 0.0 ? (final - initial) / std::abs(initial) : 0.0) << "}";
+    }
+
+    if (result.forceErrorStepCount > 0)
+    {
+        json << ", \"force_error\": {\"samples\": " << config.errorSampleCount
+            << ", \"mean_relative_rms\": " << result.forceErrorSum / result.forceErrorStepCount
+            << ", \"max_relative_rms\": " << result.forceErrorMax << "}";
+    }
+
+    if (!config.restartPath.empty() || !config.checkpointPath.empty())
+    {
+        json << ", \"checkpoint\": {\"restart_ms\": " << toMilliseconds(result.restartTime)
+            << ", \"save_ms\": " << toMilliseconds(result.checkpointTime) << "}";
+    }
+
+    if (!config.trajectoryPath.empty())
+    {
+        const TrajectoryWriter::Statistics& trajectory = result.trajectoryStatistics;
+        json << ", \"trajectory\": {\"slots\": " << config.trajectorySlotCount
+            << ", \"blocking\": " << (config.trajectoryBlocking ? "true" : "false")
+            << ", \"frames_submitted\": " << trajectory.submittedFrames
+            << ", \"frames_written\": " << trajectory.writtenFrames
+            << ", \"frames_dropped\": " << trajectory.droppedFrames
+            << ", \"frames_blocked\": " << trajectory.blockedFrames
+            << ", \"blocked_ms\": " << toMilliseconds(trajectory.blockedTime)
+            << ", \"submit_ms\": " << toMilliseconds(result.trajectorySubmitTime)
+            << ", \"bytes\": " << trajectory.writtenBytes
+            << ", \"compression\": " << (trajectory.writtenBytes > 0
+                ? static_cast<double>(trajectory.rawBytes) / trajectory.writtenBytes : 0.0) << "}";
+    }
+
+    if (!result.rankTimings.empty())
+    {
+        json << ", \"mpi\": {\"ranks\": " << result.rankTimings.size() << ", \"rank_times_ms\": [";
+        for (std::size_t r = 0; r < result.rankTimings.size(); ++r)
+        {
+            json << (r == 0 ? "" : ", ")
+                << "{\"rank\": " << r
+                << ", \"compute\": " << toMilliseconds(result.rankTimings[r].computeTime)
+                << ", \"communication\": " << toMilliseconds(result.rankTimings[r].communicationTime) << "}";
+        }
+        json << "]}";
+    }
+
+    json << "}";
+    return json.str();
+}
\ No newline at end of file
@@ -0,0 +1,153 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "Ensemble.h"
+#include "ParticleSystem.h"
+#include "TrajectoryWriter.h"
+
+// render-less driver shared by the headless executable and the benchmark suite
+namespace HeadlessRunner
+{
+    struct Config
+    {
+        std::size_t particleCount = 5000;
+        ParticleSystem::Distribution distribution = ParticleSystem::Distribution::Disc;
+        // size of the initial system, 0 = the default of distributeParticles
+        float distributionScale = 0.f;
+        std::size_t stepCount = 100;
+        float deltaTime = 0.01f;
+        std::size_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        ParticleSystem::ForceEngine forceEngine = ParticleSystem::ForceEngine::DirectSum;
+        float openingAngle = 0.5f;
+        std::size_t expansionOrder = 6;
+        // particle-mesh cells per side, assignment scheme and kernel softening in cells
+        std::size_t meshSize = 256;
+        ParticleMesh::Assignment meshAssignment = ParticleMesh::Assignment::CloudInCell;
+        float meshSoftening = 1.f;
+        // particles checked against direct summation every step when an approximate engine runs
+        std::size_t errorSampleCount = 32;
+        // power of two block timesteps, 1 bin = shared step
+        std::size_t timestepBinCount = 1;
+        float timestepAccuracy = 0.2f;
+        ParticleSystem::Integrator integrator = ParticleSystem::Integrator::SemiImplicitEuler;
+        // collisions merge particles and lose energy, turn them off to measure the drift of the integrator alone
+        bool collisions = true;
+        // total energy before the first and after the last step, off unless asked for with --energy 1: the two O(n^2)
+        // sums are not timed but can outlast the run itself at large particle counts
+        bool measureEnergy = false;
+        ForceKernels::InstructionSet instructionSet = ForceKernels::detectInstructionSet();
+        ForceKernels::Interaction interaction;
+        ParticleSystem::CollisionBroadPhase collisionBroadPhase = ParticleSystem::CollisionBroadPhase::SweepAndPrune;
+        std::uint64_t seed = 1;
+        // > 0 runs that many independent systems of particleCount bodies in one Ensemble instead of one system,
+        // member s seeded with seed + s (direct summation and shared steps only, no checkpoints or trajectory)
+        std::size_t ensembleSize = 0;
+        // start from this checkpoint instead of distributeParticles (its particles and parameters win over the options)
+        std::string restartPath;
+        // written after the last step
+        std::string checkpointPath;
+        // positions and masses of every step, streamed by a background thread
+        std::string trajectoryPath;
+        std::size_t trajectorySlotCount = 3;
+        float trajectoryQuantum = 1e-3f;
+        // wait for a free slot instead of dropping the frame when the writer falls behind
+        bool trajectoryBlocking = false;
+        // chrome trace of every step, written after the run (rank 0)
+        std::string tracePath;
+        // prints the rolling profiler summary to stderr every N steps, 0 = never
+        std::size_t summaryInterval = 0;
+    };
+
+    // compute vs communication time of one MPI rank, summed over every step
+    struct RankTiming
+    {
+        sf::Time computeTime;
+        sf::Time communicationTime;
+    };
+
+    struct Result
+    {
+        Config config;
+        std::size_t finalParticleCount = 0;
+        // hash of the final positions, velocities and masses: runs that end bit-identical share it (0 for ensembles)
+        std::uint64_t stateHash = 0;
+        // simulated time after the last step, continues from the restart checkpoint
+        double simulationTime = 0.0;
+
+        // summed over every step
+        sf::Time totalTime;
+        sf::Time collisionTime;
+        sf::Time forceTime;
+        sf::Time integrationTime;
+        std::size_t interactionCount = 0;
+
+        // force error estimates of the approximate engines (on rank 0's slice when distributed)
+        std::size_t forceErrorStepCount = 0;
+        double forceErrorSum = 0.0;
+        double forceErrorMax = 0.0;
+
+        // block timestep counters summed over every step, bin occupancy at the start of the last step
+        std::size_t substepCount = 0;
+        std::size_t forceEvaluationCount = 0;
+        std::size_t sharedStepEvaluationCount = 0;
+        std::vector<std::size_t> timestepBinCounts;
+
+        // heap allocations of the first step (buffers growing to size) and the most of any later one, which is 0 in
+        // the steady state; largest scratch the frame arena handed out in a step and the bytes it held at the end
+        std::uint64_t firstStepAllocationCount = 0;
+        std::uint64_t steadyStateAllocationCount = 0;
+        std::size_t frameArenaPeakUsage = 0;
+        std::size_t frameArenaCapacity = 0;
+
+        ParticleSystem::Energy initialEnergy;
+        ParticleSystem::Energy finalEnergy;
+
+        // filled on rank 0 when running under mpirun with more than one rank
+        std::vector<RankTiming> rankTimings;
+
+        // time to load the restart checkpoint and to write the final one (rank 0)
+        sf::Time restartTime;
+        sf::Time checkpointTime;
+
+        // writer counters and the time the steps spent handing frames over (rank 0)
+        TrajectoryWriter::Statistics trajectoryStatistics;
+        sf::Time trajectorySubmitTime;
+
+        // every member of an ensemble run, with its own energies when measured
+        std::vector<Ensemble::SystemStatistics> ensembleSystems;
+        // the phases of an ensemble run are not separated in wall time (every batch runs all of them on one worker):
+        // these are summed over the workers, so with several threads they add up to more than totalTime, and the
+        // wall time phases above stay zero
+        sf::Time ensembleCollisionWorkerTime;
+        sf::Time ensembleForceWorkerTime;
+        sf::Time ensembleIntegrationWorkerTime;
+
+        // set when a checkpoint or the trajectory could not be read or written
+        std::string error;
+
+        double getStepsPerSecond() const;
+        // per second of force time, or of the whole steps in an ensemble run, which has no wall time force phase
+        double getInteractionsPerSecond() const;
+        // steps of every member of an ensemble together (the steps per second of a single system otherwise)
+        double getSystemStepsPerSecond() const;
+    };
+
+    // parses "--name value" pairs into config; unknown options and bad values are reported in error
+    // options: --particles --distribution --scale --steps --dt --threads --engine --theta --order --mesh-size --mesh-assignment
+    //          --mesh-softening --error-samples --timestep-bins --timestep-accuracy --integrator --collisions --energy --simd
+    //          --precision --softening --softening-length --gravitational-constant --broad-phase --seed --restart --checkpoint
+    //          --trajectory --trajectory-slots --trajectory-quantum --trajectory-blocking --trace --summary-interval
+    //          --ensemble
+    bool parseArguments(const std::vector<std::string>& arguments, Config& config, std::string& error);
+
+    // sets up distributeParticles(distribution, particleCount) with the given seed (or loads the restart checkpoint)
+    // and runs handleCollisions + update per step; with an ensembleSize, steps that many systems of an Ensemble instead
+    // if MPI is initialized with more than one rank, the steps are distributed with DistributedSimulation
+    // (collective: every rank must call it) and the per-rank timings are gathered on rank 0
+    Result run(const Config& config);
+
+    std::string toJson(const Result& result);
+}
\ No newline at end of file
@@ -0,0 +1,142 @@
+#include "InitialConditions.h"
+
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    const float PI = 3.14159265f;
+
+    void setBody(ParticleStore& particles, const std::size_t i, const float x, const float y, const float vx, const float vy)
+    {
+        particles.x[i] = x;
+        particles.y[i] = y;
+        particles.vx[i] = vx;
+        particles.vy[i] = vy;
+        particles.ax[i] = 0.f;
+        particles.ay[i] = 0.f;
+        particles.mass[i] = 1.f;
+        particles.radius[i] = ParticleStore::calculateRadius(1.f);
+        particles.active[i] = 1;
+    }
+
+    // body(i, k) for every i in [begin, end), k = i - begin
+    template <typename Body>
+    void generate(const std::size_t begin, const std::size_t end, ThreadPool& threadPool, const Body& body)
+    {
+        threadPool.parallelFor(begin, end, [&](std::size_t start, std::size_t stop, std::size_t) {
+            for (std::size_t i = start; i < stop; ++i) body(i, i - begin);
+        });
+    }
+}
+
+void InitialConditions::disc(ParticleStore& particles, const std::size_t begin, const std::size_t end,
+    const CounterRandom& random, const float radius, ThreadPool& threadPool)
+{
+    generate(begin, end, threadPool, [&](std::size_t i, std::size_t k) {
+        const float angle = random.uniform(k, 0) * 2 * PI;
+        const float sin = std::sin(angle);
+        const float cos = std::cos(angle);
+
+        float sum = 0.f;
+        for (std::uint64_t draw = 1; draw <= 6; ++draw) sum += random.uniform(k, draw);
+        const float r = std::abs(sum / 3.f - 1.f) * radius;
+
+        setBody(particles, i, cos * r, sin * r, sin, -cos);
+    });
+}
+
+void InitialConditions::uniformDisc(ParticleStore& particles, const std::size_t begin, const std::size_t end,
+    const CounterRandom& random, const float maxRadius, ThreadPool& threadPool)
+{
+    generate(begin, end, threadPool, [&](std::size_t i, std::size_t k) {
+        const float angle = random.uniform(k, 0) * 2 * PI;
+        const float sin = std::sin(angle);
+        const float cos = std::cos(angle);
+        const float r = random.uniform(k, 1) * maxRadius;
+
+        setBody(particles, i, cos * r, sin * r, sin, -cos);
+    });
+}
+
+void InitialConditions::plummer(ParticleStore& particles, const std::size_t begin, const std::size_t end,
+    const CounterRandom& random, const float scaleRadius, ThreadPool& threadPool)
+{
+    const double a = scaleRadius;
+    const double totalMass = static_cast<double>(end - begin);
+
+    generate(begin, end, threadPool, [&](std::size_t i, std::size_t k) {
+        // invert the cumulative mass m(r) = r^3 / (r^2 + a^2)^(3/2), leaving out the far tail
+        const double massFraction = 1e-6 + 0.998 * random.uniform(k, 0);
+        const double r = a / std::sqrt(1.0 / std::cbrt(massFraction * massFraction) - 1.0);
+
+        // isotropic direction, only its projection on the plane is kept
+        const double cosTheta = 2.0 * random.uniform(k, 1) - 1.0;
+        const double phi = 2.0 * PI * random.uniform(k, 2);
+        const double projected = r * std::sqrt(1.0 - cosTheta * cosTheta);
+
+        // speed q * escape speed with q from g(q) = q^2 (1 - q^2)^(7/2) by rejection
+        double q = 0.0;
+        for (std::uint64_t attempt = 0; attempt < 32; ++attempt)
+        {
+            const double candidate = random.uniform(k, 3 + 2 * attempt);
+            const double remainder = 1.0 - candidate * candidate;
+            if (0.1 * random.uniform(k, 4 + 2 * attempt) < candidate * candidate * remainder * remainder * remainder * std::sqrt(remainder))
+            {
+                q = candidate;
+                break;
+            }
+        }
+        const double speed = q * std::sqrt(2.0 * totalMass) * std::pow(r * r + a * a, -0.25);
+        const double velocityCosTheta = 2.0 * random.uniform(k, 100) - 1.0;
+        const double velocityPhi = 2.0 * PI * random.uniform(k, 101);
+        const double planarSpeed = speed * std::sqrt(1.0 - velocityCosTheta * velocityCosTheta);
+
+        setBody(particles, i,
+            static_cast<float>(projected * std::cos(phi)), static_cast<float>(projected * std::sin(phi)),
+            static_cast<float>(planarSpeed * std::cos(velocityPhi)), static_cast<float>(planarSpeed * std::sin(velocityPhi)));
+    });
+}
+
+void InitialConditions::exponentialDisc(ParticleStore& particles, const std::size_t begin, const std::size_t end,
+    const CounterRandom& random, const float scaleLength, const sf::Vector2f center, const sf::Vector2f velocity,
+    const bool clockwise, ThreadPool& threadPool)
+{
+    const double h = scaleLength;
+    const double totalMass = static_cast<double>(end - begin);
+    // the pair forces are softened below 0.1
+    const double softening = 0.1;
+
+    generate(begin, end, threadPool, [&](std::size_t i, std::size_t k) {
+        // r * exp(-r / h) is a gamma(2, h) distribution, i.e. the sum of two exponential variates
+        const double r = -h * std::log(static_cast<double>(random.positive(k, 0)) * random.positive(k, 1));
+        const double angle = 2.0 * PI * random.uniform(k, 2);
+        const double sin = std::sin(angle);
+        const double cos = std::cos(angle);
+
+        // circular speed of the disc mass inside r as if it were a point mass at the center
+        const double enclosedMass = totalMass * (1.0 - (1.0 + r / h) * std::exp(-r / h));
+        const double speed = std::sqrt(enclosedMass * r / (r * r + softening * softening));
+        const double direction = clockwise ? 1.0 : -1.0;
+
+        setBody(particles, i,
+            center.x + static_cast<float>(cos * r), center.y + static_cast<float>(sin * r),
+            velocity.x + static_cast<float>(direction * sin * speed), velocity.y - static_cast<float>(direction * cos * speed));
+    });
+}
+
+void InitialConditions::galaxyCollision(ParticleStore& particles, const std::size_t begin, const std::size_t end,
+    const CounterRandom& random, const float separation, ThreadPool& threadPool)
+{
+    const std::size_t middle = begin + (end - begin) / 2;
+
+    // each galaxy moves at half the relative speed of a parabolic encounter at this distance
+    const float speed = 0.5f * std::sqrt(2.f * static_cast<float>(end - begin) / separation);
+    const sf::Vector2f offset{ separation / 2.f, separation / 8.f };
+
+    // the second galaxy draws from its own stream, otherwise it would be a shifted copy of the first
+    const CounterRandom second(random(std::numeric_limits<std::uint64_t>::max(), 0));
+
+    exponentialDisc(particles, begin, middle, random, separation / 12.f, -offset, { speed, 0.f }, true, threadPool);
+    exponentialDisc(particles, middle, end, second, separation / 12.f, offset, { -speed, 0.f }, false, threadPool);
+}
\ No newline at end of file
@@ -0,0 +1,37 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <cstdint>
+
+#include "CounterRandom.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+// initial condition generators writing straight into preallocated storage on a thread pool
+// every generator fills particles [begin, end) with unit masses; body k = i - begin only draws from random(k, ...),
+// so the result depends on the seed alone, not on the thread count or on the particles already in the store
+// G = 1 and the masses add up to end - begin for every generator that computes velocities from the mass
+namespace InitialConditions
+{
+    // the original disc: radius |(u1 + ... + u6) / 3 - 1| * radius, tangential unit velocities
+    void disc(ParticleStore& particles, std::size_t begin, std::size_t end, const CounterRandom& random,
+        float radius, ThreadPool& threadPool);
+
+    // uniform angle and uniform radius up to maxRadius, tangential unit velocities
+    void uniformDisc(ParticleStore& particles, std::size_t begin, std::size_t end, const CounterRandom& random,
+        float maxRadius, ThreadPool& threadPool);
+
+    // Plummer sphere of scale radius a projected on the plane, velocities from its distribution function
+    // (Aarseth, Henon & Wielen 1974), also projected; radii are cut at about 40 a
+    void plummer(ParticleStore& particles, std::size_t begin, std::size_t end, const CounterRandom& random,
+        float scaleRadius, ThreadPool& threadPool);
+
+    // exponential surface density exp(-r / h) around center, circular velocities of the enclosed disc mass
+    // plus the bulk velocity; clockwise = false rotates counter-clockwise
+    void exponentialDisc(ParticleStore& particles, std::size_t begin, std::size_t end, const CounterRandom& random,
+        float scaleLength, sf::Vector2f center, sf::Vector2f velocity, bool clockwise, ThreadPool& threadPool);
+
+    // two exponential discs of scale length separation / 12 approaching each other on a slightly offset course
+    // the second one rotates the other way round
+    void galaxyCollision(ParticleStore& particles, std::size_t begin, std::size_t end, const CounterRandom& random,
+        float separation, ThreadPool& threadPool);
+}
\ No newline at end of file
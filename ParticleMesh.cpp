@@ -0,0 +1,334 @@
+#include "ParticleMesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+    // body(start, stop, workerIndex) over [begin, end), on the pool if there is one
+    template <typename Body>
+    void forRange(ThreadPool* threadPool, const std::size_t begin, const std::size_t end, const Body& body)
+    {
+        if (threadPool)
+            threadPool->parallelFor(begin, end, body);
+        else if (begin < end)
+            body(begin, end, 0);
+    }
+
+    // cells between the particles and the mesh edges: 1 for the assignment stencil, 2 for the finite differences
+    // and 1 so rounding never pushes a stencil over
+    const double meshMargin = 4.0;
+}
+
+const char* ParticleMesh::getAssignmentName(const Assignment assignment)
+{
+    return assignment == Assignment::TriangularShapedCloud ? "tsc" : "cic";
+}
+
+bool ParticleMesh::parseAssignment(const std::string& name, Assignment& assignment)
+{
+    for (Assignment candidate : { Assignment::CloudInCell, Assignment::TriangularShapedCloud })
+    {
+        if (name == getAssignmentName(candidate))
+        {
+            assignment = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+ParticleMesh::ParticleMesh()
+    : size{ 256 }, paddedSize{ 512 }, assignment{ Assignment::CloudInCell }, softening{ 1.f },
+    originX{ 0.0 }, originY{ 0.0 }, cellSize{ 1.0 }, kernelCurrent{ false } {}
+
+std::size_t ParticleMesh::getSize() const
+{
+    return this->size;
+}
+
+ParticleMesh::Assignment ParticleMesh::getAssignment() const
+{
+    return this->assignment;
+}
+
+float ParticleMesh::getSoftening() const
+{
+    return this->softening;
+}
+
+void ParticleMesh::setSize(std::size_t newSize)
+{
+    std::size_t powerOfTwo = minSize;
+    while (powerOfTwo < newSize && powerOfTwo < maxSize) powerOfTwo *= 2;
+
+    if (powerOfTwo == this->size) return;
+    this->size = powerOfTwo;
+    this->paddedSize = 2 * powerOfTwo;
+    this->kernelCurrent = false;
+}
+
+void ParticleMesh::setAssignment(Assignment newAssignment)
+{
+    this->assignment = newAssignment;
+}
+
+void ParticleMesh::setSoftening(float newSoftening)
+{
+    newSoftening = std::max(newSoftening, 0.1f);
+    if (newSoftening == this->softening) return;
+    this->softening = newSoftening;
+    this->kernelCurrent = false;
+}
+
+std::size_t ParticleMesh::getStencilWidth() const
+{
+    return this->assignment == Assignment::TriangularShapedCloud ? 3 : 2;
+}
+
+std::size_t ParticleMesh::getWeights(double u, double* weights) const
+{
+    // cell c covers [c, c + 1) and has its center at c + 0.5
+    u = std::min(std::max(u, meshMargin), static_cast<double>(this->size) - meshMargin);
+    if (this->assignment == Assignment::CloudInCell)
+    {
+        const double cell = std::floor(u - 0.5);
+        const double fraction = u - 0.5 - cell;
+        weights[0] = 1.0 - fraction;
+        weights[1] = fraction;
+        return static_cast<std::size_t>(cell);
+    }
+
+    const double cell = std::floor(u);
+    const double offset = u - cell - 0.5;
+    weights[0] = 0.5 * (0.5 - offset) * (0.5 - offset);
+    weights[1] = 0.75 - offset * offset;
+    weights[2] = 0.5 * (0.5 + offset) * (0.5 + offset);
+    return static_cast<std::size_t>(cell) - 1;
+}
+
+void ParticleMesh::computeKernelSpectrum(ThreadPool* threadPool)
+{
+    const std::size_t n = this->paddedSize;
+    const std::size_t coefficientCount = n / 2 + 1;
+    const double softeningSquared = static_cast<double>(this->softening) * this->softening;
+
+    // -1 / sqrt(d^2 + eps^2) for the shortest wrapped offset d, in cells; offsets up to size - 1 are all the mesh needs
+    forRange(threadPool, 0, n, [&](std::size_t start, std::size_t stop, std::size_t) {
+        for (std::size_t row = start; row < stop; ++row)
+        {
+            const double dy = static_cast<double>(row <= n / 2 ? row : n - row);
+            for (std::size_t column = 0; column < n; ++column)
+            {
+                const double dx = static_cast<double>(column <= n / 2 ? column : n - column);
+                this->grid[row * n + column] = -1.0 / std::sqrt(dx * dx + dy * dy + softeningSquared);
+            }
+            this->fourierTransform.forwardReal(&this->grid[row * n], &this->spectrum[row * coefficientCount]);
+        }
+    });
+
+    // the kernel is real and even, so is its transform
+    forRange(threadPool, 0, coefficientCount, [&](std::size_t start, std::size_t stop, std::size_t workerIndex) {
+        std::vector<std::complex<double>>& column = this->workerColumns[workerIndex];
+        for (std::size_t c = start; c < stop; ++c)
+        {
+            for (std::size_t row = 0; row < n; ++row) column[row] = this->spectrum[row * coefficientCount + c];
+            this->fourierTransform.forward(column.data());
+            for (std::size_t row = 0; row < n; ++row)
+                this->kernelSpectrum[row * coefficientCount + c] = column[row].real() / (static_cast<double>(n) * n);
+        }
+    });
+
+    this->kernelCurrent = true;
+}
+
+void ParticleMesh::depositMasses(const ParticleStore& particles, ThreadPool* threadPool)
+{
+    const std::size_t m = this->size;
+    const std::size_t n = this->paddedSize;
+    const std::size_t width = this->getStencilWidth();
+
+    // first stencil row of every particle
+    forRange(threadPool, 0, particles.size(), [&](std::size_t start, std::size_t stop, std::size_t) {
+        double weightsY[3];
+        for (std::size_t i = start; i < stop; ++i)
+        {
+            this->particleRows[i] = particles.active[i]
+                ? this->getWeights((particles.y[i] - this->originY) / this->cellSize, weightsY)
+                : m;
+        }
+    });
+
+    // counting sort by that row, in index order: count row r at r + 2, so that after the prefix sum rowStarts[r + 1]
+    // is the start of row r and placing the particles advances it to the start of row r + 1
+    this->rowStarts.assign(m + 2, 0);
+    for (std::size_t i = 0; i < particles.size(); ++i)
+        if (this->particleRows[i] < m) ++this->rowStarts[this->particleRows[i] + 2];
+    for (std::size_t row = 2; row < m + 2; ++row) this->rowStarts[row] += this->rowStarts[row - 1];
+    for (std::size_t i = 0; i < particles.size(); ++i)
+        if (this->particleRows[i] < m) this->rowParticles[this->rowStarts[this->particleRows[i] + 1]++] = i;
+
+    // every task owns a band of rows of the lower left quarter of the padded grid (the rest is the zero padding) and
+    // adds the stencil rows inside it of every particle whose stencil reaches it, so no two threads add to one cell
+    // and no cell depends on which worker took which band
+    forRange(threadPool, 0, m, [&](std::size_t start, std::size_t stop, std::size_t) {
+        for (std::size_t row = start; row < stop; ++row)
+            std::fill(&this->grid[row * n], &this->grid[row * n] + n, 0.0);
+
+        double weightsX[3], weightsY[3];
+        for (std::size_t sourceRow = start + 1 >= width ? start + 1 - width : 0; sourceRow < stop; ++sourceRow)
+        {
+            for (std::size_t k = this->rowStarts[sourceRow]; k < this->rowStarts[sourceRow + 1]; ++k)
+            {
+                const std::size_t i = this->rowParticles[k];
+                const std::size_t firstX = this->getWeights((particles.x[i] - this->originX) / this->cellSize, weightsX);
+                this->getWeights((particles.y[i] - this->originY) / this->cellSize, weightsY);
+                for (std::size_t b = 0; b < width; ++b)
+                {
+                    if (sourceRow + b < start || sourceRow + b >= stop) continue;
+
+                    double* row = &this->grid[(sourceRow + b) * n + firstX];
+                    const double rowMass = particles.mass[i] * weightsY[b];
+                    for (std::size_t a = 0; a < width; ++a) row[a] += rowMass * weightsX[a];
+                }
+            }
+        }
+    });
+}
+
+void ParticleMesh::solvePotential(ThreadPool* threadPool)
+{
+    const std::size_t m = this->size;
+    const std::size_t n = this->paddedSize;
+    const std::size_t coefficientCount = n / 2 + 1;
+
+    // rows, the padding rows transform to zero
+    forRange(threadPool, 0, n, [&](std::size_t start, std::size_t stop, std::size_t) {
+        for (std::size_t row = start; row < stop; ++row)
+        {
+            std::complex<double>* coefficients = &this->spectrum[row * coefficientCount];
+            if (row < m)
+                this->fourierTransform.forwardReal(&this->grid[row * n], coefficients);
+            else
+                std::fill(coefficients, coefficients + coefficientCount, std::complex<double>{});
+        }
+    });
+
+    // columns: forward, convolution with the kernel as a product, inverse
+    forRange(threadPool, 0, coefficientCount, [&](std::size_t start, std::size_t stop, std::size_t workerIndex) {
+        std::vector<std::complex<double>>& column = this->workerColumns[workerIndex];
+        for (std::size_t c = start; c < stop; ++c)
+        {
+            for (std::size_t row = 0; row < n; ++row) column[row] = this->spectrum[row * coefficientCount + c];
+            this->fourierTransform.forward(column.data());
+            for (std::size_t row = 0; row < n; ++row) column[row] *= this->kernelSpectrum[row * coefficientCount + c];
+            this->fourierTransform.inverse(column.data());
+            for (std::size_t row = 0; row < n; ++row) this->spectrum[row * coefficientCount + c] = column[row];
+        }
+    });
+
+    // rows back to real values, the padding rows are never read
+    forRange(threadPool, 0, m, [&](std::size_t start, std::size_t stop, std::size_t) {
+        for (std::size_t row = start; row < stop; ++row)
+            this->fourierTransform.inverseReal(&this->spectrum[row * coefficientCount], &this->grid[row * n]);
+    });
+}
+
+void ParticleMesh::differentiatePotential(double G, ThreadPool* threadPool)
+{
+    const std::size_t m = this->size;
+    const std::size_t n = this->paddedSize;
+
+    // the grid holds the potential of a unit cell size, a = -grad(phi) with phi = G / h * grid and the fourth order
+    // central difference (8 (f[1] - f[-1]) - (f[2] - f[-2])) / (12 h)
+    const double scale = -G / (12.0 * this->cellSize * this->cellSize);
+    forRange(threadPool, 2, m - 2, [&](std::size_t start, std::size_t stop, std::size_t) {
+        for (std::size_t row = start; row < stop; ++row)
+        {
+            const double* potential = &this->grid[row * n];
+            for (std::size_t column = 2; column < m - 2; ++column)
+            {
+                const double* center = potential + column;
+                this->meshAccelerationX[row * m + column] = scale * (8.0 * (center[1] - center[-1]) - (center[2] - center[-2]));
+                this->meshAccelerationY[row * m + column] = scale * (8.0 * (center[n] - center[-static_cast<std::ptrdiff_t>(n)])
+                    - (center[2 * n] - center[-2 * static_cast<std::ptrdiff_t>(n)]));
+            }
+        }
+    });
+}
+
+std::size_t ParticleMesh::computeAccelerations(const ParticleStore& particles, std::size_t begin, std::size_t end,
+    const std::uint8_t* targets, float G, float* ax, float* ay, ThreadPool* threadPool)
+{
+    const std::size_t m = this->size;
+    const std::size_t n = this->paddedSize;
+
+    // square bounds of the active particles
+    double minX = std::numeric_limits<double>::max(), minY = minX;
+    double maxX = std::numeric_limits<double>::lowest(), maxY = maxX;
+    for (std::size_t i = 0; i < particles.size(); ++i)
+    {
+        if (!particles.active[i]) continue;
+        minX = std::min<double>(minX, particles.x[i]);
+        maxX = std::max<double>(maxX, particles.x[i]);
+        minY = std::min<double>(minY, particles.y[i]);
+        maxY = std::max<double>(maxY, particles.y[i]);
+    }
+    if (minX > maxX || begin >= end) return 0;
+
+    const double extent = std::max(std::max(maxX - minX, maxY - minY), 1e-6);
+    this->cellSize = extent / (static_cast<double>(m) - 2.0 * meshMargin);
+    this->originX = 0.5 * (minX + maxX) - 0.5 * static_cast<double>(m) * this->cellSize;
+    this->originY = 0.5 * (minY + maxY) - 0.5 * static_cast<double>(m) * this->cellSize;
+
+    // buffers of the current size and thread count
+    const std::size_t workerCount = threadPool ? threadPool->getThreadCount() : 1;
+    this->fourierTransform.plan(n);
+    this->grid.resize(n * n);
+    this->spectrum.resize(n * (n / 2 + 1));
+    this->kernelSpectrum.resize(n * (n / 2 + 1));
+    this->meshAccelerationX.assign(m * m, 0.0);
+    this->meshAccelerationY.assign(m * m, 0.0);
+    this->particleRows.resize(particles.size());
+    this->rowParticles.resize(particles.size());
+    if (this->workerColumns.size() < workerCount) this->workerColumns.resize(workerCount);
+    for (std::vector<std::complex<double>>& column : this->workerColumns) column.resize(n);
+
+    if (!this->kernelCurrent) this->computeKernelSpectrum(threadPool);
+    this->depositMasses(particles, threadPool);
+    this->solvePotential(threadPool);
+    this->differentiatePotential(G, threadPool);
+
+    // interpolate with the assignment weights, which keeps the mesh forces free of self-forces on average
+    const std::size_t width = this->getStencilWidth();
+    std::size_t targetCount = 0;
+    for (std::size_t i = begin; i < end; ++i)
+        if (particles.active[i] && (!targets || targets[i])) ++targetCount;
+
+    forRange(threadPool, begin, end, [&](std::size_t start, std::size_t stop, std::size_t) {
+        double weightsX[3], weightsY[3];
+        for (std::size_t i = start; i < stop; ++i)
+        {
+            if (!particles.active[i] || (targets && !targets[i])) continue;
+
+            const std::size_t firstX = this->getWeights((particles.x[i] - this->originX) / this->cellSize, weightsX);
+            const std::size_t firstY = this->getWeights((particles.y[i] - this->originY) / this->cellSize, weightsY);
+            double accelerationX = 0.0, accelerationY = 0.0;
+            for (std::size_t b = 0; b < width; ++b)
+            {
+                const std::size_t rowOffset = (firstY + b) * m + firstX;
+                for (std::size_t a = 0; a < width; ++a)
+                {
+                    const double weight = weightsY[b] * weightsX[a];
+                    accelerationX += weight * this->meshAccelerationX[rowOffset + a];
+                    accelerationY += weight * this->meshAccelerationY[rowOffset + a];
+                }
+            }
+            ax[i] += static_cast<float>(accelerationX);
+            ay[i] += static_cast<float>(accelerationY);
+        }
+    });
+
+    return targetCount * width * width;
+}
\ No newline at end of file
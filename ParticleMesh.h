@@ -0,0 +1,101 @@
+#pragma once
+#include <complex>
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#include "FourierTransform.h"
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+// particle-mesh gravity: the masses are assigned to a square grid spanning every active particle, the potential of the
+// planar 1 / r law is the convolution of that grid with the softened kernel -G / sqrt(r^2 + eps^2), done with real to
+// complex FFTs on a zero padded grid of twice the size (isolated, not periodic, boundaries), and the accelerations are
+// finite differences of the potential interpolated back to the particles with the assignment weights
+// O(n + m^2 log m) for m cells per side; only resolves the forces above a few cells, so it suits large smooth systems
+class ParticleMesh
+{
+public:
+
+    // mass assignment and force interpolation scheme
+    enum class Assignment
+    {
+        CloudInCell,            // bilinear over the 2 x 2 nearest cells
+        TriangularShapedCloud   // quadratic over the 3 x 3 nearest cells, smoother forces
+    };
+
+    static const std::size_t minSize = 16;
+    static const std::size_t maxSize = 4096;
+
+    static const char* getAssignmentName(const Assignment assignment);
+    static bool parseAssignment(const std::string& name, Assignment& assignment);
+
+private:
+
+    // cells per side of the mesh (a power of two) and of the padded grid the convolution runs on
+    std::size_t size;
+    std::size_t paddedSize;
+    Assignment assignment;
+    // plummer softening of the kernel in cells
+    float softening;
+
+    // lower corner and cell size of the last computeAccelerations, the particles stay 4 cells clear of the mesh edges
+    double originX;
+    double originY;
+    double cellSize;
+
+    FourierTransform fourierTransform;
+
+    // paddedSize x paddedSize masses, overwritten with the potential
+    std::vector<double> grid;
+    // paddedSize rows of paddedSize / 2 + 1 coefficients
+    std::vector<std::complex<double>> spectrum;
+    // transform of the kernel for a unit cell, divided by paddedSize^2 so the inverse transform comes out normalized
+    // rebuilt only when the size or the softening change
+    std::vector<double> kernelSpectrum;
+    bool kernelCurrent;
+
+    // size x size mesh accelerations
+    std::vector<double> meshAccelerationX;
+    std::vector<double> meshAccelerationY;
+
+    // first stencil row of every particle (size for the inactive ones) and the active particles bucketed by it in index
+    // order: rowParticles[rowStarts[r], rowStarts[r + 1]) start their stencil on row r
+    std::vector<std::size_t> particleRows;
+    std::vector<std::size_t> rowStarts;
+    std::vector<std::size_t> rowParticles;
+    // per-worker column buffers of the transforms
+    std::vector<std::vector<std::complex<double>>> workerColumns;
+
+    // first cell and weights of the assignment along one axis, u is the position in cells
+    std::size_t getWeights(double u, double* weights) const;
+    std::size_t getStencilWidth() const;
+
+    void computeKernelSpectrum(ThreadPool* threadPool);
+    // every cell sums its contributions in (first stencil row, particle index) order, whatever the thread count
+    void depositMasses(const ParticleStore& particles, ThreadPool* threadPool);
+    // transforms the grid, multiplies with the kernel and transforms back; only the first size rows of the result are valid
+    void solvePotential(ThreadPool* threadPool);
+    void differentiatePotential(double G, ThreadPool* threadPool);
+
+public:
+
+    ParticleMesh();
+
+    std::size_t getSize() const;
+    Assignment getAssignment() const;
+    float getSoftening() const;
+
+    // rounded up to a power of two in [minSize, maxSize]
+    void setSize(std::size_t newSize);
+    void setAssignment(Assignment newAssignment);
+    // at least 0.1 cells, the self-interaction of a particle would be singular without softening
+    void setSoftening(float newSoftening);
+
+    // deposits every active particle and adds the mesh acceleration to the particles in [begin, end)
+    // (only the ones with targets[i] set, if targets is given); runs the passes on threadPool unless it is null
+    // returns the number of particle-cell interactions of the interpolation
+    std::size_t computeAccelerations(const ParticleStore& particles, std::size_t begin, std::size_t end,
+        const std::uint8_t* targets, float G, float* ax, float* ay, ThreadPool* threadPool);
+};
\ No newline at end of file
@@ -0,0 +1,363 @@
+#include "ParticleSnapshot.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // workers of the density binning, not the physics pool, which may be stepping on the simulation thread meanwhile
+    // only one thread draws at a time, so every snapshot shares it; started by the first density draw
+    // its busy time stays out of the profiler, whose worker slots belong to the physics pool
+    ThreadPool& getRenderPool()
+    {
+        static ThreadPool threadPool(std::thread::hardware_concurrency(), false);
+        return threadPool;
+    }
+
+    // particle -> world (transform of the drawable) -> normalized device coordinates (view) -> pixels of the viewport,
+    // y pointing down
+    sf::Transform getPixelTransform(const sf::View& view, const sf::IntRect& viewport, const sf::Transform& transform)
+    {
+        sf::Transform toPixels;
+        toPixels.translate(viewport.width / 2.f, viewport.height / 2.f).scale(viewport.width / 2.f, -(viewport.height / 2.f));
+        toPixels *= view.getTransform();
+        toPixels *= transform;
+        return toPixels;
+    }
+
+    // what the view shows in particle coordinates (the bounding box of it for a rotated view)
+    sf::FloatRect getVisibleRect(const sf::View& view, const sf::Transform& transform)
+    {
+        const sf::FloatRect world = view.getInverseTransform().transformRect(sf::FloatRect(-1.f, -1.f, 2.f, 2.f));
+        return transform.getInverse().transformRect(world);
+    }
+}
+
+ParticleSnapshot::ParticleSnapshot()
+    : x{}, y{}, radius{}, mass{}, referenceMass{ 1.f }, maxRadius{ 0.f }, gridLeft{ 0.f }, gridTop{ 0.f },
+    gridCellSize{ 1.f }, gridSize{ 1 }, cellStart{}, cellFill{}, cellEntries{}, drawMode{ DrawMode::Circles },
+    pointCount{ 30 }, vertices{ sf::Triangles }, points{ sf::Points }, circlePoints{}, circleOffsets{},
+    visibleParticles{}, visiblePointCounts{}, density{}, bandMaxima{}, pixels{}, texture{},
+    quad{ sf::TriangleStrip, 4 } {}
+
+const char* ParticleSnapshot::getDrawModeName(const DrawMode drawMode)
+{
+    switch (drawMode)
+    {
+    case DrawMode::Density: return "density";
+    default: return "circles";
+    }
+}
+
+void ParticleSnapshot::capture(const ParticleStore& particles, const std::size_t newPointCount, const DrawMode newDrawMode)
+{
+    this->pointCount = std::max<std::size_t>(newPointCount, 3);
+    this->drawMode = newDrawMode;
+
+    this->x.clear();
+    this->y.clear();
+    this->radius.clear();
+    this->mass.clear();
+    this->maxRadius = 0.f;
+    double totalMass = 0.0;
+    for (std::size_t i = 0; i < particles.size(); ++i)
+    {
+        if (!particles.active[i]) continue;
+        this->x.push_back(particles.x[i]);
+        this->y.push_back(particles.y[i]);
+        this->radius.push_back(particles.radius[i]);
+        this->mass.push_back(particles.mass[i]);
+        this->maxRadius = std::max(this->maxRadius, particles.radius[i]);
+        totalMass += particles.mass[i];
+    }
+
+    this->referenceMass = this->mass.empty() || totalMass <= 0.0 ? 1.f : static_cast<float>(totalMass / this->mass.size());
+
+    this->buildGrid();
+}
+
+std::size_t ParticleSnapshot::getCellX(const float value) const
+{
+    // clamped before the conversion; nan ends up in the first cell
+    const float cell = (value - this->gridLeft) / this->gridCellSize;
+    return cell > 0.f ? static_cast<std::size_t>(std::min(cell, static_cast<float>(this->gridSize - 1))) : 0;
+}
+
+std::size_t ParticleSnapshot::getCellY(const float value) const
+{
+    const float cell = (value - this->gridTop) / this->gridCellSize;
+    return cell > 0.f ? static_cast<std::size_t>(std::min(cell, static_cast<float>(this->gridSize - 1))) : 0;
+}
+
+void ParticleSnapshot::buildGrid()
+{
+    const std::size_t n = this->x.size();
+
+    float left = 0.f, top = 0.f, right = 0.f, bottom = 0.f;
+    if (n > 0)
+    {
+        const auto [minX, maxX] = std::minmax_element(this->x.begin(), this->x.end());
+        const auto [minY, maxY] = std::minmax_element(this->y.begin(), this->y.end());
+        left = *minX, right = *maxX, top = *minY, bottom = *maxY;
+    }
+    const float extent = std::max(right - left, bottom - top);
+
+    // about 8 particles per cell; a single cell if the bounds are not finite
+    this->gridSize = std::isfinite(extent)
+        ? std::clamp<std::size_t>(static_cast<std::size_t>(std::ceil(std::sqrt(n / 8.0))), 1, 2048) : 1;
+    this->gridLeft = std::isfinite(extent) ? left : 0.f;
+    this->gridTop = std::isfinite(extent) ? top : 0.f;
+    this->gridCellSize = std::isfinite(extent) && extent > 0.f ? extent / this->gridSize : 1.f;
+
+    // counting sort of the particles by cell
+    const std::size_t cellCount = this->gridSize * this->gridSize;
+    this->cellStart.assign(cellCount + 1, 0);
+    for (std::size_t i = 0; i < n; ++i)
+        ++this->cellStart[this->getCellY(this->y[i]) * this->gridSize + this->getCellX(this->x[i]) + 1];
+    for (std::size_t c = 0; c < cellCount; ++c)
+        this->cellStart[c + 1] += this->cellStart[c];
+
+    this->cellFill.assign(this->cellStart.begin(), this->cellStart.end() - 1);
+    this->cellEntries.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+        this->cellEntries[this->cellFill[this->getCellY(this->y[i]) * this->gridSize + this->getCellX(this->x[i])]++] = i;
+}
+
+bool ParticleSnapshot::getCellRange(const sf::FloatRect& rect, std::size_t& x0, std::size_t& x1, std::size_t& y0,
+    std::size_t& y1) const
+{
+    if (this->x.empty()) return false;
+
+    // a circle overlapping rect has its center at most maxRadius outside of it
+    const float left = rect.left - this->maxRadius;
+    const float top = rect.top - this->maxRadius;
+    const float right = rect.left + rect.width + this->maxRadius;
+    const float bottom = rect.top + rect.height + this->maxRadius;
+    // a single cell also holds the particles of non finite bounds, which lie anywhere
+    const float gridExtent = this->gridCellSize * this->gridSize;
+    if (this->gridSize > 1 && !(right >= this->gridLeft && left <= this->gridLeft + gridExtent && bottom >= this->gridTop && top <= this->gridTop + gridExtent))
+        return false;
+
+    x0 = this->getCellX(left), x1 = this->getCellX(right);
+    y0 = this->getCellY(top), y1 = this->getCellY(bottom);
+    return true;
+}
+
+std::size_t ParticleSnapshot::getParticleCount() const
+{
+    return this->x.size();
+}
+
+ParticleSnapshot::DrawMode ParticleSnapshot::getDrawMode() const
+{
+    return this->drawMode;
+}
+
+void ParticleSnapshot::draw(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    Profiler::Scope scope("draw");
+
+    if (this->drawMode == DrawMode::Density)
+    {
+        this->drawDensity(target, states);
+        return;
+    }
+
+    // no texture
+    states.texture = NULL;
+
+    const sf::View& view = target.getView();
+    const sf::IntRect viewport = target.getViewport(view);
+
+    // length of a particle unit in pixels, what the level of detail of a circle is picked from
+    const sf::Transform toPixels = getPixelTransform(view, viewport, states.transform);
+    const sf::Vector2f origin = toPixels.transformPoint(sf::Vector2f{ 0.f, 0.f });
+    const sf::Vector2f unit = toPixels.transformPoint(sf::Vector2f{ 1.f, 0.f }) - origin;
+    const float pixelsPerUnit = std::sqrt(unit.x * unit.x + unit.y * unit.y);
+
+    // rebuild the vertices of the visible particles into the persistent vertex arrays and draw each at once
+    this->updateVertices(getVisibleRect(view, states.transform), pixelsPerUnit);
+    target.draw(this->vertices, states);
+    target.draw(this->points, states);
+}
+
+void ParticleSnapshot::updateVertices(const sf::FloatRect& visible, const float pixelsPerUnit) const
+{
+    const float PI = 3.14159265f;
+
+    // unit circle points for every point count, same layout as sf::CircleShape (first point at the top)
+    if (this->circleOffsets.size() != this->pointCount + 1)
+    {
+        this->circlePoints.clear();
+        this->circleOffsets.assign(this->pointCount + 1, 0);
+        for (std::size_t count = 3; count <= this->pointCount; ++count)
+        {
+            this->circleOffsets[count] = this->circlePoints.size();
+            for (std::size_t k = 0; k < count; ++k)
+            {
+                const float angle = static_cast<float>(k) / static_cast<float>(count) * 2.f * PI - PI / 2.f;
+                this->circlePoints.push_back({ std::cos(angle), std::sin(angle) });
+            }
+        }
+    }
+
+    // cull against the view through the grid, then pick the point count of every visible particle: an edge every
+    // 3 pixels of the circumference, between 3 and pointCount, and a single point below a pixel across
+    this->visibleParticles.clear();
+    this->visiblePointCounts.clear();
+    std::size_t vertexCount = 0, pointTotal = 0;
+    std::size_t x0, x1, y0, y1;
+    if (this->getCellRange(visible, x0, x1, y0, y1))
+    {
+        const float right = visible.left + visible.width;
+        const float bottom = visible.top + visible.height;
+        for (std::size_t cy = y0; cy <= y1; ++cy)
+        {
+            for (std::size_t cx = x0; cx <= x1; ++cx)
+            {
+                const std::size_t cell = cy * this->gridSize + cx;
+                for (std::size_t e = this->cellStart[cell]; e < this->cellStart[cell + 1]; ++e)
+                {
+                    const std::size_t i = this->cellEntries[e];
+                    const float r = this->radius[i];
+                    if (!(this->x[i] + r >= visible.left && this->x[i] - r <= right && this->y[i] + r >= visible.top && this->y[i] - r <= bottom))
+                        continue;
+
+                    const float pixelRadius = r * pixelsPerUnit;
+                    const std::size_t count = pixelRadius < 0.5f ? 0 : std::clamp<std::size_t>(
+                        static_cast<std::size_t>(std::ceil(2.f * PI * std::min(pixelRadius, 1e6f) / 3.f)), 3, this->pointCount);
+                    this->visibleParticles.push_back(i);
+                    this->visiblePointCounts.push_back(count);
+                    if (count == 0) ++pointTotal;
+                    else vertexCount += 3 * count;
+                }
+            }
+        }
+    }
+
+    // one triangle per circle edge, fanned around the center; resizing keeps the capacity between frames
+    this->vertices.resize(vertexCount);
+    this->points.resize(pointTotal);
+
+    std::size_t v = 0, p = 0;
+    for (std::size_t k = 0; k < this->visibleParticles.size(); ++k)
+    {
+        const std::size_t i = this->visibleParticles[k];
+        const std::size_t count = this->visiblePointCounts[k];
+        const sf::Vector2f center{ this->x[i], this->y[i] };
+        if (count == 0)
+        {
+            this->points[p++] = sf::Vertex{ center, sf::Color::White };
+            continue;
+        }
+
+        const sf::Vector2f* circle = &this->circlePoints[this->circleOffsets[count]];
+        const float r = this->radius[i];
+        for (std::size_t j = 0; j < count; ++j)
+        {
+            const sf::Vector2f& point1 = circle[j];
+            const sf::Vector2f& point2 = circle[j + 1 == count ? 0 : j + 1];
+            this->vertices[v++] = sf::Vertex{ center, sf::Color::White };
+            this->vertices[v++] = sf::Vertex{ center + point1 * r, sf::Color::White };
+            this->vertices[v++] = sf::Vertex{ center + point2 * r, sf::Color::White };
+        }
+    }
+}
+
+void ParticleSnapshot::drawDensity(sf::RenderTarget& target, sf::RenderStates states) const
+{
+    // one accumulation cell per pixel of the view, so zooming and resizing change the resolution of the binning
+    const sf::View& view = target.getView();
+    const sf::IntRect viewport = target.getViewport(view);
+    if (viewport.width <= 0 || viewport.height <= 0) return;
+    const std::size_t width = static_cast<std::size_t>(viewport.width);
+    const std::size_t height = static_cast<std::size_t>(viewport.height);
+    const std::size_t pixelCount = width * height;
+
+    // the shape matters, not just the pixel count: the rows of the upload and the quad follow the texture
+    const sf::Vector2u textureSize = this->texture.getSize();
+    if (textureSize.x != width || textureSize.y != height || this->density.size() != pixelCount)
+    {
+        if (!this->texture.create(static_cast<unsigned>(width), static_cast<unsigned>(height))) return;
+        this->density.assign(pixelCount, 0.f);
+        this->pixels.assign(4 * pixelCount, 0);
+    }
+
+    const sf::Transform toPixels = getPixelTransform(view, viewport, states.transform);
+    const sf::Transform toParticles = toPixels.getInverse();
+
+    // the pixel rows are split into bands, each task zeroes and fills its own band of the single density buffer, so the
+    // memory is one float per pixel whatever the thread count; a band only visits the grid cells under it (the same
+    // cell can lie under a few bands, its particles then count in the band their pixel falls into)
+    ThreadPool& threadPool = getRenderPool();
+    const std::size_t bandCount = std::min(height, 4 * threadPool.getThreadCount());
+    this->bandMaxima.resize(bandCount);
+    const float pixelsX = static_cast<float>(width);
+    const float pixelsY = static_cast<float>(height);
+    threadPool.run(bandCount, [&](std::size_t band, std::size_t) {
+        const std::size_t rowBegin = height * band / bandCount;
+        const std::size_t rowEnd = height * (band + 1) / bandCount;
+        float* rows = this->density.data() + rowBegin * width;
+        std::fill(rows, rows + (rowEnd - rowBegin) * width, 0.f);
+
+        const float bandTop = static_cast<float>(rowBegin);
+        const float bandBottom = static_cast<float>(rowEnd);
+        const sf::FloatRect bandRect = toParticles.transformRect(sf::FloatRect(0.f, bandTop, pixelsX, bandBottom - bandTop));
+        std::size_t x0, x1, y0, y1;
+        if (this->getCellRange(bandRect, x0, x1, y0, y1))
+        {
+            for (std::size_t cy = y0; cy <= y1; ++cy)
+            {
+                for (std::size_t cx = x0; cx <= x1; ++cx)
+                {
+                    const std::size_t cell = cy * this->gridSize + cx;
+                    for (std::size_t e = this->cellStart[cell]; e < this->cellStart[cell + 1]; ++e)
+                    {
+                        const std::size_t i = this->cellEntries[e];
+                        const sf::Vector2f pixel = toPixels.transformPoint(sf::Vector2f{ this->x[i], this->y[i] });
+                        // nearest pixel; written so that nan positions fail too
+                        if (!(pixel.x >= 0.f && pixel.x < pixelsX && pixel.y >= bandTop && pixel.y < bandBottom)) continue;
+                        this->density[static_cast<std::size_t>(pixel.y) * width + static_cast<std::size_t>(pixel.x)] += this->mass[i];
+                    }
+                }
+            }
+        }
+
+        // bandCount <= height, so no band is empty
+        this->bandMaxima[band] = *std::max_element(rows, rows + (rowEnd - rowBegin) * width);
+    });
+    const float maximum = bandCount > 0 ? *std::max_element(this->bandMaxima.begin(), this->bandMaxima.end()) : 0.f;
+    if (maximum <= 0.f) return;
+
+    // asinh tone mapping: linear around a single particle, logarithmic in the dense core, the densest pixel opaque
+    // the level goes into the alpha channel, so empty pixels leave whatever was drawn below
+    const float reference = this->referenceMass;
+    const float scale = 255.f / std::asinh(maximum / reference);
+    threadPool.parallelFor(0, pixelCount, [&](std::size_t start, std::size_t end, std::size_t) {
+        for (std::size_t p = start; p < end; ++p)
+        {
+            sf::Uint8* pixel = &this->pixels[4 * p];
+            pixel[0] = pixel[1] = pixel[2] = 255;
+            pixel[3] = this->density[p] > 0.f
+                ? static_cast<sf::Uint8>(std::min(255.f, std::asinh(this->density[p] / reference) * scale + 0.5f)) : 0;
+        }
+    });
+    this->texture.update(this->pixels.data());
+
+    // the quad covers the viewport exactly, its corners are mapped back through the view only (the pixels already
+    // went through the transform of the drawable)
+    const sf::Vector2i corners[4] = {
+        { viewport.left, viewport.top },
+        { viewport.left + viewport.width, viewport.top },
+        { viewport.left, viewport.top + viewport.height },
+        { viewport.left + viewport.width, viewport.top + viewport.height }
+    };
+    const sf::Vector2f textureCorners[4] = { { 0.f, 0.f }, { pixelsX, 0.f }, { 0.f, pixelsY }, { pixelsX, pixelsY } };
+    for (std::size_t k = 0; k < 4; ++k)
+        this->quad[k] = sf::Vertex{ target.mapPixelToCoords(corners[k], view), sf::Color::White, textureCorners[k] };
+
+    states.transform = sf::Transform::Identity;
+    states.texture = &this->texture;
+    target.draw(this->quad, states);
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+#include <cstddef>
+
+#include "ParticleStore.h"
+#include "ThreadPool.h"
+
+// copy of what drawing needs from the active particles at the end of a step
+// the render thread of the pipelined mode draws one while the simulation thread already computes the next step,
+// so nothing here refers back to the particle system; the buffers keep their capacity between captures
+class ParticleSnapshot : public sf::Drawable
+{
+public:
+
+    enum class DrawMode
+    {
+        Circles,    // every visible particle as a filled circle, the cost grows with the visible particle count
+        Density     // mass per pixel of the view, tone mapped and drawn as one textured quad; the cost grows with the
+                    // pixel count and the visible particles, so it is the one for large N where most are below a pixel
+    };
+
+    static const char* getDrawModeName(const DrawMode drawMode);
+
+private:
+
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> radius;
+    std::vector<float> mass;
+    // mean mass of the particles: one of them alone in a pixel sits at the knee of the density tone mapping
+    float referenceMass;
+    float maxRadius;
+
+    // spatial index built by capture: gridSize x gridSize square cells over the bounding box of the particles,
+    // cellEntries[cellStart[c], cellStart[c + 1]) are the particles whose center lies in cell c = cy * gridSize + cx
+    float gridLeft;
+    float gridTop;
+    float gridCellSize;
+    std::size_t gridSize;
+    std::vector<std::size_t> cellStart;
+    std::vector<std::size_t> cellFill;
+    std::vector<std::size_t> cellEntries;
+
+    DrawMode drawMode;
+    // points of the circles covering the most pixels, smaller ones get fewer
+    std::size_t pointCount;
+
+    // the visible particles as fans of triangles, each with a point count for its size on screen, and the ones below
+    // a pixel as single points; rebuilt in place on each draw and submitted in one call each
+    mutable sf::VertexArray vertices;
+    mutable sf::VertexArray points;
+    // unit circles of 3 to pointCount points, the one of k points starts at circlePoints[circleOffsets[k]]
+    mutable std::vector<sf::Vector2f> circlePoints;
+    mutable std::vector<std::size_t> circleOffsets;
+    // visible particles of the current draw and the point count of each, 0 for a single point
+    mutable std::vector<std::size_t> visibleParticles;
+    mutable std::vector<std::size_t> visiblePointCounts;
+
+    // density mode: mass per pixel, the densest pixel of every band of rows, the tone mapped rgba pixels uploaded to
+    // texture, and the quad covering the view it is drawn on
+    mutable std::vector<float> density;
+    mutable std::vector<float> bandMaxima;
+    mutable std::vector<sf::Uint8> pixels;
+    mutable sf::Texture texture;
+    mutable sf::VertexArray quad;
+
+    virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
+    std::size_t getCellX(const float value) const;
+    std::size_t getCellY(const float value) const;
+    // range of cells holding every particle that may overlap rect (in particle coordinates); false if there is none
+    bool getCellRange(const sf::FloatRect& rect, std::size_t& x0, std::size_t& x1, std::size_t& y0, std::size_t& y1) const;
+    void buildGrid();
+
+    void updateVertices(const sf::FloatRect& visible, const float pixelsPerUnit) const;
+    void drawDensity(sf::RenderTarget& target, sf::RenderStates states) const;
+
+public:
+
+    ParticleSnapshot();
+
+    // copies the active particles, drawn in newDrawMode (circles of newPointCount points, at least 3)
+    void capture(const ParticleStore& particles, const std::size_t newPointCount, const DrawMode newDrawMode);
+
+    std::size_t getParticleCount() const;
+    DrawMode getDrawMode() const;
+};
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "ParticleStore.h"
+
+#include <cmath>
+
+float ParticleStore::calculateRadius(const float m)
+{
+    const float PI = 3.14159265f;
+    return std::sqrt(m / PI);
+}
+
+std::size_t ParticleStore::size() const
+{
+    return this->x.size();
+}
+
+bool ParticleStore::empty() const
+{
+    return this->x.empty();
+}
+
+void ParticleStore::reserve(const std::size_t capacity)
+{
+    this->x.reserve(capacity);
+    this->y.reserve(capacity);
+    this->vx.reserve(capacity);
+    this->vy.reserve(capacity);
+    this->ax.reserve(capacity);
+    this->ay.reserve(capacity);
+    this->mass.reserve(capacity);
+    this->radius.reserve(capacity);
+    this->active.reserve(capacity);
+}
+
+void ParticleStore::resize(const std::size_t count)
+{
+    this->x.resize(count);
+    this->y.resize(count);
+    this->vx.resize(count);
+    this->vy.resize(count);
+    this->ax.resize(count);
+    this->ay.resize(count);
+    this->mass.resize(count);
+    this->radius.resize(count);
+    this->active.resize(count);
+}
+
+void ParticleStore::clear()
+{
+    this->resize(0);
+}
+
+void ParticleStore::push(sf::Vector2f position, sf::Vector2f velocity, float m, sf::Vector2f acceleration)
+{
+    this->x.push_back(position.x);
+    this->y.push_back(position.y);
+    this->vx.push_back(velocity.x);
+    this->vy.push_back(velocity.y);
+    this->ax.push_back(acceleration.x);
+    this->ay.push_back(acceleration.y);
+    this->mass.push_back(m);
+    this->radius.push_back(calculateRadius(m));
+    this->active.push_back(1);
+}
+
+void ParticleStore::setMass(const std::size_t index, const float m)
+{
+    this->mass[index] = m;
+    this->radius[index] = calculateRadius(m);
+}
+
+void ParticleStore::removeInactive()
+{
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < this->size(); ++i)
+    {
+        if (!this->active[i]) continue;
+
+        if (kept != i)
+        {
+            this->x[kept] = this->x[i];
+            this->y[kept] = this->y[i];
+            this->vx[kept] = this->vx[i];
+            this->vy[kept] = this->vy[i];
+            this->ax[kept] = this->ax[i];
+            this->ay[kept] = this->ay[i];
+            this->mass[kept] = this->mass[i];
+            this->radius[kept] = this->radius[i];
+            this->active[kept] = 1;
+        }
+        ++kept;
+    }
+    this->resize(kept);
+}
\ No newline at end of file
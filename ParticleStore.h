@@ -0,0 +1,38 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <vector>
+#include <cstdint>
+
+// structure-of-arrays particle storage
+// every physics phase works on these contiguous arrays directly, index i describes the same particle in all of them
+struct ParticleStore
+{
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> vx;
+    std::vector<float> vy;
+    std::vector<float> ax;
+    std::vector<float> ay;
+    std::vector<float> mass;
+    std::vector<float> radius;
+
+    // std::uint8_t instead of bool so the flags stay addressable and thread safe to write
+    std::vector<std::uint8_t> active;
+
+    static float calculateRadius(const float m);
+
+    std::size_t size() const;
+    bool empty() const;
+
+    void reserve(const std::size_t capacity);
+    void resize(const std::size_t count);
+    void clear();
+
+    void push(sf::Vector2f position, sf::Vector2f velocity, float m, sf::Vector2f acceleration = { 0.f, 0.f });
+
+    // sets the mass and the radius derived from it
+    void setMass(const std::size_t index, const float m);
+
+    // removes the inactive particles in one pass, keeping the order of the others
+    void removeInactive();
+};
\ No newline at end of file
@@ -1,85 +1,260 @@
 #include "ParticleSystem.h"
 
+#include "AllocationCounter.h"
+#include "Checkpoint.h"
+#include "InitialConditions.h"
+#include "Profiler.h"
+
 ParticleSystem::ParticleSystem()
-    : particles{}, particlesVertexCount{ 30 } {}
+    : particles{}, particlesVertexCount{ 30 }, drawMode{ ParticleSnapshot::DrawMode::Circles }, forceEngine{ ForceEngine::DirectSum }, openingAngle{ 0.5f },
+    expansionOrder{ 6 }, forceErrorSampleCount{ 0 }, integrator{ Integrator::SemiImplicitEuler },
+    accelerationsCurrent{ false }, accelerationsBegin{ 0 }, accelerationsEnd{ 0 }, timestepBinCount{ 1 }, timestepAccuracy{ 0.2f },
+    broadPhase{ CollisionBroadPhase::SweepAndPrune },
+    instructionSet{ ForceKernels::detectInstructionSet() }, simulationTime{ 0.0 }, randomState{ 1 }
+{
+    this->selectForceKernel();
+}
 
 void ParticleSystem::draw(sf::RenderTarget& target, sf::RenderStates states) const
 {
     // apply the transform
     states.transform *= getTransform();
 
-    // no texture
-    states.texture = NULL;
+    // drawn through a snapshot, the same path the render thread of the pipelined mode takes
+    this->captureSnapshot(this->drawSnapshot);
+    target.draw(this->drawSnapshot, states);
+}
 
-    // draw the vertex array
-    for (auto particle : this->particles)
-        target.draw(particle, states);
+std::uint64_t ParticleSystem::randomNumber()
+{
+    return CounterRandom::next(this->randomState);
 }
 
 float ParticleSystem::randFloat()
 {
-    //srand(time(NULL));
-    return static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
+    // the top 24 bits give every float in [0, 1) with a 2^-24 spacing
+    return static_cast<float>(this->randomNumber() >> 40) / 16777216.f;
 }
 
 void ParticleSystem::collisionBroadPhase()
 {
-    // sort particles based on their projection on OX axis and leave inactive particles at the end
-    std::sort(this->particles.begin(), this->particles.end(), [](const Particle& p1, const Particle& p2) {
-        if (!p1.getIsActive()) return false;
-        if (!p2.getIsActive()) return true;
-        float r1 = p1.getRadius(), r2 = p2.getRadius();
-        sf::Vector2f c1 = p1.getCenter(), c2 = p2.getCenter();
-        return c1.x - r1 < c2.x - r2;
-        });
+    // includes the narrow phase, which runs on the groups / pairs the broad phase found
+    Profiler::Scope scope("collisionBroadPhase");
+
+    if (this->broadPhase == CollisionBroadPhase::UniformGrid)
+        this->uniformGridBroadPhase();
+    else
+        this->sweepAndPruneBroadPhase();
+}
+
+void ParticleSystem::removeInactiveParticles()
+{
+    // new index of every particle that survives the compaction
+    const std::size_t n = this->particles.size();
+    std::pmr::vector<std::size_t> compactedIndices(n, &this->frameArena);
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < n; ++i)
+        compactedIndices[i] = this->particles.active[i] ? kept++ : n;
+
+    if (kept == n) return;
+    this->particles.removeInactive();
+
+    // drop the endpoints of removed particles and renumber the rest, the sorted order is kept
+    std::size_t write = 0;
+    for (const Endpoint& endpoint : this->endpoints)
+    {
+        if (endpoint.index >= n || compactedIndices[endpoint.index] == n) continue;
+        this->endpoints[write++] = { endpoint.minX, compactedIndices[endpoint.index] };
+    }
+    this->endpoints.resize(write);
+}
+
+void ParticleSystem::sortEndpoints()
+{
+    // insertion sort is O(n + inversions), which is close to O(n) when particles barely move between frames
+    // give up and fall back to a full sort when the order is far from sorted (new particles, first frame)
+    const std::size_t moveBudget = 8 * this->endpoints.size() + 64;
+    std::size_t moves = 0;
+    for (std::size_t i = 1; i < this->endpoints.size(); ++i)
+    {
+        const Endpoint current = this->endpoints[i];
+        std::size_t j = i;
+        while (j > 0 && this->endpoints[j - 1].minX > current.minX)
+        {
+            this->endpoints[j] = this->endpoints[j - 1];
+            --j;
+        }
+        this->endpoints[j] = current;
+
+        moves += i - j;
+        if (moves > moveBudget)
+        {
+            std::sort(this->endpoints.begin(), this->endpoints.end(), [](const Endpoint& e1, const Endpoint& e2) {
+                return e1.minX < e2.minX;
+                });
+            return;
+        }
+    }
+}
+
+void ParticleSystem::sweepAndPruneBroadPhase()
+{
+    // remove inactive particles in one O(n) pass (the endpoints follow the compaction)
+    this->removeInactiveParticles();
+    const std::size_t n = this->particles.size();
+
+    // particles added since the last frame get new endpoints, anything else inconsistent is rebuilt
+    bool consistent = this->endpoints.size() <= n;
+    for (std::size_t e = 0; consistent && e < this->endpoints.size(); ++e)
+        consistent = this->endpoints[e].index < n;
+    if (!consistent) this->endpoints.clear();
+    for (std::size_t i = this->endpoints.size(); i < n; ++i)
+        this->endpoints.push_back({ 0.f, i });
+
+    // refresh the projection on the OX axis and restore the sorted order
+    this->threadPool.parallelFor(0, n, [&](std::size_t start, std::size_t end, std::size_t) {
+        const ParticleStore& p = this->particles;
+        for (std::size_t e = start; e < end; ++e)
+        {
+            const std::size_t i = this->endpoints[e].index;
+            this->endpoints[e].minX = p.x[i] - p.radius[i];
+        }
+    });
+    this->sortEndpoints();
+
+    if (n == 0) return;
 
-    // remove inactive particles if any (inactive particles are sorted to the end
-    while (!this->particles[this->particles.size() - 1].getIsActive()) this->particles.pop_back();
+    // collect every active group first (flat member list + offsets), they are resolved in parallel afterwards
+    // every particle is in at most one group and a group has at least 2, so reserving that much never reallocates
+    std::pmr::vector<std::size_t> groupMembers(&this->frameArena);
+    std::pmr::vector<std::size_t> groupOffsets(&this->frameArena);
+    groupMembers.reserve(n);
+    groupOffsets.reserve(n / 2 + 1);
+    groupOffsets.push_back(0);
+    auto closeGroup = [&]() {
+        // a group of a single particle has nothing to collide with; members go in index order, the order the grid path
+        // sums the merged masses in
+        if (groupMembers.size() - groupOffsets.back() > 1)
+        {
+            std::sort(groupMembers.begin() + groupOffsets.back(), groupMembers.end());
+            groupOffsets.push_back(groupMembers.size());
+        }
+        else
+            groupMembers.resize(groupOffsets.back());
+    };
 
     // initialize active group and active interval with the first particle
-    std::vector<std::pair<Particle*, std::size_t>> activeGroup{ {&this->particles[0], 0} };
-    sf::Vector2f activeInterval = this->particles[0].getOXProjection();
-    for (std::size_t i = 1; i < this->particles.size(); ++i)
+    const std::size_t first = this->endpoints[0].index;
+    groupMembers.push_back(first);
+    float activeIntervalEnd = this->particles.x[first] + this->particles.radius[first];
+    for (std::size_t e = 1; e < n; ++e)
     {
-        sf::Vector2f currentInterval = this->particles[i].getOXProjection();
-        if (activeGroup.empty())
+        const std::size_t i = this->endpoints[e].index;
+        const float currentStart = this->particles.x[i] - this->particles.radius[i];
+        const float currentEnd = this->particles.x[i] + this->particles.radius[i];
+        if (activeIntervalEnd >= currentStart)
         {
-            // first particle in the active group
-            activeGroup.push_back({ &this->particles[i], i });
-            activeInterval = currentInterval;
+            // extend interval if intervals intersect
+            groupMembers.push_back(i);
+            activeIntervalEnd = std::max(activeIntervalEnd, currentEnd);
         }
         else
         {
-            if (activeInterval.y >= currentInterval.x)
-            {
-                // extend interval if intervals intersect
-                activeGroup.push_back({ &this->particles[i], i });
-                activeInterval.y = std::max(activeInterval.y, currentInterval.y);
-            }
-            else
-            {
-                // proceed to narrow phase
-                this->collisionNarrowPhase(activeGroup);
+            // close the group and start a new one with the current particle
+            closeGroup();
+            groupMembers.push_back(i);
+            activeIntervalEnd = currentEnd;
+        }
+    }
 
-                // empty active group
-                activeGroup = std::vector<std::pair<Particle*, std::size_t>>{};
-            }
+    // flush the last active group
+    closeGroup();
+
+    this->resolveActiveGroups(groupMembers, groupOffsets);
+}
+
+void ParticleSystem::resolveActiveGroups(const std::pmr::vector<std::size_t>& groupMembers, const std::pmr::vector<std::size_t>& groupOffsets)
+{
+    const std::size_t groupCount = groupOffsets.size() - 1;
+    if (groupCount == 0) return;
+    Profiler::Scope scope("collisionNarrowPhase");
+    const bool profiling = Profiler::isEnabled();
+
+    // groups hold disjoint particles, so they can be resolved concurrently
+    // batch consecutive groups into tasks of about the same k^2 narrow phase cost
+    std::size_t totalCost = 0;
+    for (std::size_t g = 0; g < groupCount; ++g)
+    {
+        const std::size_t size = groupOffsets[g + 1] - groupOffsets[g];
+        totalCost += size * size;
+        if (profiling) Profiler::addHistogramSample("activeGroupSize", size);
+    }
+    const std::size_t taskCost = totalCost / (4 * this->threadPool.getThreadCount()) + 1;
+
+    // first group of every narrow phase task
+    std::pmr::vector<std::size_t> taskGroupBounds(1, 0, &this->frameArena);
+    std::size_t cost = 0;
+    for (std::size_t g = 0; g < groupCount; ++g)
+    {
+        const std::size_t size = groupOffsets[g + 1] - groupOffsets[g];
+        cost += size * size;
+        if (cost >= taskCost)
+        {
+            taskGroupBounds.push_back(g + 1);
+            cost = 0;
         }
     }
+    if (taskGroupBounds.back() != groupCount) taskGroupBounds.push_back(groupCount);
+
+    this->threadPool.run(taskGroupBounds.size() - 1, [&](std::size_t task, std::size_t) {
+        NarrowPhaseScratch scratch(&this->frameArena);
+        for (std::size_t g = taskGroupBounds[task]; g < taskGroupBounds[task + 1]; ++g)
+            this->collisionNarrowPhase(groupMembers.data() + groupOffsets[g], groupOffsets[g + 1] - groupOffsets[g], scratch);
+    });
+}
+
+void ParticleSystem::uniformGridBroadPhase()
+{
+    // drop the particles merged away in the previous frame
+    this->removeInactiveParticles();
+    const std::size_t n = this->particles.size();
+    if (n < 2) return;
+
+    // cells as large as the largest diameter => touching circles are at most one cell apart
+    float maxRadius = 0.f;
+    for (std::size_t i = 0; i < n; ++i)
+        maxRadius = std::max(maxRadius, this->particles.radius[i]);
+    this->uniformGrid.build(this->particles.x.data(), this->particles.y.data(), this->particles.active.data(), n, 2.f * maxRadius);
+
+    // every worker collects the candidate pairs of its rows into its own list (the arena takes concurrent allocations)
+    // which worker gets which rows changes from run to run, the narrow phase does not depend on the pair order
+    std::pmr::vector<std::pmr::vector<std::pair<std::size_t, std::size_t>>> candidatePairs(
+        this->threadPool.getThreadCount(), &this->frameArena);
+    this->threadPool.parallelFor(0, n, [&](std::size_t start, std::size_t end, std::size_t workerIndex) {
+        this->uniformGrid.collectCandidatePairs(start, end, candidatePairs[workerIndex]);
+    });
+
+    this->collisionNarrowPhase(candidatePairs);
 }
 
-void ParticleSystem::collisionNarrowPhase(std::vector<std::pair<Particle*, std::size_t>>& activeGroup)
+void ParticleSystem::collisionNarrowPhase(const std::size_t* activeGroup, const std::size_t groupSize, NarrowPhaseScratch& scratch)
 {
-    // define and initialize parent vector used for union
-    std::vector<std::size_t> parent(activeGroup.size());
-    for (std::size_t i = 0; i < parent.size(); ++i) parent[i] = i;
+    // initialize the reusable parent array used for union
+    std::pmr::vector<std::size_t>& parent = scratch.parent;
+    parent.resize(groupSize);
+    for (std::size_t i = 0; i < groupSize; ++i) parent[i] = i;
 
-    // define find function with path compression
-    std::function<std::size_t(std::size_t)> find = [&](std::size_t x) {
-        if (parent[x] == x) return x;
-        std::size_t result = find(parent[x]);
-        parent[x] = result;
-        return result;
+    // iterative find: walk up to the root, then point the whole path at it (path compression)
+    auto find = [&](std::size_t x) {
+        std::size_t root = x;
+        while (parent[root] != root) root = parent[root];
+        while (parent[x] != root)
+        {
+            std::size_t next = parent[x];
+            parent[x] = root;
+            x = next;
+        }
+        return root;
     };
 
     // define union function of two sets
@@ -87,214 +262,1276 @@ void ParticleSystem::collisionNarrowPhase(std::vector<std::pair<Particle*, std::
         std::size_t reprX = find(x);
         std::size_t reprY = find(y);
 
-        // compare the masses of the representatives
-        if (activeGroup[reprX].first->getMass() > activeGroup[reprY].first->getMass())
+        // compare the masses of the representatives, equal masses keep the smaller particle index
+        if (this->outranks(activeGroup[reprX], activeGroup[reprY]))
             parent[reprY] = reprX;
         else
             parent[reprX] = reprY;
     };
 
     // perform collision checking for the current active group
-    for (std::size_t i = 0; i < activeGroup.size() - 1; ++i)
+    for (std::size_t i = 0; i + 1 < groupSize; ++i)
     {
-        const Particle& part1 = *(activeGroup[i].first);
-        for (std::size_t j = i + 1; j < activeGroup.size(); ++j)
+        for (std::size_t j = i + 1; j < groupSize; ++j)
         {
-            const Particle& part2 = *(activeGroup[j].first);
-            if (part1.intersects(part2)) unify(i, j);
+            if (this->intersects(activeGroup[i], activeGroup[j])) unify(i, j);
         }
     }
 
-    // calculate final masses of the representatives of each set
-    std::unordered_map<std::size_t, float> massAccumulation;
-    for (std::size_t i = 0; i < activeGroup.size(); ++i)
+    // calculate final masses of the representatives of each set (summed in member order, starting from 0)
+    std::pmr::vector<float>& massAccumulation = scratch.mass;
+    massAccumulation.assign(groupSize, 0.f);
+    scratch.isRepresentative.assign(groupSize, 0);
+    for (std::size_t i = 0; i < groupSize; ++i)
     {
         std::size_t repr = find(i);
-        massAccumulation[repr] += activeGroup[i].first->getMass();
+        massAccumulation[repr] += this->particles.mass[activeGroup[i]];
+        scratch.isRepresentative[repr] = 1;
 
         // if current particle is not a representative of a set mark as inactive for later deletion
-        if (repr != i) activeGroup[i].first->setIsActive(false);
+        if (repr != i) this->particles.active[activeGroup[i]] = 0;
     }
 
     // set new mass for representative particles
-    for (auto& [index, finalMass] : massAccumulation)
+    for (std::size_t i = 0; i < groupSize; ++i)
     {
         // set new mass if mass changed(basically the set contained more than one particle)
-        if (activeGroup[index].first->getMass() != finalMass) 
-            activeGroup[index].first->setMass(finalMass);
+        if (scratch.isRepresentative[i] && this->particles.mass[activeGroup[i]] != massAccumulation[i])
+            this->particles.setMass(activeGroup[i], massAccumulation[i]);
     }
 }
 
-std::size_t ParticleSystem::getParticleCount() const
+void ParticleSystem::collisionNarrowPhase(const std::pmr::vector<std::pmr::vector<std::pair<std::size_t, std::size_t>>>& candidatePairs)
 {
-    return this->particles.size();
+    Profiler::Scope scope("collisionNarrowPhase");
+
+    const std::size_t n = this->particles.size();
+    std::pmr::vector<std::size_t> parent(n, &this->frameArena);
+    for (std::size_t i = 0; i < n; ++i) parent[i] = i;
+
+    // iterative find with path halving
+    auto find = [&](std::size_t x) {
+        while (parent[x] != x)
+        {
+            parent[x] = parent[parent[x]];
+            x = parent[x];
+        }
+        return x;
+    };
+
+    // union of two sets, the representative that outranks the other stays (same rule as the active groups)
+    bool merged = false;
+    for (const auto& pairs : candidatePairs)
+    {
+        for (const auto& [i, j] : pairs)
+        {
+            if (!this->intersects(i, j)) continue;
+
+            std::size_t reprX = find(i);
+            std::size_t reprY = find(j);
+            if (reprX == reprY) continue;
+
+            if (this->outranks(reprX, reprY))
+                parent[reprY] = reprX;
+            else
+                parent[reprX] = reprY;
+            merged = true;
+        }
+    }
+
+    if (!merged) return;
+
+    // accumulate the masses into the representatives and mark the rest as inactive for later deletion
+    // summed from 0 in index order like the active groups, so both broad phases give the same bits for the same merge
+    std::pmr::vector<float> finalMass(n, 0.f, &this->frameArena);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        std::size_t repr = find(i);
+        finalMass[repr] += this->particles.mass[i];
+        if (repr != i) this->particles.active[i] = 0;
+    }
+
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        if (this->particles.active[i] && finalMass[i] != this->particles.mass[i])
+            this->particles.setMass(i, finalMass[i]);
+    }
 }
 
-void ParticleSystem::setParticlesVertexCount(const std::size_t newCount)
+bool ParticleSystem::intersects(const std::size_t i, const std::size_t j) const
 {
-    this->particlesVertexCount = newCount;
-    for (auto& particle : this->particles)
-        particle.setParticleVertexCount(newCount);
+    // check intersection only if it is active
+    if (!this->particles.active[i]) return false;
+
+    float diffY = this->particles.y[j] - this->particles.y[i];
+    float diffX = this->particles.x[j] - this->particles.x[i];
+    float magnitude = std::sqrt(diffY * diffY + diffX * diffX);
+
+    return (magnitude <= this->particles.radius[i] + this->particles.radius[j]);
 }
 
-void ParticleSystem::distributeParticles(const std::size_t particleCount)
+bool ParticleSystem::outranks(const std::size_t i, const std::size_t j) const
 {
-    const float PI = 3.14159265f;
-    for (std::size_t i = 0; i < particleCount; ++i)
+    const float massI = this->particles.mass[i];
+    const float massJ = this->particles.mass[j];
+    return massI > massJ || (massI == massJ && i < j);
+}
+
+void ParticleSystem::computeForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due)
+{
+    if (this->forceEngine == ForceEngine::BarnesHut)
+        this->computeBarnesHutForces(begin, end, parallel, due);
+    else if (this->forceEngine == ForceEngine::FastMultipole)
+        this->computeFastMultipoleForces(begin, end, parallel, due);
+    else if (this->forceEngine == ForceEngine::ParticleMesh)
+        this->computeParticleMeshForces(begin, end, parallel, due);
+    else
+        this->computeDirectForces(begin, end, parallel, due);
+
+    Profiler::addCount("pairInteractions", static_cast<double>(this->statistics.interactionCount));
+}
+
+void ParticleSystem::computeDirectForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due)
+{
+    Profiler::Scope scope("forces.directSum");
+    const std::size_t n = this->particles.size();
+
+    // counted as distinct pairs (each row owns half of its pairs), even though full rows evaluate each pair from both sides
+    const std::size_t rowCount = due ? std::count(due + begin, due + end, 1) : end - begin;
+    this->statistics.interactionCount = n > 0 ? rowCount * (n - 1) / 2 : 0;
+
+    // the symmetric pair loop needs every row; vector kernels, double precision, partial ranges and subsets evaluate
+    // full rows instead
+    if (this->kernel.instructionSet != ForceKernels::InstructionSet::Scalar || !this->kernel.triangle || begin != 0 || end != n || due)
     {
-        float angle = randFloat() * 2 * PI;
-        float sin = std::sin(angle);
-        float cos = std::cos(angle);
-        
-        float r = std::abs((randFloat() + randFloat() + randFloat() + randFloat() + randFloat() + randFloat()) / 3.f - 1.f);
-        float velMult = 1.f;
+        // full rows have no j-side updates, so rows are independent and need no reduction
+        auto accumulateRows = [&](std::size_t start, std::size_t stop, std::size_t) {
+            ParticleStore& p = this->particles;
+            while (start < stop)
+            {
+                // runs of consecutive due rows go through the kernel at once
+                std::size_t runEnd = start;
+                while (runEnd < stop && (!due || due[runEnd])) ++runEnd;
+                if (runEnd > start)
+                    this->kernel.rows(p.x.data(), p.y.data(), p.mass.data(), n, start, runEnd, this->interaction, p.ax.data(), p.ay.data());
+                start = runEnd;
+                while (start < stop && !due[start]) ++start;
+            }
+        };
 
-        sf::Vector2f pos = sf::Vector2f{ cos, sin } * std::sqrtf(static_cast<int>(particleCount)) * 10.f * r;
-        sf::Vector2f vel = sf::Vector2f{ sin , -cos } * velMult;
+        if (parallel)
+            this->threadPool.parallelFor(begin, end, accumulateRows);
+        else
+            accumulateRows(begin, end, 0);
+        return;
+    }
 
-        this->particles.push_back({ pos, vel, 1.f });
+    if (!parallel)
+    {
+        ParticleStore& p = this->particles;
+        this->kernel.triangle(p.x.data(), p.y.data(), p.mass.data(), n, 0, n, this->interaction, p.ax.data(), p.ay.data());
+        return;
     }
 
-    /*std::sort(this->particles.begin(), this->particles.end(), [](const Particle& part1, const Particle& part2) {
-        auto p1 = part1.getPosition();
-        auto p2 = part2.getPosition();
-        return (p1.x * p1.x + p1.y * p1.y) < (p2.x * p2.x + p2.y * p2.y);
+    // a couple of chunks per thread so the pool can steal around the slower ones
+    const std::size_t chunkCount = std::max<std::size_t>(std::min(this->threadPool.getThreadCount() * 2, n), 1);
+
+    // give every chunk the same number of pair evaluations instead of the same number of rows
+    // row i evaluates n - i - 1 pairs, so the first rows are much more expensive than the last ones
+    std::pmr::vector<std::size_t> rowBounds(chunkCount + 1, &this->frameArena);
+    const std::size_t totalPairs = n * (n - 1) / 2;
+    for (std::size_t t = 0; t < chunkCount; ++t)
+        rowBounds[t] = rowForPairCount(n, totalPairs / chunkCount * t + std::min(t, totalPairs % chunkCount));
+    rowBounds[chunkCount] = n;
+
+    // private acceleration buffers per chunk => no locking while accumulating, and the reduction order
+    // does not depend on which worker ran the chunk
+    // chunk t only touches indices >= rowBounds[t], so only that part is cleared and reduced
+    this->chunkAccelerationsX.resize(chunkCount);
+    this->chunkAccelerationsY.resize(chunkCount);
+
+    this->threadPool.run(chunkCount, [&](std::size_t t, std::size_t) {
+        const ParticleStore& p = this->particles;
+        std::vector<float>& bufferX = this->chunkAccelerationsX[t];
+        std::vector<float>& bufferY = this->chunkAccelerationsY[t];
+        bufferX.resize(n);
+        bufferY.resize(n);
+        std::fill(bufferX.begin() + rowBounds[t], bufferX.end(), 0.f);
+        std::fill(bufferY.begin() + rowBounds[t], bufferY.end(), 0.f);
+
+        this->kernel.triangle(p.x.data(), p.y.data(), p.mass.data(), n, rowBounds[t], rowBounds[t + 1], this->interaction,
+            bufferX.data(), bufferY.data());
+    });
+
+    // parallel reduction: every task sums all buffers over its own slice of particles
+    this->threadPool.parallelFor(0, n, [&](std::size_t start, std::size_t end, std::size_t) {
+        ParticleStore& p = this->particles;
+        for (std::size_t k = 0; k < chunkCount && rowBounds[k] < end; ++k)
+        {
+            const std::vector<float>& bufferX = this->chunkAccelerationsX[k];
+            const std::vector<float>& bufferY = this->chunkAccelerationsY[k];
+            for (std::size_t i = std::max(start, rowBounds[k]); i < end; ++i)
+            {
+                p.ax[i] += bufferX[i];
+                p.ay[i] += bufferY[i];
+            }
+        }
+    });
+}
+
+void ParticleSystem::computeBarnesHutForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due)
+{
+    Profiler::Scope scope("forces.barnesHut");
+    const float magnitudeThreshold = this->interaction.softeningLength * this->interaction.softeningLength;
+    const float G = this->interaction.G;
+
+    // the tree is built straight over the position and mass arrays
+    const std::size_t n = this->particles.size();
+    this->quadTree.build(this->particles.x.data(), this->particles.y.data(), this->particles.mass.data(), n);
+
+    // every particle only writes its own acceleration => no synchronization needed
+    std::atomic<std::size_t> interactionCount{ 0 };
+    auto updateParticles = [&](std::size_t start, std::size_t stop, std::size_t) {
+        std::size_t interactions = 0;
+        for (std::size_t i = start; i < stop; ++i)
+        {
+            if (due && !due[i]) continue;
+
+            sf::Vector2f acceleration = this->quadTree.computeAcceleration(
+                this->particles.x[i], this->particles.y[i], i, this->openingAngle, G, magnitudeThreshold, &interactions);
+            this->particles.ax[i] += acceleration.x;
+            this->particles.ay[i] += acceleration.y;
+        }
+        interactionCount += interactions;
+    };
+
+    if (parallel)
+        this->threadPool.parallelFor(begin, end, updateParticles);
+    else
+        updateParticles(begin, end, 0);
+
+    this->statistics.interactionCount = interactionCount;
+}
+
+void ParticleSystem::computeFastMultipoleForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due)
+{
+    Profiler::Scope scope("forces.fastMultipole");
+    const float magnitudeThreshold = this->interaction.softeningLength * this->interaction.softeningLength;
+    const float G = this->interaction.G;
+
+    // a few subtrees per thread so the pool can balance uneven ones
+    const std::size_t n = this->particles.size();
+    const std::size_t taskCountHint = parallel ? 4 * this->threadPool.getThreadCount() : 1;
+    this->fastMultipole.build(this->particles.x.data(), this->particles.y.data(), this->particles.mass.data(), n,
+        begin, end, due, this->expansionOrder, taskCountHint);
+
+    auto runTasks = [&](const ThreadPool::Task& task) {
+        if (parallel)
+            this->threadPool.run(this->fastMultipole.getTaskCount(), task);
+        else
+            for (std::size_t t = 0; t < this->fastMultipole.getTaskCount(); ++t) task(t, 0);
+    };
+
+    runTasks([&](std::size_t t, std::size_t) { this->fastMultipole.computeMultipoles(t); });
+    this->fastMultipole.computeUpperMultipoles();
+
+    // every task only writes the locals and accelerations of its own subtree
+    std::atomic<std::size_t> interactionCount{ 0 };
+    runTasks([&](std::size_t t, std::size_t) {
+        interactionCount += this->fastMultipole.evaluate(t, this->openingAngle, G, magnitudeThreshold,
+            this->particles.ax.data(), this->particles.ay.data());
     });
 
-    for (std::size_t i = 0; i < particleCount; ++i)
+    this->statistics.interactionCount = interactionCount;
+}
+
+void ParticleSystem::computeParticleMeshForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due)
+{
+    Profiler::Scope scope("forces.particleMesh");
+    const float G = this->interaction.G;
+
+    // every pass writes disjoint rows, cells or particles (the deposit goes through per-worker grids)
+    this->statistics.interactionCount = this->particleMesh.computeAccelerations(this->particles, begin, end, due, G,
+        this->particles.ax.data(), this->particles.ay.data(), parallel ? &this->threadPool : nullptr);
+}
+
+void ParticleSystem::measureForceError(std::size_t begin, std::size_t end)
+{
+    this->statistics.forceError = 0.f;
+    this->statistics.forceErrorSampleCount = 0;
+    if (this->forceEngine == ForceEngine::DirectSum || this->forceErrorSampleCount == 0 || begin >= end) return;
+    Profiler::Scope scope("forces.errorCheck");
+
+    const ParticleStore& p = this->particles;
+    const std::size_t n = p.size();
+
+    // evenly spread samples, the reference is summed in double with the interaction of the direct summation
+    // the trees always clamp, so they are measured against clamped direct summation, not the chosen softening
+    ForceKernels::Interaction reference = this->interaction;
+    if (this->forceEngine == ForceEngine::BarnesHut || this->forceEngine == ForceEngine::FastMultipole)
+        reference.softening = ForceKernels::Softening::Clamp;
+
+    const std::size_t sampleCount = std::min(this->forceErrorSampleCount, end - begin);
+    double errorSquared = 0.0, referenceSquared = 0.0;
+    for (std::size_t s = 0; s < sampleCount; ++s)
     {
-        sf::Vector2f p = this->particles[i].getPosition();
-        float mag = std::sqrtf(p.x * p.x + p.y * p.y);
-        float v = std::sqrtf(i / mag);
-        this->particles[i].setVelocity(this->particles[i].getVelocity() * v);
-    }*/
+        const std::size_t i = begin + s * (end - begin) / sampleCount;
+        if (!p.active[i]) continue;
+
+        double referenceX = 0.0, referenceY = 0.0;
+        for (std::size_t j = 0; j < n; ++j)
+        {
+            const double diffX = static_cast<double>(p.x[j]) - p.x[i];
+            const double diffY = static_cast<double>(p.y[j]) - p.y[i];
+            const double magnitude_squared = diffX * diffX + diffY * diffY;
+            if (magnitude_squared == 0.0) continue;
+
+            const double tmp = ForceKernels::pairAcceleration(reference, magnitude_squared) * p.mass[j];
+            referenceX += tmp * diffX;
+            referenceY += tmp * diffY;
+        }
+
+        errorSquared += (p.ax[i] - referenceX) * (p.ax[i] - referenceX) + (p.ay[i] - referenceY) * (p.ay[i] - referenceY);
+        referenceSquared += referenceX * referenceX + referenceY * referenceY;
+        ++this->statistics.forceErrorSampleCount;
+    }
+
+    if (referenceSquared > 0.0)
+        this->statistics.forceError = static_cast<float>(std::sqrt(errorSquared / referenceSquared));
 }
 
-void ParticleSystem::distributeParticles(const std::size_t particleCount, const float maxRadius)
+std::size_t ParticleSystem::rowForPairCount(const std::size_t n, const std::size_t pairCount)
+{
+    // first row r such that rows [0, r) contain at least pairCount pairs
+    // rows [0, r) contain r * n - r * (r + 1) / 2 pairs, which grows monotonically with r
+    std::size_t low = 0, high = n;
+    while (low < high)
+    {
+        std::size_t middle = (low + high) / 2;
+        if (middle * n - middle * (middle + 1) / 2 < pairCount) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+void ParticleSystem::moveParticles(sf::Time deltaTime, std::size_t begin, std::size_t end, bool parallel)
+{
+    const float dt = deltaTime.asSeconds();
+    auto moveRange = [&](std::size_t start, std::size_t stop, std::size_t) {
+        ParticleStore& p = this->particles;
+        for (std::size_t i = start; i < stop; ++i)
+        {
+            // only move if it is active
+            if (!p.active[i]) continue;
+
+            // calculate new velocity based on acceleration, then new position based on new velocity
+            p.vx[i] += p.ax[i] * dt;
+            p.vy[i] += p.ay[i] * dt;
+            p.x[i] += p.vx[i] * dt;
+            p.y[i] += p.vy[i] * dt;
+
+            // reset acceleration to 0
+            p.ax[i] = 0.f;
+            p.ay[i] = 0.f;
+        }
+    };
+
+    if (parallel)
+        this->threadPool.parallelFor(begin, end, moveRange);
+    else
+        moveRange(begin, end, 0);
+}
+
+void ParticleSystem::recordSharedTimestep(std::size_t particleCount)
+{
+    this->statistics.timestepBinCounts.assign(1, particleCount);
+    this->statistics.substepCount = 1;
+    this->statistics.forceEvaluationCount = particleCount;
+    this->statistics.sharedStepEvaluationCount = particleCount;
+}
+
+std::size_t ParticleSystem::getTimestepBin(const std::size_t i, const float deltaTime) const
+{
+    const ParticleStore& p = this->particles;
+    const float acceleration = std::sqrt(p.ax[i] * p.ax[i] + p.ay[i] * p.ay[i]);
+    const float velocity = std::sqrt(p.vx[i] * p.vx[i] + p.vy[i] * p.vy[i]);
+
+    float step = deltaTime;
+    if (acceleration > 0.f) step = std::min(step, this->timestepAccuracy * std::sqrt(p.radius[i] / acceleration));
+    if (velocity > 0.f) step = std::min(step, this->timestepAccuracy * p.radius[i] / velocity);
+
+    std::size_t bin = 0;
+    while (bin + 1 < this->timestepBinCount && deltaTime / static_cast<float>(std::size_t{ 1 } << bin) > step) ++bin;
+    return bin;
+}
+
+void ParticleSystem::advanceBlockTimesteps(sf::Time deltaTime, bool parallel)
 {
-    const float PI = 3.14159265f;
-    for (std::size_t i = 0; i < particleCount; ++i)
+    // includes the force evaluations of the substeps
+    Profiler::Scope scope("integration");
+    ParticleStore& p = this->particles;
+    const std::size_t n = p.size();
+    const float dt = deltaTime.asSeconds();
+    const bool kickDriftKick = this->integrator != Integrator::SemiImplicitEuler;
+
+    // substeps are counted in units of the finest bin, bin k starts a block every (substepCount >> k) substeps
+    const std::size_t substepCount = std::size_t{ 1 } << (this->timestepBinCount - 1);
+    const float substep = dt / static_cast<float>(substepCount);
+
+    this->timestepBins.assign(n, 0);
+    this->dueParticles.resize(n);
+
+    StepStatistics& statistics = this->statistics;
+    statistics.forceTime = sf::Time::Zero;
+    statistics.integrationTime = sf::Time::Zero;
+    statistics.substepCount = 0;
+    statistics.forceEvaluationCount = 0;
+    std::size_t interactionCount = 0;
+    std::size_t finestBin = 0;
+
+    sf::Clock clock;
+    auto computeDueForces = [&]() {
+        std::size_t dueCount = 0;
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (!this->dueParticles[i]) continue;
+            ++dueCount;
+            // euler resets the accelerations after its kick, the kick-drift-kick blocks keep them for the closing kick
+            if (kickDriftKick) p.ax[i] = p.ay[i] = 0.f;
+        }
+
+        clock.restart();
+        this->computeForces(0, n, parallel, this->dueParticles.data());
+        statistics.forceTime += clock.restart();
+        interactionCount += statistics.interactionCount;
+        statistics.forceEvaluationCount += dueCount;
+    };
+
+    // every active particle opens a block at s == 0, kick-drift-kick can open with the closing forces of the last update
+    for (std::size_t i = 0; i < n; ++i) this->dueParticles[i] = p.active[i];
+    if (!kickDriftKick && this->accelerationsCurrent) this->clearAccelerations(0, n);
+    if (!kickDriftKick || !this->accelerationsCurrent || this->accelerationsBegin != 0 || this->accelerationsEnd != n)
+        computeDueForces();
+    this->accelerationsCurrent = false;
+
+    this->measureForceError(0, n);
+    clock.restart();
+
+    std::size_t s = 0;
+    while (true)
     {
-        float angle = randFloat() * 2 * PI;
-        float sin = std::sin(angle);
-        float cos = std::cos(angle);
+        // due particles close their block (kick-drift-kick only), get a new bin from the fresh acceleration
+        // and open the next block: a half kick for kick-drift-kick, a kick over the whole block for euler
+        auto kickRange = [&](std::size_t start, std::size_t stop, std::size_t) {
+            for (std::size_t i = start; i < stop; ++i)
+            {
+                if (!this->dueParticles[i]) continue;
 
-        float radius = randFloat() * maxRadius;
-        float velMult = 1.f;
+                if (kickDriftKick && s > 0)
+                {
+                    const float closingStep = dt / static_cast<float>(std::size_t{ 1 } << this->timestepBins[i]) / 2.f;
+                    p.vx[i] += p.ax[i] * closingStep;
+                    p.vy[i] += p.ay[i] * closingStep;
+                }
 
-        sf::Vector2f pos = sf::Vector2f{ cos, sin } * radius;
-        sf::Vector2f vel = sf::Vector2f{ sin , -cos } *velMult;
+                // finer bins are always in step; a coarser bin must wait for a substep where its blocks start
+                std::size_t bin = this->getTimestepBin(i, dt);
+                while (bin < this->timestepBins[i] && s % (substepCount >> bin) != 0) ++bin;
+                this->timestepBins[i] = static_cast<std::uint8_t>(bin);
 
-        this->particles.push_back({ pos, vel, 1.f });
+                const float blockStep = dt / static_cast<float>(std::size_t{ 1 } << bin) / (kickDriftKick ? 2.f : 1.f);
+                p.vx[i] += p.ax[i] * blockStep;
+                p.vy[i] += p.ay[i] * blockStep;
+                p.ax[i] = 0.f;
+                p.ay[i] = 0.f;
+            }
+        };
+        if (parallel)
+            this->threadPool.parallelFor(0, n, kickRange);
+        else
+            kickRange(0, n, 0);
+
+        this->binOccupancy.assign(this->timestepBinCount, 0);
+        for (std::size_t i = 0; i < n; ++i)
+            if (p.active[i]) ++this->binOccupancy[this->timestepBins[i]];
+        for (std::size_t bin = 0; bin < this->timestepBinCount; ++bin)
+            if (this->binOccupancy[bin] > 0) finestBin = std::max(finestBin, bin);
+        if (s == 0) statistics.timestepBinCounts = this->binOccupancy;
+
+        // skip the substeps where no block starts and drift every active particle up to the next one
+        std::size_t next = s + 1;
+        auto isDue = [&](std::size_t substepIndex) {
+            for (std::size_t bin = 0; bin < this->timestepBinCount; ++bin)
+                if (this->binOccupancy[bin] > 0 && substepIndex % (substepCount >> bin) == 0) return true;
+            return false;
+        };
+        while (next < substepCount && !isDue(next)) ++next;
+
+        this->driftParticles(substep * static_cast<float>(next - s), 0, n, parallel);
+        statistics.integrationTime += clock.restart();
+        ++statistics.substepCount;
+
+        s = next;
+        if (s == substepCount) break;
+
+        for (std::size_t i = 0; i < n; ++i)
+            this->dueParticles[i] = p.active[i] && s % (substepCount >> this->timestepBins[i]) == 0;
+        computeDueForces();
+    }
+
+    if (kickDriftKick)
+    {
+        // every block ends with the update: the closing kick of all particles, its forces open the next update
+        for (std::size_t i = 0; i < n; ++i) this->dueParticles[i] = p.active[i];
+        computeDueForces();
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            if (!p.active[i]) continue;
+            const float closingStep = dt / static_cast<float>(std::size_t{ 1 } << this->timestepBins[i]) / 2.f;
+            p.vx[i] += p.ax[i] * closingStep;
+            p.vy[i] += p.ay[i] * closingStep;
+        }
+        statistics.integrationTime += clock.restart();
+
+        this->accelerationsCurrent = true;
+        this->accelerationsBegin = 0;
+        this->accelerationsEnd = n;
+    }
+
+    statistics.interactionCount = interactionCount;
+    statistics.sharedStepEvaluationCount = (statistics.timestepBinCounts.empty() ? 0
+        : std::accumulate(statistics.timestepBinCounts.begin(), statistics.timestepBinCounts.end(), std::size_t{ 0 })) << finestBin;
+}
+
+void ParticleSystem::integrate(sf::Time deltaTime, std::size_t begin, std::size_t end, bool parallel)
+{
+    // includes the force evaluations of the stages
+    Profiler::Scope scope("integration");
+    this->recordSharedTimestep(end - begin);
+    const float dt = deltaTime.asSeconds();
+    sf::Clock clock;
+
+    if (this->integrator == Integrator::SemiImplicitEuler)
+    {
+        // forces are accumulated on top of the store's accelerations, so drop any left by kick-drift-kick
+        if (this->accelerationsCurrent) this->clearAccelerations(0, this->particles.size());
+        this->accelerationsCurrent = false;
+
+        clock.restart();
+        this->computeForces(begin, end, parallel);
+        this->statistics.forceTime = clock.restart();
+
+        // not part of the force time
+        this->measureForceError(begin, end);
+        clock.restart();
+
+        this->moveParticles(deltaTime, begin, end, parallel);
+        this->statistics.integrationTime = clock.getElapsedTime();
+        return;
     }
 
-    /*std::sort(this->particles.begin(), this->particles.end(), [](const Particle& part1, const Particle& part2) {
-        auto p1 = part1.getPosition();
-        auto p2 = part2.getPosition();
-        return (p1.x * p1.x + p1.y * p1.y) < (p2.x * p2.x + p2.y * p2.y);
+    // yoshida: leapfrog steps of w1, w0, w1 times the step cancel the third order error terms
+    const float cubeRoot = static_cast<float>(std::cbrt(2.0));
+    const float yoshidaWeights[3] = { 1.f / (2.f - cubeRoot), -cubeRoot / (2.f - cubeRoot), 1.f / (2.f - cubeRoot) };
+    const float leapfrogWeights[1] = { 1.f };
+    const bool yoshida = this->integrator == Integrator::Yoshida;
+    const float* weights = yoshida ? yoshidaWeights : leapfrogWeights;
+    const std::size_t stageCount = yoshida ? 3 : 1;
+
+    this->statistics.forceTime = sf::Time::Zero;
+    this->statistics.integrationTime = sf::Time::Zero;
+    std::size_t interactionCount = 0;
+    std::size_t evaluationCount = 0;
+
+    auto evaluateForces = [&]() {
+        this->clearAccelerations(begin, end);
+        clock.restart();
+        this->computeForces(begin, end, parallel);
+        this->statistics.forceTime += clock.restart();
+        interactionCount += this->statistics.interactionCount;
+        evaluationCount += end - begin;
+    };
+
+    // first same as last: the closing kick forces of the previous step open this one unless something changed since
+    if (!this->accelerationsCurrent || this->accelerationsBegin != begin || this->accelerationsEnd != end)
+        evaluateForces();
+    this->accelerationsCurrent = false;
+
+    this->measureForceError(begin, end);
+    clock.restart();
+
+    for (std::size_t stage = 0; stage < stageCount; ++stage)
+    {
+        const float stageStep = weights[stage] * dt;
+        this->kickParticles(stageStep / 2.f, begin, end, parallel);
+        this->driftParticles(stageStep, begin, end, parallel);
+        this->statistics.integrationTime += clock.restart();
+
+        if (this->synchronizationCallback) this->synchronizationCallback();
+
+        evaluateForces();
+        this->kickParticles(stageStep / 2.f, begin, end, parallel);
+        this->statistics.integrationTime += clock.restart();
+    }
+
+    this->accelerationsCurrent = true;
+    this->accelerationsBegin = begin;
+    this->accelerationsEnd = end;
+
+    this->statistics.interactionCount = interactionCount;
+    this->statistics.forceEvaluationCount = evaluationCount;
+    this->statistics.sharedStepEvaluationCount = evaluationCount;
+}
+
+void ParticleSystem::kickParticles(float deltaTime, std::size_t begin, std::size_t end, bool parallel)
+{
+    auto kickRange = [&](std::size_t start, std::size_t stop, std::size_t) {
+        ParticleStore& p = this->particles;
+        for (std::size_t i = start; i < stop; ++i)
+        {
+            if (!p.active[i]) continue;
+            p.vx[i] += p.ax[i] * deltaTime;
+            p.vy[i] += p.ay[i] * deltaTime;
+        }
+    };
+
+    if (parallel)
+        this->threadPool.parallelFor(begin, end, kickRange);
+    else
+        kickRange(begin, end, 0);
+}
+
+void ParticleSystem::driftParticles(float deltaTime, std::size_t begin, std::size_t end, bool parallel)
+{
+    auto driftRange = [&](std::size_t start, std::size_t stop, std::size_t) {
+        ParticleStore& p = this->particles;
+        for (std::size_t i = start; i < stop; ++i)
+        {
+            if (!p.active[i]) continue;
+            p.x[i] += p.vx[i] * deltaTime;
+            p.y[i] += p.vy[i] * deltaTime;
+        }
+    };
+
+    if (parallel)
+        this->threadPool.parallelFor(begin, end, driftRange);
+    else
+        driftRange(begin, end, 0);
+}
+
+void ParticleSystem::clearAccelerations(std::size_t begin, std::size_t end)
+{
+    std::fill(this->particles.ax.begin() + begin, this->particles.ax.begin() + end, 0.f);
+    std::fill(this->particles.ay.begin() + begin, this->particles.ay.begin() + end, 0.f);
+}
+
+ParticleSystem::Energy ParticleSystem::computeEnergy()
+{
+    const ParticleStore& p = this->particles;
+    const std::size_t n = p.size();
+
+    // full rows (each pair counted from both sides) keep the chunks balanced; one partial sum per chunk
+    // keeps the result independent of which worker ran the chunk
+    const std::size_t chunkCount = std::max<std::size_t>(std::min(4 * this->threadPool.getThreadCount(), n), 1);
+    std::pmr::vector<Energy> chunkEnergies(chunkCount, &this->frameArena);
+    this->threadPool.run(chunkCount, [&](std::size_t t, std::size_t) {
+        Energy& energy = chunkEnergies[t];
+        for (std::size_t i = n * t / chunkCount; i < n * (t + 1) / chunkCount; ++i)
+        {
+            if (!p.active[i]) continue;
+            energy.kinetic += 0.5 * p.mass[i] * (static_cast<double>(p.vx[i]) * p.vx[i] + static_cast<double>(p.vy[i]) * p.vy[i]);
+
+            for (std::size_t j = 0; j < n; ++j)
+            {
+                if (j == i || !p.active[j]) continue;
+                const double diffX = static_cast<double>(p.x[j]) - p.x[i];
+                const double diffY = static_cast<double>(p.y[j]) - p.y[i];
+                const double magnitude = std::sqrt(diffX * diffX + diffY * diffY);
+
+                energy.potential += 0.5 * p.mass[i] * p.mass[j] * ForceKernels::pairPotential(this->interaction, magnitude);
+            }
+        }
     });
 
-    for (std::size_t i = 0; i < particleCount; ++i)
+    Energy total;
+    for (const Energy& energy : chunkEnergies)
     {
-        sf::Vector2f p = this->particles[i].getPosition();
-        float mag = std::sqrtf(p.x * p.x + p.y * p.y);
-        float v = std::sqrtf(i / mag);
-        this->particles[i].setVelocity(this->particles[i].getVelocity() * v);
-    }*/
+        total.kinetic += energy.kinetic;
+        total.potential += energy.potential;
+    }
+    return total;
 }
 
-void ParticleSystem::addParticle(sf::Vector2f position, float mass, sf::Vector2f acceleration)
+std::size_t ParticleSystem::getParticleCount() const
 {
-    // TODO: get rid of magic values
-    sf::Vector2f velocity{ (std::rand() % 600 - 300) / 10.f, (std::rand() % 600 - 300) / 10.f };
-    this->particles.push_back({ position, velocity, mass, acceleration, this->particlesVertexCount });
+    return this->particles.size();
 }
 
-void ParticleSystem::addParticle(sf::Vector2f position, sf::Vector2f velocity, float mass, sf::Vector2f acceleration)
+ParticleSnapshot::DrawMode ParticleSystem::getDrawMode() const
 {
-    this->particles.push_back({ position, velocity, mass, acceleration, this->particlesVertexCount });
+    return this->drawMode;
 }
 
-void ParticleSystem::update(sf::Time deltaTime)
+const ParticleStore& ParticleSystem::getParticles() const
+{
+    return this->particles;
+}
+
+ParticleStore& ParticleSystem::getParticles()
+{
+    return this->particles;
+}
+
+const ParticleSystem::StepStatistics& ParticleSystem::getStatistics() const
+{
+    return this->statistics;
+}
+
+double ParticleSystem::getSimulationTime() const
+{
+    return this->simulationTime;
+}
+
+const char* ParticleSystem::getForceEngineName(const ForceEngine engine)
+{
+    switch (engine)
+    {
+    case ForceEngine::BarnesHut: return "barnes-hut";
+    case ForceEngine::FastMultipole: return "fmm";
+    case ForceEngine::ParticleMesh: return "pm";
+    default: return "direct";
+    }
+}
+
+const char* ParticleSystem::getCollisionBroadPhaseName(const CollisionBroadPhase broadPhase)
+{
+    switch (broadPhase)
+    {
+    case CollisionBroadPhase::UniformGrid: return "grid";
+    default: return "sweep";
+    }
+}
+
+bool ParticleSystem::parseCollisionBroadPhase(const std::string& name, CollisionBroadPhase& broadPhase)
+{
+    for (CollisionBroadPhase candidate : { CollisionBroadPhase::SweepAndPrune, CollisionBroadPhase::UniformGrid })
+    {
+        if (name == getCollisionBroadPhaseName(candidate))
+        {
+            broadPhase = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* ParticleSystem::getIntegratorName(const Integrator integrator)
+{
+    switch (integrator)
+    {
+    case Integrator::Leapfrog: return "leapfrog";
+    case Integrator::Yoshida: return "yoshida4";
+    default: return "euler";
+    }
+}
+
+bool ParticleSystem::parseIntegrator(const std::string& name, Integrator& integrator)
 {
-    const float magnitudeThreshold = 0.01f;
-    const float G = 1.f;
-    for (std::size_t i = 0; i < this->particles.size(); ++i)
+    for (Integrator candidate : { Integrator::SemiImplicitEuler, Integrator::Leapfrog, Integrator::Yoshida })
     {
-        sf::Vector2f pos1 = this->particles[i].getPosition();
-        float mass1 = this->particles[i].getMass();
-        sf::Vector2f acceleration{ 0.f, 0.f };
-        for (std::size_t j = i + 1; j < this->particles.size(); ++j)
+        if (name == getIntegratorName(candidate))
         {
-            sf::Vector2f pos2 = this->particles[j].getPosition();
-            float mass2 = this->particles[j].getMass();
+            integrator = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* ParticleSystem::getDistributionName(const Distribution distribution)
+{
+    switch (distribution)
+    {
+    case Distribution::UniformDisc: return "uniform-disc";
+    case Distribution::Plummer: return "plummer";
+    case Distribution::ExponentialDisc: return "exponential-disc";
+    case Distribution::GalaxyCollision: return "galaxies";
+    default: return "disc";
+    }
+}
 
-            sf::Vector2f diff = pos2 - pos1;
-            float magnitude_squared = diff.x * diff.x + diff.y * diff.y;
-            float magnitude = std::sqrtf(magnitude_squared);
-            sf::Vector2f tmp = G * diff / (std::max(magnitude_squared, magnitudeThreshold) * magnitude);
+bool ParticleSystem::parseDistribution(const std::string& name, Distribution& distribution)
+{
+    for (Distribution candidate : { Distribution::Disc, Distribution::UniformDisc, Distribution::Plummer,
+        Distribution::ExponentialDisc, Distribution::GalaxyCollision })
+    {
+        if (name == getDistributionName(candidate))
+        {
+            distribution = candidate;
+            return true;
+        }
+    }
+    return false;
+}
 
-            this->particles[i].setAcceleration(this->particles[i].getAcceleration() + mass2 * tmp);
-            this->particles[j].setAcceleration(this->particles[j].getAcceleration() - mass1 * tmp);
+bool ParticleSystem::parseForceEngine(const std::string& name, ForceEngine& engine)
+{
+    for (ForceEngine candidate : { ForceEngine::DirectSum, ForceEngine::BarnesHut, ForceEngine::FastMultipole, ForceEngine::ParticleMesh })
+    {
+        if (name == getForceEngineName(candidate))
+        {
+            engine = candidate;
+            return true;
         }
     }
+    return false;
+}
+
+ParticleSystem::ForceEngine ParticleSystem::getForceEngine() const
+{
+    return this->forceEngine;
+}
 
-    for (auto& particle : this->particles)
-        particle.move(deltaTime);
+float ParticleSystem::getOpeningAngle() const
+{
+    return this->openingAngle;
+}
+
+std::size_t ParticleSystem::getExpansionOrder() const
+{
+    return this->expansionOrder;
+}
+
+std::size_t ParticleSystem::getMeshSize() const
+{
+    return this->particleMesh.getSize();
+}
+
+ParticleMesh::Assignment ParticleSystem::getMeshAssignment() const
+{
+    return this->particleMesh.getAssignment();
+}
+
+float ParticleSystem::getMeshSoftening() const
+{
+    return this->particleMesh.getSoftening();
+}
+
+std::size_t ParticleSystem::getForceErrorSampleCount() const
+{
+    return this->forceErrorSampleCount;
+}
+
+std::size_t ParticleSystem::getTimestepBinCount() const
+{
+    return this->timestepBinCount;
+}
+
+float ParticleSystem::getTimestepAccuracy() const
+{
+    return this->timestepAccuracy;
+}
+
+std::size_t ParticleSystem::getThreadCount() const
+{
+    return this->threadPool.getThreadCount();
+}
+
+ForceKernels::InstructionSet ParticleSystem::getInstructionSet() const
+{
+    return this->kernel.instructionSet;
+}
+
+ForceKernels::Precision ParticleSystem::getPrecision() const
+{
+    return this->interaction.precision;
+}
+
+ForceKernels::Softening ParticleSystem::getSoftening() const
+{
+    return this->interaction.softening;
+}
+
+float ParticleSystem::getSofteningLength() const
+{
+    return this->interaction.softeningLength;
+}
+
+float ParticleSystem::getGravitationalConstant() const
+{
+    return this->interaction.G;
+}
+
+ParticleSystem::Integrator ParticleSystem::getIntegrator() const
+{
+    return this->integrator;
+}
+
+ParticleSystem::CollisionBroadPhase ParticleSystem::getCollisionBroadPhase() const
+{
+    return this->broadPhase;
+}
+
+void ParticleSystem::setParticlesVertexCount(const std::size_t newCount)
+{
+    this->particlesVertexCount = newCount;
+}
+
+void ParticleSystem::setDrawMode(const ParticleSnapshot::DrawMode newDrawMode)
+{
+    this->drawMode = newDrawMode;
+}
+
+void ParticleSystem::setForceEngine(const ForceEngine newEngine)
+{
+    this->forceEngine = newEngine;
+    this->accelerationsCurrent = false;
+}
+
+void ParticleSystem::setOpeningAngle(const float newAngle)
+{
+    this->openingAngle = std::max(newAngle, 0.f);
+    this->accelerationsCurrent = false;
+}
+
+void ParticleSystem::setExpansionOrder(const std::size_t newOrder)
+{
+    this->expansionOrder = std::min(std::max<std::size_t>(newOrder, 1), FastMultipole::maxOrder);
+    this->accelerationsCurrent = false;
+}
+
+void ParticleSystem::setMeshSize(const std::size_t newSize)
+{
+    this->particleMesh.setSize(newSize);
+    this->accelerationsCurrent = false;
+}
+
+void ParticleSystem::setMeshAssignment(const ParticleMesh::Assignment newAssignment)
+{
+    this->particleMesh.setAssignment(newAssignment);
+    this->accelerationsCurrent = false;
+}
+
+void ParticleSystem::setMeshSoftening(const float newSoftening)
+{
+    this->particleMesh.setSoftening(newSoftening);
+    this->accelerationsCurrent = false;
+}
+
+void ParticleSystem::setForceErrorSampleCount(const std::size_t newCount)
+{
+    this->forceErrorSampleCount = newCount;
+}
+
+void ParticleSystem::setTimestepBinCount(const std::size_t newCount)
+{
+    this->timestepBinCount = std::min<std::size_t>(std::max<std::size_t>(newCount, 1), 16);
+}
+
+void ParticleSystem::setTimestepAccuracy(const float newAccuracy)
+{
+    this->timestepAccuracy = std::max(newAccuracy, 0.f);
+}
+
+void ParticleSystem::setIntegrator(const Integrator newIntegrator)
+{
+    this->integrator = newIntegrator;
+}
+
+void ParticleSystem::setSynchronizationCallback(std::function<void()> callback)
+{
+    this->synchronizationCallback = std::move(callback);
+}
+
+void ParticleSystem::setRandomSeed(const std::uint64_t seed)
+{
+    this->randomState = seed;
+}
+
+void ParticleSystem::setThreadCount(const std::size_t newCount)
+{
+    this->threadPool.setThreadCount(newCount);
+}
+
+void ParticleSystem::setCollisionBroadPhase(const CollisionBroadPhase newBroadPhase)
+{
+    this->broadPhase = newBroadPhase;
+}
+
+void ParticleSystem::setInstructionSet(const ForceKernels::InstructionSet newInstructionSet)
+{
+    // fall back to scalar on cpus without support
+    this->instructionSet = ForceKernels::isSupported(newInstructionSet)
+        ? newInstructionSet
+        : ForceKernels::InstructionSet::Scalar;
+    this->selectForceKernel();
+}
+
+void ParticleSystem::setPrecision(const ForceKernels::Precision newPrecision)
+{
+    this->interaction.precision = newPrecision;
+    this->selectForceKernel();
+}
+
+void ParticleSystem::setSoftening(const ForceKernels::Softening newSoftening)
+{
+    this->interaction.softening = newSoftening;
+    this->selectForceKernel();
+}
+
+void ParticleSystem::setSofteningLength(const float newLength)
+{
+    this->interaction.softeningLength = std::max(newLength, 0.f);
+    this->selectForceKernel();
+}
+
+void ParticleSystem::setGravitationalConstant(const float newG)
+{
+    this->interaction.G = newG;
+    this->selectForceKernel();
+}
+
+void ParticleSystem::selectForceKernel()
+{
+    this->kernel = ForceKernels::selectKernel(this->instructionSet, this->interaction);
+    this->accelerationsCurrent = false;
+}
+
+void ParticleSystem::generateParticles(ParticleStore& particles, const std::size_t begin, const std::size_t end,
+    const Distribution distribution, float scale, const CounterRandom& random, ThreadPool& threadPool)
+{
+    if (scale <= 0.f) scale = std::sqrt(static_cast<float>(end - begin)) * 10.f;
+
+    switch (distribution)
+    {
+    case Distribution::UniformDisc:
+        InitialConditions::uniformDisc(particles, begin, end, random, scale, threadPool);
+        break;
+    case Distribution::Plummer:
+        InitialConditions::plummer(particles, begin, end, random, scale / 5.f, threadPool);
+        break;
+    case Distribution::ExponentialDisc:
+        InitialConditions::exponentialDisc(particles, begin, end, random, scale / 5.f, { 0.f, 0.f }, { 0.f, 0.f }, true, threadPool);
+        break;
+    case Distribution::GalaxyCollision:
+        InitialConditions::galaxyCollision(particles, begin, end, random, scale, threadPool);
+        break;
+    default:
+        InitialConditions::disc(particles, begin, end, random, scale, threadPool);
+        break;
+    }
+}
+
+void ParticleSystem::distributeParticles(const Distribution distribution, const std::size_t particleCount, float scale)
+{
+    // the bodies are written in place, so the store is grown once
+    const std::size_t begin = this->particles.size();
+    const std::size_t end = begin + particleCount;
+    this->particles.resize(end);
+
+    generateParticles(this->particles, begin, end, distribution, scale, CounterRandom(this->randomNumber()), this->threadPool);
+
+    // the new bodies change every force
+    this->accelerationsCurrent = false;
+}
+
+void ParticleSystem::distributeParticles(const std::size_t particleCount)
+{
+    this->distributeParticles(Distribution::Disc, particleCount);
+}
+
+void ParticleSystem::distributeParticles(const std::size_t particleCount, const float maxRadius)
+{
+    this->distributeParticles(Distribution::UniformDisc, particleCount, maxRadius);
+}
+
+void ParticleSystem::addParticle(sf::Vector2f position, float mass, sf::Vector2f acceleration)
+{
+    // TODO: get rid of magic values
+    sf::Vector2f velocity{ (static_cast<int>(randFloat() * 600) - 300) / 10.f, (static_cast<int>(randFloat() * 600) - 300) / 10.f };
+    this->particles.push(position, velocity, mass, acceleration);
+}
+
+void ParticleSystem::addParticle(sf::Vector2f position, sf::Vector2f velocity, float mass, sf::Vector2f acceleration)
+{
+    this->particles.push(position, velocity, mass, acceleration);
+}
+
+std::uint64_t ParticleSystem::beginStepPhase()
+{
+    const std::uint64_t allocationCount = AllocationCounter::getCount();
+    this->frameArena.reset();
+    return allocationCount;
+}
+
+void ParticleSystem::endStepPhase(const std::uint64_t allocationCount, std::uint64_t& phaseAllocationCount)
+{
+    phaseAllocationCount = AllocationCounter::getCount() - allocationCount;
+    this->statistics.frameArenaPeakUsage = this->frameArena.getPeakUsage();
+    this->statistics.frameArenaCapacity = this->frameArena.getCapacity();
+}
+
+void ParticleSystem::captureSnapshot(ParticleSnapshot& snapshot) const
+{
+    snapshot.capture(this->particles, this->particlesVertexCount, this->drawMode);
+}
+
+void ParticleSystem::update(sf::Time deltaTime)
+{
+    const std::uint64_t allocationCount = this->beginStepPhase();
+
+    if (this->timestepBinCount > 1)
+        this->advanceBlockTimesteps(deltaTime, false);
+    else
+        this->integrate(deltaTime, 0, this->particles.size(), false);
+
+    this->simulationTime += deltaTime.asSeconds();
+
+    this->endStepPhase(allocationCount, this->statistics.updateAllocationCount);
 }
 
 void ParticleSystem::handleCollisions()
 {
+    sf::Clock clock;
+    const std::uint64_t allocationCount = this->beginStepPhase();
+
     // no collisions to check if empty
-    if (this->particles.empty()) return;
+    if (!this->particles.empty())
+    {
+        const std::size_t previousCount = this->particles.size();
 
-    // start broad phase
-    this->collisionBroadPhase();
+        // start broad phase
+        this->collisionBroadPhase();
+
+        // removed or merged particles change the forces, so cached accelerations can't open the next step
+        if (this->particles.size() != previousCount
+            || std::find(this->particles.active.begin(), this->particles.active.end(), 0) != this->particles.active.end())
+            this->accelerationsCurrent = false;
+
+        // every merge leaves one inactive particle behind until the next broad phase compacts the arrays
+        if (Profiler::isEnabled())
+            Profiler::addCount("merges", static_cast<double>(std::count(this->particles.active.begin(), this->particles.active.end(), 0)));
+    }
+
+    this->statistics.collisionTime = clock.getElapsedTime();
+    this->endStepPhase(allocationCount, this->statistics.collisionAllocationCount);
 }
 
 void ParticleSystem::update(sf::Time deltaTime, std::size_t nrThreads)
 {
-    std::vector<std::thread> threads;
-    std::vector<std::mutex> mutexes(this->particles.size());
+    const std::uint64_t allocationCount = this->beginStepPhase();
+    this->threadPool.setThreadCount(nrThreads);
 
-    const float magnitudeThreshold = 0.01f;
-    const float G = 1.f;
-    auto updateParticles = [&](std::size_t start, std::size_t end) {
-        for (std::size_t i = start; i < end; ++i)
-        {
-            sf::Vector2f pos1 = this->particles[i].getPosition();
-            float mass1 = this->particles[i].getMass();
-            sf::Vector2f acceleration{ 0.f, 0.f };
-            for (std::size_t j = i + 1; j < this->particles.size(); ++j)
-            {
-                sf::Vector2f pos2 = this->particles[j].getPosition();
-                float mass2 = this->particles[j].getMass();
+    if (this->timestepBinCount > 1)
+        this->advanceBlockTimesteps(deltaTime, true);
+    else
+        this->integrate(deltaTime, 0, this->particles.size(), true);
 
-                sf::Vector2f diff = pos2 - pos1;
-                float magnitude_squared = diff.x * diff.x + diff.y * diff.y;
-                float magnitude = std::sqrtf(magnitude_squared);
-                sf::Vector2f tmp = G * diff / (std::max(magnitude_squared, magnitudeThreshold) * magnitude);
+    this->simulationTime += deltaTime.asSeconds();
 
-                this->particles[i].setAcceleration(this->particles[i].getAcceleration() + mass2 * tmp);
-                {
-                    std::unique_lock<std::mutex> lock(mutexes[j]);
-                    this->particles[j].setAcceleration(this->particles[j].getAcceleration() - mass1 * tmp);
-                }
-            }
-        }
-    };
+    this->endStepPhase(allocationCount, this->statistics.updateAllocationCount);
+}
+
+void ParticleSystem::updateRange(sf::Time deltaTime, std::size_t begin, std::size_t end)
+{
+    const std::uint64_t allocationCount = this->beginStepPhase();
+    end = std::min(end, this->particles.size());
+    begin = std::min(begin, end);
+
+    this->integrate(deltaTime, begin, end, true);
+
+    this->simulationTime += deltaTime.asSeconds();
 
-    std::size_t batchSize = this->particles.size() / nrThreads;
-    for (std::size_t i = 0; i < nrThreads; ++i)
+    this->endStepPhase(allocationCount, this->statistics.updateAllocationCount);
+}
+
+bool ParticleSystem::saveCheckpoint(const std::string& path, std::string& error) const
+{
+    Checkpoint::Header header;
+    header.simulationTime = this->simulationTime;
+    header.randomState = this->randomState;
+    header.forceEngine = static_cast<std::uint32_t>(this->forceEngine);
+    header.integrator = static_cast<std::uint32_t>(this->integrator);
+    header.collisionBroadPhase = static_cast<std::uint32_t>(this->broadPhase);
+    header.instructionSet = static_cast<std::uint32_t>(this->instructionSet);
+    header.openingAngle = this->openingAngle;
+    header.expansionOrder = static_cast<std::uint32_t>(this->expansionOrder);
+    header.timestepBinCount = static_cast<std::uint32_t>(this->timestepBinCount);
+    header.timestepAccuracy = this->timestepAccuracy;
+    header.forceErrorSampleCount = this->forceErrorSampleCount;
+    header.accelerationsCurrent = this->accelerationsCurrent;
+    header.accelerationsBegin = this->accelerationsBegin;
+    header.accelerationsEnd = this->accelerationsEnd;
+    header.meshSize = static_cast<std::uint32_t>(this->particleMesh.getSize());
+    header.meshAssignment = static_cast<std::uint32_t>(this->particleMesh.getAssignment());
+    header.meshSoftening = this->particleMesh.getSoftening();
+    header.precision = static_cast<std::uint32_t>(this->interaction.precision);
+    header.softening = static_cast<std::uint32_t>(this->interaction.softening);
+    header.softeningLength = this->interaction.softeningLength;
+    header.gravitationalConstant = this->interaction.G;
+
+    return Checkpoint::write(path, header, this->particles, error);
+}
+
+bool ParticleSystem::loadCheckpoint(const std::string& path, std::string& error)
+{
+    // read into scratch storage so a bad file leaves the running simulation alone
+    Checkpoint::Header header;
+    ParticleStore loaded;
+    if (!Checkpoint::read(path, header, loaded, error)) return false;
+
+    if (header.forceEngine > static_cast<std::uint32_t>(ForceEngine::ParticleMesh)
+        || header.integrator > static_cast<std::uint32_t>(Integrator::Yoshida)
+        || header.collisionBroadPhase > static_cast<std::uint32_t>(CollisionBroadPhase::UniformGrid)
+        || header.instructionSet > static_cast<std::uint32_t>(ForceKernels::InstructionSet::AVX512)
+        || header.meshAssignment > static_cast<std::uint32_t>(ParticleMesh::Assignment::TriangularShapedCloud)
+        || header.precision > static_cast<std::uint32_t>(ForceKernels::Precision::Double)
+        || header.softening > static_cast<std::uint32_t>(ForceKernels::Softening::Spline)
+        || header.accelerationsBegin > header.accelerationsEnd || header.accelerationsEnd > loaded.size())
     {
-        std::size_t start = i * batchSize;
-        std::size_t end = std::min((i + 1) * batchSize, this->particles.size());
-        threads.push_back(std::thread{ updateParticles, start, end });
+        error = "invalid parameters in checkpoint " + path;
+        return false;
     }
 
-    for (std::size_t i = 0; i < nrThreads; ++i)
-        threads[i].join();
+    this->particles = std::move(loaded);
+    this->simulationTime = header.simulationTime;
+    this->randomState = header.randomState;
+
+    this->setForceEngine(static_cast<ForceEngine>(header.forceEngine));
+    this->setIntegrator(static_cast<Integrator>(header.integrator));
+    this->setCollisionBroadPhase(static_cast<CollisionBroadPhase>(header.collisionBroadPhase));
+    // the saving machine may have had wider vectors
+    this->setInstructionSet(static_cast<ForceKernels::InstructionSet>(header.instructionSet));
+    this->setOpeningAngle(header.openingAngle);
+    this->setExpansionOrder(header.expansionOrder);
+    this->setTimestepBinCount(header.timestepBinCount);
+    this->setTimestepAccuracy(header.timestepAccuracy);
+    this->setForceErrorSampleCount(static_cast<std::size_t>(header.forceErrorSampleCount));
+    // checkpoints written before the mesh parameters existed leave them 0
+    if (header.meshSize != 0)
+    {
+        this->setMeshSize(header.meshSize);
+        this->setMeshAssignment(static_cast<ParticleMesh::Assignment>(header.meshAssignment));
+        this->setMeshSoftening(header.meshSoftening);
+    }
+    // same for the interaction, whose G is never 0 otherwise
+    if (header.gravitationalConstant != 0.f)
+    {
+        this->setPrecision(static_cast<ForceKernels::Precision>(header.precision));
+        this->setSoftening(static_cast<ForceKernels::Softening>(header.softening));
+        this->setSofteningLength(header.softeningLength);
+        this->setGravitationalConstant(header.gravitationalConstant);
+    }
+
+    // the saved accelerations are exactly the ones the next kick-drift-kick step would open with
+    this->accelerationsCurrent = header.accelerationsCurrent;
+    this->accelerationsBegin = static_cast<std::size_t>(header.accelerationsBegin);
+    this->accelerationsEnd = static_cast<std::size_t>(header.accelerationsEnd);
+
+    // the sweep and prune order refers to the old particles
+    this->endpoints.clear();
+    this->statistics = StepStatistics{};
 
-    for (auto& particle : this->particles)
-        particle.move(deltaTime);
+    return true;
 }
\ No newline at end of file
@@ -2,44 +2,369 @@
 #include <SFML/Graphics.hpp>
 #include <random>
 #include<vector>
-#include <unordered_map>
 #include <functional>
-#include <thread>
-#include <mutex>
+#include <memory_resource>
+#include <limits>
+#include <atomic>
+#include <string>
+#include <numeric>
 
-#include "Particle.h"
+#include "FastMultipole.h"
+#include "CounterRandom.h"
+#include "ForceKernels.h"
+#include "FrameArena.h"
+#include "ParticleMesh.h"
+#include "ParticleSnapshot.h"
+#include "ParticleStore.h"
+#include "QuadTree.h"
+#include "ThreadPool.h"
+#include "UniformGrid.h"
 
 class ParticleSystem : public sf::Drawable, public sf::Transformable
 {
+public:
+
+    // algorithm used to compute the gravitational accelerations
+    enum class ForceEngine
+    {
+        DirectSum,      // exact O(n^2) pair summation
+        BarnesHut,      // O(n log n) quadtree approximation controlled by the opening angle
+        FastMultipole,  // O(n) multipole expansions of a configurable order, cells separated by the opening angle
+        ParticleMesh    // O(n + m^2 log m) FFT potential on an m x m mesh, only resolves separations above a few cells
+    };
+
+    // time integration scheme of update / updateRange
+    enum class Integrator
+    {
+        SemiImplicitEuler,  // kick, then drift with the new velocity; first order, one force evaluation per step
+        Leapfrog,           // kick-drift-kick, second order and symplectic, one force evaluation per step
+        Yoshida             // 4th order composition of three leapfrog steps, three force evaluations per step
+    };
+
+    // algorithm used to find the candidate pairs of the collision phase
+    enum class CollisionBroadPhase
+    {
+        SweepAndPrune,  // sort on the OX axis and sweep overlapping intervals into active groups
+        UniformGrid     // spatial hash with cells sized by the largest radius, pairs only from neighbouring cells
+    };
+
+    // initial conditions of distributeParticles, see InitialConditions
+    enum class Distribution
+    {
+        Disc,               // the original disc with tangential unit velocities
+        UniformDisc,        // uniform angle and radius, tangential unit velocities
+        Plummer,            // 3d Plummer sphere and its distribution function velocities projected on the plane (not a 2d equilibrium)
+        ExponentialDisc,    // exponential surface density on circular orbits
+        GalaxyCollision     // two exponential discs on a collision course
+    };
+
+    // energies of the active particles, the potential uses the softened pair potential matching the forces
+    struct Energy
+    {
+        double kinetic = 0.0;
+        double potential = 0.0;
+    };
+
+    // timings and counters of the last handleCollisions / update calls
+    struct StepStatistics
+    {
+        sf::Time collisionTime;
+        sf::Time forceTime;
+        sf::Time integrationTime;
+
+        // pair (or body-node, particle-cell) interactions evaluated by the force engine
+        std::size_t interactionCount = 0;
+
+        // relative rms error of the approximate engines against direct summation on a sample of particles
+        // (only measured when the sample count is not 0 and the engine is not the direct summation)
+        float forceError = 0.f;
+        std::size_t forceErrorSampleCount = 0;
+
+        // block timesteps: particles per bin when the update started, substeps actually taken,
+        // accelerations computed and the accelerations a shared step as fine as the finest bin used would have needed
+        std::vector<std::size_t> timestepBinCounts;
+        std::size_t substepCount = 0;
+        std::size_t forceEvaluationCount = 0;
+        std::size_t sharedStepEvaluationCount = 0;
+
+        // heap allocations during the last handleCollisions / update; the counter is process wide, so allocations of
+        // other threads in the meantime count too. 0 once the frame arena and the reused buffers stopped growing
+        std::uint64_t collisionAllocationCount = 0;
+        std::uint64_t updateAllocationCount = 0;
+        // most step scratch ever drawn from the frame arena between two resets, and the bytes its blocks hold
+        std::size_t frameArenaPeakUsage = 0;
+        std::size_t frameArenaCapacity = 0;
+    };
+
 private:
 
-    std::vector<Particle> particles;
+    ParticleStore particles;
     std::size_t particlesVertexCount;
+    ParticleSnapshot::DrawMode drawMode;
+
+    // active particles of the last draw
+    mutable ParticleSnapshot drawSnapshot;
+
+    ForceEngine forceEngine;
+    float openingAngle;
+    std::size_t expansionOrder;
+    std::size_t forceErrorSampleCount;
+
+    Integrator integrator;
+    // the accelerations in the store are a(x) of the current positions for [accelerationsBegin, accelerationsEnd)
+    // (left there by the closing kick of the kick-drift-kick schemes, so the next step can open with them)
+    bool accelerationsCurrent;
+    std::size_t accelerationsBegin;
+    std::size_t accelerationsEnd;
+    // called between the drift and the force evaluation of every multi-stage step (e.g. to exchange MPI slices)
+    std::function<void()> synchronizationCallback;
+
+    // block timesteps: a particle in bin k advances with deltaTime / 2^k, 1 bin is the shared step
+    std::size_t timestepBinCount;
+    float timestepAccuracy;
+    std::vector<std::uint8_t> timestepBins;
+    std::vector<std::uint8_t> dueParticles;
+    std::vector<std::size_t> binOccupancy;
+
+    // vector instruction set used by the direct summation, scalar keeps the original pair loop
+    ForceKernels::InstructionSet instructionSet;
+    // precision, softening and G of the pair interactions, and the direct summation kernel specialized for them
+    ForceKernels::Interaction interaction;
+    ForceKernels::Kernel kernel;
+
+    CollisionBroadPhase broadPhase;
+
+    StepStatistics statistics;
+
+    QuadTree quadTree;
+    FastMultipole fastMultipole;
+    ParticleMesh particleMesh;
+
+    // left end of a particle's projection on the OX axis
+    struct Endpoint
+    {
+        float minX;
+        std::size_t index;
+    };
+
+    // persistent sweep and prune order, re-sorted incrementally every frame
+    std::vector<Endpoint> endpoints;
+
+    // union-find scratch of one narrow phase task, reused by every group it resolves
+    struct NarrowPhaseScratch
+    {
+        std::pmr::vector<std::size_t> parent;
+        std::pmr::vector<float> mass;
+        std::pmr::vector<std::uint8_t> isRepresentative;
+
+        explicit NarrowPhaseScratch(std::pmr::memory_resource* resource)
+            : parent{ resource }, mass{ resource }, isRepresentative{ resource } {}
+    };
+
+    UniformGrid uniformGrid;
+
+    // persistent workers shared by every parallel phase
+    ThreadPool threadPool;
+
+    // scratch of the current step (active groups, candidate pairs, union-find, chunk bounds), released at once when
+    // handleCollisions or update start the next one; the buffers that outlive a step stay members
+    FrameArena frameArena;
+
+    // per-chunk private acceleration buffers of the parallel direct summation, reused between frames
+    std::vector<std::vector<float>> chunkAccelerationsX;
+    std::vector<std::vector<float>> chunkAccelerationsY;
 
     virtual void draw(sf::RenderTarget& target, sf::RenderStates states) const;
 
-    // get rand float between 0 and 1
-    static float randFloat();
+    // simulated time advanced by update / updateRange, restored with a checkpoint
+    double simulationTime;
+
+    // splitmix64 state of randFloat, kept as a plain integer so checkpoints can capture it
+    std::uint64_t randomState;
+
+    // next splitmix64 value of randomState
+    std::uint64_t randomNumber();
+    // get rand float in [0, 1)
+    float randFloat();
+
+    // every handleCollisions and update starts by releasing the frame arena, and ends by recording the heap
+    // allocations made since into the given statistic
+    std::uint64_t beginStepPhase();
+    void endStepPhase(const std::uint64_t allocationCount, std::uint64_t& phaseAllocationCount);
 
     void collisionBroadPhase();
-    void collisionNarrowPhase(std::vector<std::pair<Particle*, std::size_t>>& activeGroup);
+    void sweepAndPruneBroadPhase();
+    // O(n) compaction of the particles and of the sweep and prune endpoints
+    void removeInactiveParticles();
+    void sortEndpoints();
+    void uniformGridBroadPhase();
+    // resolves every collected active group on the thread pool
+    // members of group g are groupMembers[groupOffsets[g], groupOffsets[g + 1])
+    void resolveActiveGroups(const std::pmr::vector<std::size_t>& groupMembers, const std::pmr::vector<std::size_t>& groupOffsets);
+    void collisionNarrowPhase(const std::size_t* activeGroup, const std::size_t groupSize, NarrowPhaseScratch& scratch);
+    // merges every intersecting candidate pair, the pair lists may come from different workers
+    void collisionNarrowPhase(const std::pmr::vector<std::pmr::vector<std::pair<std::size_t, std::size_t>>>& candidatePairs);
+
+    bool intersects(const std::size_t i, const std::size_t j) const;
+    // true if i stays the representative when its set merges with the set of j: the heavier one, on equal masses the
+    // smaller index; a strict order, so a set ends up represented by its heaviest member whatever order the pairs
+    // are merged in (worker order of the grid lists, thread count)
+    bool outranks(const std::size_t i, const std::size_t j) const;
+
+    // add the accelerations of the selected force engine to the particles in [begin, end), on the thread pool if parallel
+    // if due is given, only the particles with due[i] set get accelerations (every particle still acts as a source)
+    void computeForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due = nullptr);
+    void computeDirectForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due);
+    // rebuild the quadtree over every particle and add the Barnes-Hut accelerations to the ones in [begin, end)
+    void computeBarnesHutForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due);
+    // same for the fast multipole method: upward pass, tree walk and downward pass are all split into subtree tasks
+    void computeFastMultipoleForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due);
+    // deposit every particle on the mesh, solve for the potential and interpolate the accelerations of [begin, end)
+    void computeParticleMeshForces(std::size_t begin, std::size_t end, bool parallel, const std::uint8_t* due);
+
+    // picks the kernel instantiation for the current instruction set and interaction, called by every setter of them
+    void selectForceKernel();
+
+    // compares the accelerations just computed for a sample of [begin, end) with a direct summation
+    void measureForceError(std::size_t begin, std::size_t end);
+
+    // first row of the direct summation triangle at which pairCount pairs have been evaluated
+    static std::size_t rowForPairCount(const std::size_t n, const std::size_t pairCount);
+
+    // semi-implicit euler step of the active particles in [begin, end), resets their accelerations
+    void moveParticles(sf::Time deltaTime, std::size_t begin, std::size_t end, bool parallel);
+    void recordSharedTimestep(std::size_t particleCount);
+
+    // one shared step of the selected integrator for the particles in [begin, end)
+    void integrate(sf::Time deltaTime, std::size_t begin, std::size_t end, bool parallel);
+    // v += a * dt and x += v * dt for the active particles in [begin, end)
+    void kickParticles(float deltaTime, std::size_t begin, std::size_t end, bool parallel);
+    void driftParticles(float deltaTime, std::size_t begin, std::size_t end, bool parallel);
+    void clearAccelerations(std::size_t begin, std::size_t end);
+
+    // one update of deltaTime split into power of two substeps: only the particles whose block starts at a substep
+    // get forces and a kick of their own step, every active particle drifts between substeps
+    // the symplectic integrators use kick-drift-kick blocks (yoshida falls back to plain leapfrog blocks)
+    void advanceBlockTimesteps(sf::Time deltaTime, bool parallel);
+    // finest bin needed by particle i with its current acceleration and velocity
+    std::size_t getTimestepBin(const std::size_t i, const float deltaTime) const;
 
 public:
 
     ParticleSystem();
 
     std::size_t getParticleCount() const;
+    ParticleSnapshot::DrawMode getDrawMode() const;
+    const ParticleStore& getParticles() const;
+    // mutable access for drivers that exchange particle state from outside (e.g. between MPI ranks)
+    ParticleStore& getParticles();
+    const StepStatistics& getStatistics() const;
+    double getSimulationTime() const;
+
+    // command line / report names of the force engines
+    static const char* getForceEngineName(const ForceEngine engine);
+    static bool parseForceEngine(const std::string& name, ForceEngine& engine);
+    static const char* getCollisionBroadPhaseName(const CollisionBroadPhase broadPhase);
+    static bool parseCollisionBroadPhase(const std::string& name, CollisionBroadPhase& broadPhase);
+    static const char* getIntegratorName(const Integrator integrator);
+    static bool parseIntegrator(const std::string& name, Integrator& integrator);
+    static const char* getDistributionName(const Distribution distribution);
+    static bool parseDistribution(const std::string& name, Distribution& distribution);
+
+    // writes the bodies of distribution into particles [begin, end), the generator behind distributeParticles
+    // (scale as there, for end - begin bodies), also used for the members of an Ensemble
+    static void generateParticles(ParticleStore& particles, const std::size_t begin, const std::size_t end,
+        const Distribution distribution, float scale, const CounterRandom& random, ThreadPool& threadPool);
+
+    ForceEngine getForceEngine() const;
+    float getOpeningAngle() const;
+    std::size_t getExpansionOrder() const;
+    std::size_t getMeshSize() const;
+    ParticleMesh::Assignment getMeshAssignment() const;
+    float getMeshSoftening() const;
+    std::size_t getForceErrorSampleCount() const;
+    std::size_t getTimestepBinCount() const;
+    float getTimestepAccuracy() const;
+    std::size_t getThreadCount() const;
+    // instruction set the direct summation rows actually use (scalar in double precision)
+    ForceKernels::InstructionSet getInstructionSet() const;
+    ForceKernels::Precision getPrecision() const;
+    ForceKernels::Softening getSoftening() const;
+    float getSofteningLength() const;
+    float getGravitationalConstant() const;
+    CollisionBroadPhase getCollisionBroadPhase() const;
+    Integrator getIntegrator() const;
 
     void setParticlesVertexCount(const std::size_t newCount);
+    // circles, or the mass per pixel binned on a render thread pool once there are more particles than pixels matter
+    void setDrawMode(const ParticleSnapshot::DrawMode newDrawMode);
+    void setForceEngine(const ForceEngine newEngine);
+    // smaller angle => more accurate and slower Barnes-Hut, 0 degenerates into direct summation
+    void setOpeningAngle(const float newAngle);
+    // order p of the multipole expansions, clamped to [1, FastMultipole::maxOrder]; the error falls roughly like theta^(p + 1)
+    void setExpansionOrder(const std::size_t newOrder);
+    // cells per side of the particle-mesh grid, rounded up to a power of two in [16, 4096]; the mesh spans the active
+    // particles, so a few distant ones coarsen the cells of everything else
+    void setMeshSize(const std::size_t newSize);
+    void setMeshAssignment(const ParticleMesh::Assignment newAssignment);
+    // plummer softening of the mesh kernel in cells (at least 0.1)
+    void setMeshSoftening(const float newSoftening);
+    // particles checked against direct summation after every force computation, 0 disables the check
+    void setForceErrorSampleCount(const std::size_t newCount);
+    // number of power of two timestep bins (1 = every particle takes deltaTime, at most 16)
+    // particle i needs a step of at most accuracy * min(sqrt(radius / |a|), radius / |v|)
+    void setTimestepBinCount(const std::size_t newCount);
+    void setTimestepAccuracy(const float newAccuracy);
+    // number of workers used by the parallel phases (the calling thread counts as one)
+    void setThreadCount(const std::size_t newCount);
+    // defaults to the best supported instruction set; unsupported ones fall back to scalar
+    void setInstructionSet(const ForceKernels::InstructionSet newInstructionSet);
+    // double precision widens the direct summation (and only it) for accuracy runs
+    void setPrecision(const ForceKernels::Precision newPrecision);
+    // the softening model applies to the direct summation, the mesh error check and the energy; the tree engines always
+    // clamp (and their error check with them) and the mesh has its own softening, but all of them use the softening length and G
+    void setSoftening(const ForceKernels::Softening newSoftening);
+    void setSofteningLength(const float newLength);
+    // the initial conditions assume G = 1
+    void setGravitationalConstant(const float newG);
+    void setCollisionBroadPhase(const CollisionBroadPhase newBroadPhase);
+    void setIntegrator(const Integrator newIntegrator);
+    // the callback must leave the positions of every particle current, an empty function removes it
+    void setSynchronizationCallback(std::function<void()> callback);
+    // seeds the generator used by distributeParticles and addParticle
+    void setRandomSeed(const std::uint64_t seed);
+
+    // writes the particles, simulated time, generator state and engine parameters to a versioned binary file
+    // the file is replaced atomically, so an interrupted save leaves the previous checkpoint intact
+    bool saveCheckpoint(const std::string& path, std::string& error) const;
+    // replaces the particles and parameters with the ones saved in path; on failure nothing is changed
+    // the thread count and the synchronization callback belong to the process and are kept
+    bool loadCheckpoint(const std::string& path, std::string& error);
+
+    // O(n^2) on the thread pool, meant for diagnostics such as the energy drift of an integrator
+    Energy computeEnergy();
 
+    // appends particleCount bodies generated in parallel on the thread pool
+    // the bodies only depend on the random seed (one value of it is used per call), not on the thread count
+    // scale is the size of the system: disc radius, 5 Plummer / exponential scale lengths or the galaxy separation;
+    // 0 picks sqrt(particleCount) * 10 like the original disc
+    void distributeParticles(const Distribution distribution, const std::size_t particleCount, float scale = 0.f);
     void distributeParticles(const std::size_t particleCount);
     void distributeParticles(const std::size_t particleCount, const float maxRadius);
 
     void addParticle(sf::Vector2f position, float mass, sf::Vector2f acceleration = { 0.f, 0.f });
     void addParticle(sf::Vector2f position, sf::Vector2f velocity, float mass, sf::Vector2f acceleration = { 0.f, 0.f });
 
+    // copies the active particles into snapshot (reusing its buffers), so they can be drawn while the system steps on
+    void captureSnapshot(ParticleSnapshot& snapshot) const;
+
     void update(sf::Time deltaTime);
     void handleCollisions();
 
     void update(sf::Time deltaTime, std::size_t nrThreads);
+
+    // forces from every particle on the particles in [begin, end), then integration of only those particles
+    // runs on the thread pool; the other particles are left untouched
+    // always takes the shared step: block timesteps would need every rank's positions at every substep
+    void updateRange(sf::Time deltaTime, std::size_t begin, std::size_t end);
 };
\ No newline at end of file
@@ -0,0 +1,343 @@
+#include "Profiler.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <iomanip>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    struct ScopeTotal
+    {
+        std::int64_t time = 0;
+        std::int64_t maxTime = 0;
+        std::size_t calls = 0;
+    };
+
+    struct Frame
+    {
+        std::int64_t start = 0;
+        std::int64_t duration = 0;
+        std::map<std::string, ScopeTotal> scopes;
+        std::map<std::string, double> counters;
+        std::map<std::string, std::vector<std::size_t>> histograms;
+        std::vector<std::int64_t> busyTimes;
+    };
+
+    struct TraceEvent
+    {
+        std::string name;
+        char phase;
+        int thread;
+        std::int64_t timestamp;
+        std::int64_t duration;
+        // json object for counters and metadata
+        std::string arguments;
+    };
+
+    struct State
+    {
+        std::atomic<bool> enabled{ false };
+        std::atomic<bool> tracing{ false };
+        const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+        std::mutex mutex;
+        Frame current;
+        std::deque<Frame> window;
+        std::size_t windowSize = 60;
+
+        std::map<std::thread::id, int> threads;
+        std::vector<TraceEvent> events;
+    };
+
+    State& getState()
+    {
+        static State state;
+        return state;
+    }
+
+    std::int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - getState().epoch).count();
+    }
+
+    // small stable thread numbers for the trace, the first thread seen is 0 (expected to be the main thread)
+    int getThreadNumber(State& state)
+    {
+        const auto inserted = state.threads.insert({ std::this_thread::get_id(), static_cast<int>(state.threads.size()) });
+        return inserted.first->second;
+    }
+
+    std::string getBucketName(const std::size_t bucket)
+    {
+        const std::size_t low = std::size_t{ 1 } << bucket;
+        return bucket == 0 ? "1" : std::to_string(low) + "-" + std::to_string(2 * low - 1);
+    }
+
+    // closes the current frame, state.mutex held
+    void closeFrame(State& state, const std::int64_t end)
+    {
+        Frame& frame = state.current;
+        frame.duration = end - frame.start;
+
+        if (state.tracing.load(std::memory_order_relaxed))
+        {
+            const int thread = getThreadNumber(state);
+            for (const auto& counter : frame.counters)
+            {
+                std::ostringstream arguments;
+                arguments << "{\"value\": " << counter.second << "}";
+                state.events.push_back({ counter.first, 'C', thread, end, 0, arguments.str() });
+            }
+            for (const auto& histogram : frame.histograms)
+            {
+                std::ostringstream arguments;
+                arguments << "{";
+                for (std::size_t b = 0; b < histogram.second.size(); ++b)
+                    arguments << (b == 0 ? "" : ", ") << "\"" << getBucketName(b) << "\": " << histogram.second[b];
+                arguments << "}";
+                state.events.push_back({ histogram.first, 'C', thread, end, 0, arguments.str() });
+            }
+            if (!frame.busyTimes.empty())
+            {
+                std::ostringstream arguments;
+                arguments << "{";
+                for (std::size_t w = 0; w < frame.busyTimes.size(); ++w)
+                    arguments << (w == 0 ? "" : ", ") << "\"worker " << w << "\": " << frame.busyTimes[w] / 1000.0;
+                arguments << "}";
+                state.events.push_back({ "busy_ms", 'C', thread, end, 0, arguments.str() });
+            }
+        }
+
+        state.window.push_back(std::move(frame));
+        while (state.window.size() > state.windowSize) state.window.pop_front();
+        state.current = Frame{};
+        state.current.start = end;
+    }
+}
+
+Profiler::Scope::Scope(const char* name)
+    : name{ name }, start{ getState().enabled.load(std::memory_order_relaxed) ? now() : -1 } {}
+
+Profiler::Scope::~Scope()
+{
+    if (this->start < 0) return;
+
+    const std::int64_t end = now();
+    State& state = getState();
+    std::unique_lock<std::mutex> lock(state.mutex);
+
+    ScopeTotal& total = state.current.scopes[this->name];
+    total.time += end - this->start;
+    total.maxTime = std::max(total.maxTime, end - this->start);
+    ++total.calls;
+
+    if (state.tracing.load(std::memory_order_relaxed))
+        state.events.push_back({ this->name, 'X', getThreadNumber(state), this->start, end - this->start, "" });
+}
+
+void Profiler::setEnabled(const bool enabled)
+{
+    State& state = getState();
+    std::unique_lock<std::mutex> lock(state.mutex);
+    if (enabled && !state.enabled.load()) state.current.start = now();
+    state.enabled.store(enabled);
+}
+
+bool Profiler::isEnabled()
+{
+    return getState().enabled.load(std::memory_order_relaxed);
+}
+
+void Profiler::setTracing(const bool tracing)
+{
+    getState().tracing.store(tracing);
+}
+
+bool Profiler::isTracing()
+{
+    return getState().tracing.load(std::memory_order_relaxed);
+}
+
+void Profiler::setSummaryWindow(const std::size_t frameCount)
+{
+    State& state = getState();
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.windowSize = std::max<std::size_t>(frameCount, 1);
+    while (state.window.size() > state.windowSize) state.window.pop_front();
+}
+
+void Profiler::addCount(const char* name, const double value)
+{
+    State& state = getState();
+    if (!state.enabled.load(std::memory_order_relaxed)) return;
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.current.counters[name] += value;
+}
+
+void Profiler::addHistogramSample(const char* name, const std::size_t value)
+{
+    State& state = getState();
+    if (!state.enabled.load(std::memory_order_relaxed) || value == 0) return;
+
+    std::size_t bucket = 0;
+    while ((value >> (bucket + 1)) != 0) ++bucket;
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    std::vector<std::size_t>& buckets = state.current.histograms[name];
+    if (buckets.size() <= bucket) buckets.resize(bucket + 1, 0);
+    ++buckets[bucket];
+}
+
+void Profiler::addBusyTime(const std::size_t workerIndex, const std::int64_t microseconds)
+{
+    State& state = getState();
+    if (!state.enabled.load(std::memory_order_relaxed)) return;
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    std::vector<std::int64_t>& busyTimes = state.current.busyTimes;
+    if (busyTimes.size() <= workerIndex) busyTimes.resize(workerIndex + 1, 0);
+    busyTimes[workerIndex] += microseconds;
+}
+
+void Profiler::endFrame()
+{
+    State& state = getState();
+    if (!state.enabled.load(std::memory_order_relaxed)) return;
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    closeFrame(state, now());
+}
+
+std::string Profiler::getSummary()
+{
+    State& state = getState();
+    std::unique_lock<std::mutex> lock(state.mutex);
+
+    std::ostringstream summary;
+    summary << std::fixed << std::setprecision(3);
+    const std::size_t frameCount = state.window.size();
+    if (frameCount == 0) return "no profiled frames\n";
+
+    // merge the window
+    std::int64_t duration = 0;
+    std::map<std::string, ScopeTotal> scopes;
+    std::map<std::string, double> counters;
+    std::map<std::string, std::vector<std::size_t>> histograms;
+    std::vector<std::int64_t> busyTimes;
+    for (const Frame& frame : state.window)
+    {
+        duration += frame.duration;
+        for (const auto& scope : frame.scopes)
+        {
+            ScopeTotal& total = scopes[scope.first];
+            total.time += scope.second.time;
+            total.maxTime = std::max(total.maxTime, scope.second.time);
+            total.calls += scope.second.calls;
+        }
+        for (const auto& counter : frame.counters)
+            counters[counter.first] += counter.second;
+        for (const auto& histogram : frame.histograms)
+        {
+            std::vector<std::size_t>& buckets = histograms[histogram.first];
+            buckets.resize(std::max(buckets.size(), histogram.second.size()), 0);
+            for (std::size_t b = 0; b < histogram.second.size(); ++b) buckets[b] += histogram.second[b];
+        }
+        busyTimes.resize(std::max(busyTimes.size(), frame.busyTimes.size()), 0);
+        for (std::size_t w = 0; w < frame.busyTimes.size(); ++w) busyTimes[w] += frame.busyTimes[w];
+    }
+
+    const double frameTime = duration / 1000.0 / frameCount;
+    summary << "last " << frameCount << " frames, " << frameTime << " ms per frame\n";
+    for (const auto& scope : scopes)
+    {
+        summary << scope.first << ": " << scope.second.time / 1000.0 / frameCount << " ms mean, "
+            << scope.second.maxTime / 1000.0 << " ms max";
+        if (scope.second.calls != frameCount)
+            summary << ", " << std::setprecision(1) << static_cast<double>(scope.second.calls) / frameCount << std::setprecision(3) << " calls";
+        summary << "\n";
+    }
+
+    summary << std::setprecision(1);
+    for (const auto& counter : counters)
+        summary << counter.first << ": " << counter.second / frameCount << " per frame\n";
+    for (const auto& histogram : histograms)
+    {
+        summary << histogram.first << ":";
+        for (std::size_t b = 0; b < histogram.second.size(); ++b)
+            if (histogram.second[b] > 0) summary << " [" << getBucketName(b) << "] " << histogram.second[b];
+        summary << "\n";
+    }
+    if (!busyTimes.empty())
+    {
+        summary << "worker busy:";
+        for (std::size_t w = 0; w < busyTimes.size(); ++w)
+            summary << " " << (duration > 0 ? 100.0 * busyTimes[w] / duration : 0.0) << "%";
+        summary << "\n";
+    }
+    return summary.str();
+}
+
+bool Profiler::writeTrace(const std::string& path, std::string& error)
+{
+    State& state = getState();
+    std::unique_lock<std::mutex> lock(state.mutex);
+
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file)
+    {
+        error = "cannot create " + path;
+        return false;
+    }
+
+    std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    const char* separator = "";
+    for (const auto& thread : state.threads)
+    {
+        std::fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}",
+            separator, thread.second, thread.second == 0 ? "main" : "thread", thread.second);
+        separator = ",\n";
+    }
+    for (const TraceEvent& event : state.events)
+    {
+        if (event.phase == 'X')
+        {
+            std::fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %lld, \"dur\": %lld}",
+                separator, event.name.c_str(), event.thread, static_cast<long long>(event.timestamp),
+                static_cast<long long>(event.duration));
+        }
+        else
+        {
+            std::fprintf(file, "%s{\"name\": \"%s\", \"ph\": \"%c\", \"pid\": 0, \"tid\": %d, \"ts\": %lld, \"args\": %s}",
+                separator, event.name.c_str(), event.phase, event.thread, static_cast<long long>(event.timestamp),
+                event.arguments.c_str());
+        }
+        separator = ",\n";
+    }
+    std::fprintf(file, "\n]}\n");
+
+    if (std::fclose(file) != 0)
+    {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+void Profiler::reset()
+{
+    State& state = getState();
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.current = Frame{};
+    state.current.start = now();
+    state.window.clear();
+    state.events.clear();
+}
\ No newline at end of file
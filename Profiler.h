@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// process wide instrumentation of the hot paths, off by default and a single atomic load per scope while off
+// scopes and counters are collected per frame (closed by endFrame); the last frames form a rolling summary and,
+// with tracing on, every scope and counter is kept as a chrome trace event (chrome://tracing, ui.perfetto.dev)
+namespace Profiler
+{
+    // times the enclosing block under name, which must be a string literal
+    // scopes may nest, the summary shows inclusive times
+    class Scope
+    {
+    private:
+
+        const char* name;
+        // microseconds since the profiler started, -1 while profiling is disabled
+        std::int64_t start;
+
+    public:
+
+        explicit Scope(const char* name);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    void setEnabled(bool enabled);
+    bool isEnabled();
+
+    // keep every event for writeTrace; memory grows with the run, so only meant for bounded captures
+    void setTracing(bool tracing);
+    bool isTracing();
+
+    // number of frames summarized by getSummary
+    void setSummaryWindow(std::size_t frameCount);
+
+    // adds value to the counter of the current frame
+    void addCount(const char* name, double value);
+    // counts value in the power of two bucket [2^k, 2^(k + 1)) of the histogram
+    void addHistogramSample(const char* name, std::size_t value);
+    // time worker workerIndex of a thread pool spent executing tasks
+    void addBusyTime(std::size_t workerIndex, std::int64_t microseconds);
+
+    // closes the current frame: moves it into the summary window and, when tracing, emits its counters
+    void endFrame();
+
+    // mean and max time per scope, mean counters, histograms and worker utilization over the window
+    std::string getSummary();
+
+    bool writeTrace(const std::string& path, std::string& error);
+
+    // drops the collected frames and trace events
+    void reset();
+}
\ No newline at end of file
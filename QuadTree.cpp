@@ -0,0 +1,173 @@
+#include "QuadTree.h"
+
+#include <algorithm>
+
+QuadTree::QuadTree(std::size_t leafCapacity, std::size_t maxDepth)
+    : nodes{}, bodyIndices{}, positionsX{ nullptr }, positionsY{ nullptr }, masses{ nullptr },
+    leafCapacity{ std::max<std::size_t>(leafCapacity, 1) }, maxDepth{ std::min<std::size_t>(maxDepth, 64) } {}
+
+void QuadTree::buildNode(std::size_t nodeIndex, std::size_t depth)
+{
+    const std::size_t begin = this->nodes[nodeIndex].bodyBegin;
+    const std::size_t end = this->nodes[nodeIndex].bodyEnd;
+
+    if (end - begin <= this->leafCapacity || depth >= this->maxDepth)
+    {
+        // leaf => accumulate mass and center of mass of its bodies
+        float mass = 0.f;
+        sf::Vector2f weighted{ 0.f, 0.f };
+        for (std::size_t k = begin; k < end; ++k)
+        {
+            const std::size_t body = this->bodyIndices[k];
+            mass += this->masses[body];
+            weighted += this->masses[body] * sf::Vector2f{ this->positionsX[body], this->positionsY[body] };
+        }
+
+        this->nodes[nodeIndex].mass = mass;
+        this->nodes[nodeIndex].centerOfMass = mass > 0.f ? weighted / mass : this->nodes[nodeIndex].center;
+        return;
+    }
+
+    const sf::Vector2f center = this->nodes[nodeIndex].center;
+    const float quarterSize = this->nodes[nodeIndex].halfSize / 2.f;
+
+    // split the bodies into quadrants: first on the OY axis, then each half on the OX axis
+    auto first = this->bodyIndices.begin() + begin;
+    auto last = this->bodyIndices.begin() + end;
+    auto middleY = std::partition(first, last, [&](std::size_t body) { return this->positionsY[body] < center.y; });
+    auto middleTop = std::partition(first, middleY, [&](std::size_t body) { return this->positionsX[body] < center.x; });
+    auto middleBottom = std::partition(middleY, last, [&](std::size_t body) { return this->positionsX[body] < center.x; });
+
+    const std::size_t bounds[5] = {
+        begin,
+        static_cast<std::size_t>(middleTop - this->bodyIndices.begin()),
+        static_cast<std::size_t>(middleY - this->bodyIndices.begin()),
+        static_cast<std::size_t>(middleBottom - this->bodyIndices.begin()),
+        end
+    };
+    const sf::Vector2f offsets[4] = { { -1.f, -1.f }, { 1.f, -1.f }, { -1.f, 1.f }, { 1.f, 1.f } };
+
+    // children are stored contiguously; don't hold references into nodes while it grows
+    const std::size_t firstChild = this->nodes.size();
+    this->nodes[nodeIndex].firstChild = firstChild;
+    this->nodes.resize(firstChild + 4);
+
+    float mass = 0.f;
+    sf::Vector2f weighted{ 0.f, 0.f };
+    for (std::size_t q = 0; q < 4; ++q)
+    {
+        Node& child = this->nodes[firstChild + q];
+        child.center = center + offsets[q] * quarterSize;
+        child.halfSize = quarterSize;
+        child.firstChild = 0;
+        child.bodyBegin = bounds[q];
+        child.bodyEnd = bounds[q + 1];
+
+        this->buildNode(firstChild + q, depth + 1);
+
+        mass += this->nodes[firstChild + q].mass;
+        weighted += this->nodes[firstChild + q].mass * this->nodes[firstChild + q].centerOfMass;
+    }
+
+    this->nodes[nodeIndex].mass = mass;
+    this->nodes[nodeIndex].centerOfMass = mass > 0.f ? weighted / mass : center;
+}
+
+std::size_t QuadTree::getNodeCount() const
+{
+    return this->nodes.size();
+}
+
+void QuadTree::build(const float* x, const float* y, const float* m, std::size_t count)
+{
+    this->positionsX = x;
+    this->positionsY = y;
+    this->masses = m;
+
+    this->nodes.clear();
+    this->bodyIndices.resize(count);
+    for (std::size_t i = 0; i < count; ++i) this->bodyIndices[i] = i;
+
+    if (count == 0) return;
+
+    // square bounds around every body
+    float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        minX = std::min(minX, x[i]);
+        maxX = std::max(maxX, x[i]);
+        minY = std::min(minY, y[i]);
+        maxY = std::max(maxY, y[i]);
+    }
+
+    Node root{};
+    root.center = { (minX + maxX) / 2.f, (minY + maxY) / 2.f };
+    // slightly enlarged so bodies on the edge still fall inside
+    root.halfSize = std::max(maxX - minX, maxY - minY) / 2.f * 1.001f + 1e-3f;
+    root.firstChild = 0;
+    root.bodyBegin = 0;
+    root.bodyEnd = count;
+    this->nodes.push_back(root);
+
+    this->buildNode(0, 0);
+}
+
+sf::Vector2f QuadTree::computeAcceleration(float x, float y, std::size_t self, float theta, float G, float magnitudeThreshold,
+    std::size_t* interactionCount) const
+{
+    sf::Vector2f acceleration{ 0.f, 0.f };
+    if (this->nodes.empty()) return acceleration;
+
+    const float thetaSquared = theta * theta;
+    std::size_t interactions = 0;
+
+    // every opened node replaces itself with 4 children => the stack never exceeds 3 * depth + 1
+    std::size_t stack[3 * 64 + 4];
+    std::size_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = this->nodes[stack[--stackSize]];
+        if (node.mass == 0.f) continue;
+
+        if (node.firstChild == 0)
+        {
+            // leaf => sum its bodies directly
+            interactions += node.bodyEnd - node.bodyBegin;
+            for (std::size_t k = node.bodyBegin; k < node.bodyEnd; ++k)
+            {
+                const std::size_t body = this->bodyIndices[k];
+                if (body == self) continue;
+
+                sf::Vector2f diff{ this->positionsX[body] - x, this->positionsY[body] - y };
+                float magnitude_squared = diff.x * diff.x + diff.y * diff.y;
+                float magnitude = std::sqrt(magnitude_squared);
+                acceleration += this->masses[body] * G * diff / (std::max(magnitude_squared, magnitudeThreshold) * magnitude);
+            }
+            continue;
+        }
+
+        sf::Vector2f diff = node.centerOfMass - sf::Vector2f{ x, y };
+        float magnitude_squared = diff.x * diff.x + diff.y * diff.y;
+        float size = 2.f * node.halfSize;
+
+        // a node holding the point itself is always opened
+        bool containsPoint = std::abs(x - node.center.x) <= node.halfSize && std::abs(y - node.center.y) <= node.halfSize;
+        if (!containsPoint && size * size < thetaSquared * magnitude_squared)
+        {
+            // far enough => treat the whole node as one body placed at its center of mass
+            ++interactions;
+            float magnitude = std::sqrt(magnitude_squared);
+            acceleration += node.mass * G * diff / (std::max(magnitude_squared, magnitudeThreshold) * magnitude);
+        }
+        else
+        {
+            for (std::size_t q = 0; q < 4; ++q)
+                stack[stackSize++] = node.firstChild + q;
+        }
+    }
+
+    if (interactionCount) *interactionCount += interactions;
+    return acceleration;
+}
\ No newline at end of file
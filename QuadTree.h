@@ -0,0 +1,55 @@
+#pragma once
+#include <SFML/Graphics.hpp>
+#include <vector>
+
+// Barnes-Hut quadtree, rebuilt from scratch every step
+// leaves hold a small bucket of bodies, inner nodes hold the total mass and center of mass of their subtree
+class QuadTree
+{
+private:
+
+    struct Node
+    {
+        // square bounds of the node
+        sf::Vector2f center;
+        float halfSize;
+
+        // mass and center of mass of every body inside the node
+        sf::Vector2f centerOfMass;
+        float mass;
+
+        // index of the first of the 4 children (0 for leaves, the root is never a child)
+        std::size_t firstChild;
+
+        // range of bodies inside the node (indices into bodyIndices)
+        std::size_t bodyBegin;
+        std::size_t bodyEnd;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<std::size_t> bodyIndices;
+
+    const float* positionsX;
+    const float* positionsY;
+    const float* masses;
+
+    std::size_t leafCapacity;
+    std::size_t maxDepth;
+
+    void buildNode(std::size_t nodeIndex, std::size_t depth);
+
+public:
+
+    QuadTree(std::size_t leafCapacity = 8, std::size_t maxDepth = 32);
+
+    std::size_t getNodeCount() const;
+
+    // builds the tree over the given bodies; the arrays must stay alive while the tree is used
+    void build(const float* x, const float* y, const float* m, std::size_t count);
+
+    // acceleration that every body except 'self' exerts on the point (x, y)
+    // theta is the opening angle, nodes with size / distance < theta are treated as a single body
+    // if interactionCount is given, the number of body-body and body-node interactions is added to it
+    sf::Vector2f computeAcceleration(float x, float y, std::size_t self, float theta, float G, float magnitudeThreshold,
+        std::size_t* interactionCount = nullptr) const;
+};
\ No newline at end of file
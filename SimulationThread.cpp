@@ -0,0 +1,111 @@
+#include "SimulationThread.h"
+
+SimulationThread::SimulationThread(ParticleSystem& particleSystem)
+    : particleSystem{ particleSystem }, threadCount{ 1 }, thread{}, stopping{ false }, frames{}, writeIndex{ 0 },
+    readIndex{ 1 }, ready{ 2 }, commands{}, runningCommands{}
+{
+
+}
+
+SimulationThread::~SimulationThread()
+{
+    this->stop();
+}
+
+void SimulationThread::captureFrame(const ParticleSystem& particleSystem, sf::Time collisionTime, sf::Time physicsTime, Frame& frame)
+{
+    particleSystem.captureSnapshot(frame.particles);
+    frame.statistics = particleSystem.getStatistics();
+    frame.collisionTime = collisionTime;
+    frame.physicsTime = physicsTime;
+
+    frame.forceEngine = particleSystem.getForceEngine();
+    frame.openingAngle = particleSystem.getOpeningAngle();
+    frame.expansionOrder = particleSystem.getExpansionOrder();
+    frame.meshSize = particleSystem.getMeshSize();
+    frame.meshAssignment = particleSystem.getMeshAssignment();
+    frame.integrator = particleSystem.getIntegrator();
+}
+
+void SimulationThread::start(const std::size_t newThreadCount)
+{
+    if (this->isRunning()) return;
+
+    this->threadCount = newThreadCount;
+    this->stopping.store(false, std::memory_order_relaxed);
+
+    // the render thread has something to draw before the first step completes
+    captureFrame(this->particleSystem, sf::Time::Zero, sf::Time::Zero, this->frames[this->writeIndex]);
+    this->publishFrame();
+
+    this->thread = std::thread{ &SimulationThread::run, this };
+}
+
+void SimulationThread::stop()
+{
+    if (!this->isRunning()) return;
+
+    this->stopping.store(true, std::memory_order_release);
+    this->thread.join();
+}
+
+bool SimulationThread::isRunning() const
+{
+    return this->thread.joinable();
+}
+
+void SimulationThread::post(Command command)
+{
+    std::unique_lock<std::mutex> lock(this->commandMutex);
+    this->commands.push_back(std::move(command));
+}
+
+const SimulationThread::Frame& SimulationThread::acquireFrame()
+{
+    // take the ready frame only if it is newer than the one being drawn, and leave the drawn one for reuse
+    if (this->ready.load(std::memory_order_acquire) & freshFlag)
+        this->readIndex = this->ready.exchange(this->readIndex, std::memory_order_acq_rel) & ~freshFlag;
+
+    return this->frames[this->readIndex];
+}
+
+void SimulationThread::publishFrame()
+{
+    // release makes the captured frame visible to the acquire of the render thread
+    this->writeIndex = this->ready.exchange(this->writeIndex | freshFlag, std::memory_order_acq_rel) & ~freshFlag;
+}
+
+void SimulationThread::applyCommands()
+{
+    {
+        std::unique_lock<std::mutex> lock(this->commandMutex);
+        if (this->commands.empty()) return;
+        this->runningCommands.swap(this->commands);
+    }
+
+    for (const Command& command : this->runningCommands)
+        command(this->particleSystem);
+    this->runningCommands.clear();
+}
+
+void SimulationThread::run()
+{
+    sf::Clock clock;
+    while (!this->stopping.load(std::memory_order_acquire))
+    {
+        this->applyCommands();
+
+        // same step as the serial loop, which advances by the time of the previous frame
+        const sf::Time elapsed = clock.restart();
+        this->particleSystem.handleCollisions();
+        const sf::Time collisionTime = clock.getElapsedTime();
+        this->particleSystem.update(elapsed, this->threadCount);
+        const sf::Time physicsTime = clock.getElapsedTime() - collisionTime;
+
+        captureFrame(this->particleSystem, collisionTime, physicsTime, this->frames[this->writeIndex]);
+        this->publishFrame();
+    }
+
+    // nothing posted before stop is lost
+    this->applyCommands();
+}
\ No newline at end of file
@@ -0,0 +1,94 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ParticleMesh.h"
+#include "ParticleSnapshot.h"
+#include "ParticleSystem.h"
+
+// steps a particle system on its own thread, so the render thread draws step N while step N + 1 is computed and the
+// frame time becomes the longer of the two instead of their sum
+// completed steps are published through a triple buffer: the simulation thread never waits for the renderer and the
+// renderer always gets the newest complete frame, both sides swap with a single atomic exchange
+// while running, only the simulation thread touches the particle system; changes are posted as commands and applied
+// between two steps
+class SimulationThread
+{
+public:
+
+    // everything the render thread shows of one completed step
+    struct Frame
+    {
+        ParticleSnapshot particles;
+        ParticleSystem::StepStatistics statistics;
+        sf::Time collisionTime;
+        sf::Time physicsTime;
+
+        // settings the step ran with
+        ParticleSystem::ForceEngine forceEngine = ParticleSystem::ForceEngine::DirectSum;
+        float openingAngle = 0.f;
+        std::size_t expansionOrder = 0;
+        std::size_t meshSize = 0;
+        ParticleMesh::Assignment meshAssignment = ParticleMesh::Assignment::CloudInCell;
+        ParticleSystem::Integrator integrator = ParticleSystem::Integrator::SemiImplicitEuler;
+    };
+
+    using Command = std::function<void(ParticleSystem&)>;
+
+    // fills frame with the state of particleSystem after a step, reusing the buffers of frame
+    static void captureFrame(const ParticleSystem& particleSystem, sf::Time collisionTime, sf::Time physicsTime, Frame& frame);
+
+private:
+
+    // marks the ready frame as not yet taken by the render thread
+    static const std::size_t freshFlag = 4;
+
+    ParticleSystem& particleSystem;
+    std::size_t threadCount;
+    std::thread thread;
+    std::atomic<bool> stopping;
+
+    // the simulation thread fills frames[writeIndex], the render thread draws frames[readIndex] and the third one
+    // (index in ready, plus freshFlag until the render thread took it) is the newest complete frame
+    Frame frames[3];
+    std::size_t writeIndex;
+    std::size_t readIndex;
+    std::atomic<std::size_t> ready;
+
+    // commands posted since the simulation thread last looked, swapped out under the mutex and run outside of it
+    std::mutex commandMutex;
+    std::vector<Command> commands;
+    std::vector<Command> runningCommands;
+
+    void run();
+    void applyCommands();
+    // hands frames[writeIndex] over as the newest frame and takes the one it replaces
+    void publishFrame();
+
+public:
+
+    explicit SimulationThread(ParticleSystem& particleSystem);
+    ~SimulationThread();
+
+    SimulationThread(const SimulationThread&) = delete;
+    SimulationThread& operator=(const SimulationThread&) = delete;
+
+    // starts stepping with threadCount pool workers; each step advances by the wall time of the previous one
+    // nobody else may touch the particle system until stop
+    void start(const std::size_t newThreadCount);
+    // finishes the current step, applies the commands still queued and joins the thread
+    void stop();
+    bool isRunning() const;
+
+    // queues a change, applied by the simulation thread before its next step (or by stop)
+    void post(Command command);
+
+    // newest completed frame (the one captured by start until the first step completes); the reference stays valid
+    // until the next call, so only one thread may acquire frames
+    const Frame& acquireFrame();
+};
\ No newline at end of file
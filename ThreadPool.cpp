@@ -0,0 +1,193 @@
+#include "ThreadPool.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+
+ThreadPool::ThreadPool(std::size_t threadCount, const bool reportBusyTime)
+    : workers{}, queues{}, currentTask{ nullptr }, remainingTasks{ 0 }, generation{ 0 }, stopping{ false },
+    reportingBusyTime{ reportBusyTime }, measuringBusyTime{ false }, busyTimes{}
+{
+    this->start(threadCount);
+}
+
+ThreadPool::~ThreadPool()
+{
+    this->stop();
+}
+
+void ThreadPool::start(const std::size_t threadCount)
+{
+    // hardware_concurrency may report 0
+    const std::size_t count = std::max<std::size_t>(threadCount, 1);
+
+    this->queues.clear();
+    for (std::size_t i = 0; i < count; ++i)
+        this->queues.push_back(std::make_unique<WorkerQueue>());
+    this->busyTimes.assign(count, 0);
+
+    this->stopping = false;
+    for (std::size_t i = 1; i < count; ++i)
+        this->workers.push_back(std::thread{ &ThreadPool::workerLoop, this, i });
+}
+
+void ThreadPool::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(this->stateMutex);
+        this->stopping = true;
+    }
+    this->stateChanged.notify_all();
+
+    for (auto& worker : this->workers)
+        worker.join();
+    this->workers.clear();
+}
+
+void ThreadPool::workerLoop(const std::size_t workerIndex)
+{
+    std::size_t seenGeneration = 0;
+    while (true)
+    {
+        {
+            // sleep until a new batch is published
+            std::unique_lock<std::mutex> lock(this->stateMutex);
+            this->stateChanged.wait(lock, [&]() { return this->stopping || this->generation != seenGeneration; });
+            if (this->stopping) return;
+            seenGeneration = this->generation;
+        }
+
+        this->help(workerIndex);
+    }
+}
+
+bool ThreadPool::takeTask(const std::size_t workerIndex, std::size_t& taskIndex)
+{
+    {
+        WorkerQueue& own = *this->queues[workerIndex];
+        std::unique_lock<std::mutex> lock(own.mutex);
+        if (own.front < own.tasks.size())
+        {
+            taskIndex = own.tasks.back();
+            own.tasks.pop_back();
+            if (own.front == own.tasks.size()) own.tasks.clear(), own.front = 0;
+            return true;
+        }
+    }
+
+    // own queue is empty => steal from the others, starting with the next worker
+    for (std::size_t offset = 1; offset < this->queues.size(); ++offset)
+    {
+        WorkerQueue& victim = *this->queues[(workerIndex + offset) % this->queues.size()];
+        std::unique_lock<std::mutex> lock(victim.mutex);
+        if (victim.front < victim.tasks.size())
+        {
+            taskIndex = victim.tasks[victim.front++];
+            if (victim.front == victim.tasks.size()) victim.tasks.clear(), victim.front = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::help(const std::size_t workerIndex)
+{
+    std::size_t taskIndex;
+    while (this->remainingTasks.load(std::memory_order_acquire) > 0)
+    {
+        if (this->takeTask(workerIndex, taskIndex))
+        {
+            if (this->measuringBusyTime.load(std::memory_order_relaxed))
+            {
+                const auto start = std::chrono::steady_clock::now();
+                (*this->currentTask)(taskIndex, workerIndex);
+                // each worker owns its entry, the decrement below publishes it to the caller of run
+                this->busyTimes[workerIndex] += std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+            }
+            else
+            {
+                (*this->currentTask)(taskIndex, workerIndex);
+            }
+            this->remainingTasks.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        else
+        {
+            // the last tasks are still running on other workers
+            std::this_thread::yield();
+        }
+    }
+}
+
+std::size_t ThreadPool::getThreadCount() const
+{
+    return this->queues.size();
+}
+
+void ThreadPool::setThreadCount(std::size_t threadCount)
+{
+    if (std::max<std::size_t>(threadCount, 1) == this->getThreadCount()) return;
+
+    this->stop();
+    this->start(threadCount);
+}
+
+void ThreadPool::run(const std::size_t taskCount, const Task& task)
+{
+    if (taskCount == 0) return;
+
+    // nothing to share => run inline without touching the queues
+    if (this->workers.empty() || taskCount == 1)
+    {
+        const bool measuring = this->reportingBusyTime && Profiler::isEnabled();
+        const auto start = measuring ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
+        for (std::size_t i = 0; i < taskCount; ++i) task(i, 0);
+        if (measuring)
+            Profiler::addBusyTime(0, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+        return;
+    }
+
+    // the workers read the flag after the generation change below
+    this->measuringBusyTime.store(this->reportingBusyTime && Profiler::isEnabled(), std::memory_order_relaxed);
+    this->currentTask = &task;
+    this->remainingTasks.store(taskCount, std::memory_order_release);
+
+    // deal the tasks round-robin, contiguous tasks end up on different workers
+    for (std::size_t i = 0; i < taskCount; ++i)
+    {
+        WorkerQueue& queue = *this->queues[i % this->queues.size()];
+        std::unique_lock<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(i);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(this->stateMutex);
+        ++this->generation;
+    }
+    this->stateChanged.notify_all();
+
+    this->help(0);
+
+    if (this->measuringBusyTime.load(std::memory_order_relaxed))
+    {
+        for (std::size_t w = 0; w < this->busyTimes.size(); ++w)
+        {
+            Profiler::addBusyTime(w, this->busyTimes[w]);
+            this->busyTimes[w] = 0;
+        }
+    }
+}
+
+void ThreadPool::parallelFor(const std::size_t begin, const std::size_t end, const RangeTask& body)
+{
+    if (begin >= end) return;
+
+    // a few chunks per worker so stealing can even out uneven chunks
+    const std::size_t count = end - begin;
+    const std::size_t chunkCount = std::min(count, this->getThreadCount() * 4);
+
+    this->run(chunkCount, [&](std::size_t chunk, std::size_t workerIndex) {
+        body(begin + count * chunk / chunkCount, begin + count * (chunk + 1) / chunkCount, workerIndex);
+    });
+}
\ No newline at end of file
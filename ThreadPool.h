@@ -0,0 +1,105 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+// persistent pool of worker threads with one work-stealing task queue per worker
+// the thread calling run() acts as worker 0 and helps until every task of the batch is done
+class ThreadPool
+{
+public:
+
+    // non-owning reference to a callable: unlike std::function it never allocates, which keeps the per-batch cost of
+    // run and parallelFor off the heap; only valid while the callable lives, which both guarantee by blocking
+    template <typename... Arguments>
+    class FunctionReference
+    {
+    private:
+
+        const void* callable;
+        void (*invoke)(const void*, Arguments...);
+
+    public:
+
+        template <typename Callable, typename = std::enable_if_t<!std::is_same_v<std::decay_t<Callable>, FunctionReference>>>
+        FunctionReference(const Callable& function)
+            : callable{ &function },
+            invoke{ [](const void* target, Arguments... arguments) { (*static_cast<const Callable*>(target))(arguments...); } } {}
+
+        void operator()(Arguments... arguments) const
+        {
+            this->invoke(this->callable, arguments...);
+        }
+    };
+
+    // task(taskIndex, workerIndex); workerIndex is in [0, getThreadCount()) and can be used to pick per-thread scratch
+    using Task = FunctionReference<std::size_t, std::size_t>;
+    // body(chunkBegin, chunkEnd, workerIndex)
+    using RangeTask = FunctionReference<std::size_t, std::size_t, std::size_t>;
+
+private:
+
+    // tasks[front, size) are pending; the owner pops at the back, thieves at the front
+    // emptied queues are cleared, so the vector keeps its capacity and dealing a batch does not allocate
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::vector<std::size_t> tasks;
+        std::size_t front = 0;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    // batch currently being executed
+    const Task* currentTask;
+    std::atomic<std::size_t> remainingTasks;
+
+    // wakes the sleeping workers when a new batch is published or the pool stops
+    std::mutex stateMutex;
+    std::condition_variable stateChanged;
+    std::size_t generation;
+    bool stopping;
+
+    // microseconds each worker spent in tasks of the current batch, only measured while the profiler is enabled
+    // and the pool reports them (the profiler has one slot per worker index, so only one pool can fill them)
+    bool reportingBusyTime;
+    std::atomic<bool> measuringBusyTime;
+    std::vector<std::int64_t> busyTimes;
+
+    void start(const std::size_t threadCount);
+    void stop();
+
+    void workerLoop(const std::size_t workerIndex);
+
+    // pops from the back of the own queue, otherwise steals from the front of another queue
+    bool takeTask(const std::size_t workerIndex, std::size_t& taskIndex);
+
+    // executes tasks until every task of the current batch is finished
+    void help(const std::size_t workerIndex);
+
+public:
+
+    // pools other than the physics one pass reportBusyTime = false, or their workers would add into its busy times
+    explicit ThreadPool(std::size_t threadCount = std::thread::hardware_concurrency(), const bool reportBusyTime = true);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    std::size_t getThreadCount() const;
+
+    // joins the current workers and starts threadCount - 1 new ones (the caller is the last worker)
+    void setThreadCount(std::size_t threadCount);
+
+    // runs task for every index in [0, taskCount) and blocks until all of them finished
+    void run(const std::size_t taskCount, const Task& task);
+
+    // splits [begin, end) into chunks and runs body(chunkBegin, chunkEnd, workerIndex) for each of them
+    void parallelFor(const std::size_t begin, const std::size_t end, const RangeTask& body);
+};
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "TrajectoryReader.h"
+#include "TrajectoryWriter.h"
+
+#include <cstring>
+#include <algorithm>
+#ifndef _MSC_VER
+#include <sys/types.h>
+#endif
+
+namespace
+{
+    std::uint64_t getU64(const unsigned char* bytes)
+    {
+        std::uint64_t value = 0;
+        for (std::size_t k = 0; k < 8; ++k)
+            value |= static_cast<std::uint64_t>(bytes[k]) << (8 * k);
+        return value;
+    }
+
+    std::uint32_t getU32(const unsigned char* bytes)
+    {
+        std::uint32_t value = 0;
+        for (std::size_t k = 0; k < 4; ++k)
+            value |= static_cast<std::uint32_t>(bytes[k]) << (8 * k);
+        return value;
+    }
+
+    double getF64(const unsigned char* bytes)
+    {
+        const std::uint64_t bits = getU64(bytes);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    bool getVarint(const unsigned char*& position, const unsigned char* end, std::uint64_t& value)
+    {
+        value = 0;
+        for (std::size_t shift = 0; shift < 64 && position < end; shift += 7)
+        {
+            const unsigned char byte = *position++;
+            value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    }
+
+    bool getSignedVarint(const unsigned char*& position, const unsigned char* end, std::int64_t& value)
+    {
+        std::uint64_t zigzag;
+        if (!getVarint(position, end, zigzag)) return false;
+        value = static_cast<std::int64_t>(zigzag >> 1) ^ -static_cast<std::int64_t>(zigzag & 1);
+        return true;
+    }
+
+    // 64 bit offsets, long stays 32 bits on windows and trajectories pass 2 GB
+#ifdef _MSC_VER
+    bool seek(std::FILE* file, const std::uint64_t offset, const int origin)
+    {
+        return _fseeki64(file, static_cast<__int64>(offset), origin) == 0;
+    }
+
+    std::int64_t tell(std::FILE* file) { return _ftelli64(file); }
+#else
+    bool seek(std::FILE* file, const std::uint64_t offset, const int origin)
+    {
+        return fseeko(file, static_cast<off_t>(offset), origin) == 0;
+    }
+
+    std::int64_t tell(std::FILE* file) { return static_cast<std::int64_t>(ftello(file)); }
+#endif
+
+    bool readAt(std::FILE* file, const std::uint64_t offset, unsigned char* bytes, const std::size_t count)
+    {
+        return seek(file, offset, SEEK_SET) && std::fread(bytes, 1, count, file) == count;
+    }
+}
+
+TrajectoryReader::TrajectoryReader()
+    : file{ nullptr }, fileSize{ 0 }, quantum{ 1e-3 }, index{}, decodedFrame{ 0 } {}
+
+TrajectoryReader::~TrajectoryReader()
+{
+    this->close();
+}
+
+bool TrajectoryReader::open(const std::string& path, std::string& error)
+{
+    this->close();
+
+    this->file = std::fopen(path.c_str(), "rb");
+    unsigned char header[TrajectoryWriter::headerSize];
+    const std::int64_t size = this->file && seek(this->file, 0, SEEK_END) ? tell(this->file) : -1;
+    if (size < 0)
+    {
+        this->close();
+        error = "cannot open " + path;
+        return false;
+    }
+    this->fileSize = static_cast<std::uint64_t>(size);
+
+    if (!readAt(this->file, 0, header, sizeof(header))
+        || std::memcmp(header, TrajectoryWriter::fileMagic, sizeof(TrajectoryWriter::fileMagic)) != 0
+        || getU32(header + 8) != TrajectoryWriter::version)
+    {
+        this->close();
+        error = path + " is not a trajectory of version " + std::to_string(TrajectoryWriter::version);
+        return false;
+    }
+    this->quantum = getF64(header + 16);
+
+    if (!this->readIndex() && !this->scanFrames())
+    {
+        this->close();
+        error = "corrupt trajectory " + path;
+        return false;
+    }
+    this->decodedFrame = this->index.size();
+    return true;
+}
+
+void TrajectoryReader::close()
+{
+    if (this->file) std::fclose(this->file);
+    this->file = nullptr;
+    this->index.clear();
+}
+
+bool TrajectoryReader::readIndex()
+{
+    unsigned char trailer[TrajectoryWriter::trailerSize];
+    if (this->fileSize < TrajectoryWriter::headerSize + TrajectoryWriter::trailerSize
+        || !readAt(this->file, this->fileSize - sizeof(trailer), trailer, sizeof(trailer))
+        || std::memcmp(trailer + 16, TrajectoryWriter::indexMagic, sizeof(TrajectoryWriter::indexMagic)) != 0)
+        return false;
+
+    const std::uint64_t indexOffset = getU64(trailer);
+    const std::uint64_t frameCount = getU64(trailer + 8);
+    if (indexOffset < TrajectoryWriter::headerSize || indexOffset > this->fileSize
+        || frameCount != (this->fileSize - sizeof(trailer) - indexOffset) / TrajectoryWriter::indexEntrySize)
+        return false;
+
+    std::vector<unsigned char> bytes(static_cast<std::size_t>(frameCount) * TrajectoryWriter::indexEntrySize);
+    if (!bytes.empty() && !readAt(this->file, indexOffset, bytes.data(), bytes.size())) return false;
+
+    this->index.resize(static_cast<std::size_t>(frameCount));
+    for (std::size_t f = 0; f < this->index.size(); ++f)
+    {
+        const unsigned char* entry = bytes.data() + f * TrajectoryWriter::indexEntrySize;
+        this->index[f] = { getU64(entry), getF64(entry + 8), getU64(entry + 16), getU64(entry + 24) };
+        if (this->index[f].keyframe > f || this->index[f].offset >= indexOffset) return false;
+    }
+    return true;
+}
+
+bool TrajectoryReader::scanFrames()
+{
+    // walk the frame headers up to the first incomplete frame
+    this->index.clear();
+    std::uint64_t offset = TrajectoryWriter::headerSize;
+    unsigned char header[TrajectoryWriter::frameHeaderSize];
+    while (offset + sizeof(header) <= this->fileSize && readAt(this->file, offset, header, sizeof(header)))
+    {
+        const std::uint64_t payloadSize = getU64(header + 25);
+        if (header[0] > 1 || payloadSize > this->fileSize - offset - sizeof(header)) break;
+        if (header[0] == 1 && this->index.empty()) return false;
+
+        const std::uint64_t keyframe = header[0] == 0 ? this->index.size() : this->index.back().keyframe;
+        this->index.push_back({ getU64(header + 1), getF64(header + 9), offset, keyframe });
+        offset += sizeof(header) + payloadSize;
+    }
+    return true;
+}
+
+std::size_t TrajectoryReader::getFrameCount() const
+{
+    return this->index.size();
+}
+
+double TrajectoryReader::getQuantum() const
+{
+    return this->quantum;
+}
+
+std::size_t TrajectoryReader::findFrame(const std::uint64_t step) const
+{
+    return std::lower_bound(this->index.begin(), this->index.end(), step,
+        [](const IndexEntry& entry, const std::uint64_t value) { return entry.step < value; }) - this->index.begin();
+}
+
+bool TrajectoryReader::decodeFrame(const std::size_t frame, std::string& error)
+{
+    unsigned char header[TrajectoryWriter::frameHeaderSize];
+    if (!readAt(this->file, this->index[frame].offset, header, sizeof(header)))
+    {
+        error = "cannot read trajectory frame " + std::to_string(frame);
+        return false;
+    }
+
+    const bool keyframe = header[0] == 0;
+    const std::size_t n = static_cast<std::size_t>(getU64(header + 17));
+    this->payload.resize(static_cast<std::size_t>(getU64(header + 25)));
+    if (!keyframe && n != this->quantizedX.size())
+    {
+        error = "trajectory frame " + std::to_string(frame) + " does not match its keyframe";
+        return false;
+    }
+    if (!this->payload.empty() && std::fread(this->payload.data(), 1, this->payload.size(), this->file) != this->payload.size())
+    {
+        error = "cannot read trajectory frame " + std::to_string(frame);
+        return false;
+    }
+
+    this->quantizedX.resize(n);
+    this->quantizedY.resize(n);
+    this->massBits.resize(n);
+    const unsigned char* position = this->payload.data();
+    const unsigned char* end = position + this->payload.size();
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        std::int64_t differenceX, differenceY;
+        std::uint64_t massDifference;
+        if (!getSignedVarint(position, end, differenceX) || !getSignedVarint(position, end, differenceY)
+            || !getVarint(position, end, massDifference))
+        {
+            error = "truncated trajectory frame " + std::to_string(frame);
+            return false;
+        }
+
+        const std::int64_t referenceX = keyframe ? (i > 0 ? this->quantizedX[i - 1] : 0) : this->quantizedX[i];
+        const std::int64_t referenceY = keyframe ? (i > 0 ? this->quantizedY[i - 1] : 0) : this->quantizedY[i];
+        const std::uint32_t referenceMass = keyframe ? (i > 0 ? this->massBits[i - 1] : 0) : this->massBits[i];
+        this->quantizedX[i] = referenceX + differenceX;
+        this->quantizedY[i] = referenceY + differenceY;
+        this->massBits[i] = referenceMass ^ static_cast<std::uint32_t>(massDifference);
+    }
+
+    this->decodedFrame = frame;
+    return true;
+}
+
+bool TrajectoryReader::readFrame(const std::size_t frame, Frame& result, std::string& error)
+{
+    if (frame >= this->index.size())
+    {
+        error = "trajectory frame " + std::to_string(frame) + " out of range";
+        return false;
+    }
+
+    // continue from the last decoded frame if it lies between the keyframe and the frame
+    const std::size_t keyframe = static_cast<std::size_t>(this->index[frame].keyframe);
+    std::size_t first = keyframe;
+    if (this->decodedFrame < this->index.size() && this->decodedFrame >= keyframe && this->decodedFrame <= frame)
+        first = this->decodedFrame + 1;
+
+    for (std::size_t f = first; f <= frame; ++f)
+    {
+        if (!this->decodeFrame(f, error))
+        {
+            this->decodedFrame = this->index.size();
+            return false;
+        }
+    }
+
+    const std::size_t n = this->quantizedX.size();
+    result.step = this->index[frame].step;
+    result.time = this->index[frame].time;
+    result.x.resize(n);
+    result.y.resize(n);
+    result.mass.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        result.x[i] = static_cast<float>(this->quantizedX[i] * this->quantum);
+        result.y[i] = static_cast<float>(this->quantizedY[i] * this->quantum);
+        std::memcpy(&result.mass[i], &this->massBits[i], sizeof(float));
+    }
+    return true;
+}
\ No newline at end of file
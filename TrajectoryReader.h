@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// random access to the frames of a TrajectoryWriter file
+// uses the index at the end of the file, or rebuilds it by scanning the frame headers if the writer was interrupted
+class TrajectoryReader
+{
+public:
+
+    struct Frame
+    {
+        std::uint64_t step = 0;
+        double time = 0.0;
+        std::vector<float> x;
+        std::vector<float> y;
+        // 0 for particles that were inactive in that step
+        std::vector<float> mass;
+    };
+
+private:
+
+    struct IndexEntry
+    {
+        std::uint64_t step;
+        double time;
+        std::uint64_t offset;
+        std::uint64_t keyframe;
+    };
+
+    std::FILE* file;
+    std::uint64_t fileSize;
+    double quantum;
+    std::vector<IndexEntry> index;
+
+    // quantized state of the last decoded frame, reused when frames are read in order
+    std::size_t decodedFrame;
+    std::vector<std::int64_t> quantizedX;
+    std::vector<std::int64_t> quantizedY;
+    std::vector<std::uint32_t> massBits;
+    std::vector<unsigned char> payload;
+
+    bool readIndex();
+    bool scanFrames();
+    // applies the frame to the quantized state
+    bool decodeFrame(std::size_t frame, std::string& error);
+
+public:
+
+    TrajectoryReader();
+    ~TrajectoryReader();
+
+    TrajectoryReader(const TrajectoryReader&) = delete;
+    TrajectoryReader& operator=(const TrajectoryReader&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+    void close();
+
+    std::size_t getFrameCount() const;
+    double getQuantum() const;
+
+    // first frame whose step is not below step, getFrameCount() if there is none
+    std::size_t findFrame(std::uint64_t step) const;
+
+    // decodes from the keyframe of the frame (or from the last decoded frame when reading forward)
+    bool readFrame(std::size_t frame, Frame& result, std::string& error);
+};
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include "TrajectoryWriter.h"
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+const char TrajectoryWriter::fileMagic[8] = { 'N', 'B', 'O', 'D', 'Y', 'T', 'R', 'J' };
+const char TrajectoryWriter::indexMagic[8] = { 'N', 'B', 'O', 'D', 'Y', 'I', 'D', 'X' };
+
+namespace
+{
+    // shifts keep the byte order independent of the machine
+    void putU64(std::vector<unsigned char>& bytes, const std::uint64_t value)
+    {
+        for (std::size_t k = 0; k < 8; ++k)
+            bytes.push_back(static_cast<unsigned char>(value >> (8 * k)));
+    }
+
+    void putU32(std::vector<unsigned char>& bytes, const std::uint32_t value)
+    {
+        for (std::size_t k = 0; k < 4; ++k)
+            bytes.push_back(static_cast<unsigned char>(value >> (8 * k)));
+    }
+
+    void putF64(std::vector<unsigned char>& bytes, const double value)
+    {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        putU64(bytes, bits);
+    }
+
+    void putVarint(std::vector<unsigned char>& bytes, std::uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            bytes.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back(static_cast<unsigned char>(value));
+    }
+
+    // small differences of either sign => small unsigned values
+    void putSignedVarint(std::vector<unsigned char>& bytes, const std::int64_t value)
+    {
+        putVarint(bytes, (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+    }
+
+    std::int64_t quantize(const float value, const double quantum)
+    {
+        // non-finite or absurd positions are stored as the origin instead of overflowing
+        const double scaled = std::round(value / quantum);
+        return std::isfinite(scaled) && std::abs(scaled) < 4e18 ? static_cast<std::int64_t>(scaled) : 0;
+    }
+}
+
+TrajectoryWriter::TrajectoryWriter()
+    : slots{}, head{ 0 }, tail{ 0 }, filledCount{ 0 }, blocking{ false }, stopping{ false }, failed{ false },
+    file{ nullptr }, quantum{ 1e-3 }, keyframeInterval{ 32 }, fileOffset{ 0 } {}
+
+TrajectoryWriter::~TrajectoryWriter()
+{
+    std::string error;
+    this->close(error);
+}
+
+bool TrajectoryWriter::open(const std::string& path, const std::size_t slotCount, const double newQuantum,
+    const std::size_t newKeyframeInterval, const bool newBlocking, std::string& error)
+{
+    if (!this->close(error)) return false;
+
+    this->file = std::fopen(path.c_str(), "wb");
+    if (!this->file)
+    {
+        error = "cannot create " + path;
+        return false;
+    }
+
+    this->slots.assign(std::max<std::size_t>(slotCount, 2), Slot{});
+    this->head = 0;
+    this->tail = 0;
+    this->filledCount = 0;
+    this->blocking = newBlocking;
+    this->stopping = false;
+    this->failed = false;
+    this->statistics = Statistics{};
+    this->ioError.clear();
+
+    this->quantum = newQuantum > 0.0 ? newQuantum : 1e-3;
+    this->keyframeInterval = std::max<std::size_t>(newKeyframeInterval, 1);
+    this->fileOffset = 0;
+    this->previousX.clear();
+    this->previousY.clear();
+    this->previousMass.clear();
+    this->index.clear();
+
+    this->buffer.clear();
+    this->buffer.insert(this->buffer.end(), fileMagic, fileMagic + sizeof(fileMagic));
+    putU32(this->buffer, version);
+    putU32(this->buffer, 0);
+    putF64(this->buffer, this->quantum);
+    putU64(this->buffer, this->keyframeInterval);
+    if (!this->writeBytes(this->buffer.data(), this->buffer.size()))
+    {
+        std::fclose(this->file);
+        this->file = nullptr;
+        error = "cannot write " + path;
+        return false;
+    }
+
+    this->ioThread = std::thread{ &TrajectoryWriter::ioLoop, this };
+    return true;
+}
+
+bool TrajectoryWriter::isOpen() const
+{
+    return this->file != nullptr;
+}
+
+bool TrajectoryWriter::submit(const ParticleStore& particles, const std::uint64_t step, const double time)
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    if (!this->file || this->failed) return false;
+
+    ++this->statistics.submittedFrames;
+    if (this->filledCount == this->slots.size())
+    {
+        if (!this->blocking)
+        {
+            ++this->statistics.droppedFrames;
+            return false;
+        }
+
+        ++this->statistics.blockedFrames;
+        sf::Clock clock;
+        this->slotFreed.wait(lock, [&]() { return this->filledCount < this->slots.size() || this->failed; });
+        this->statistics.blockedTime += clock.getElapsedTime();
+        if (this->failed)
+        {
+            ++this->statistics.droppedFrames;
+            return false;
+        }
+    }
+
+    // the I/O thread never reads the head slot, so it can be filled without holding the lock
+    Slot& slot = this->slots[this->head];
+    lock.unlock();
+
+    slot.step = step;
+    slot.time = time;
+    slot.x.assign(particles.x.begin(), particles.x.end());
+    slot.y.assign(particles.y.begin(), particles.y.end());
+    slot.mass.assign(particles.mass.begin(), particles.mass.end());
+    slot.active.assign(particles.active.begin(), particles.active.end());
+
+    lock.lock();
+    this->head = (this->head + 1) % this->slots.size();
+    ++this->filledCount;
+    lock.unlock();
+    this->slotFilled.notify_one();
+    return true;
+}
+
+void TrajectoryWriter::ioLoop()
+{
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->slotFilled.wait(lock, [&]() { return this->filledCount > 0 || this->stopping; });
+        if (this->filledCount == 0) return;
+
+        const Slot& slot = this->slots[this->tail];
+        const std::size_t particleCount = slot.x.size();
+        lock.unlock();
+
+        this->buffer.clear();
+        const std::uint64_t frameOffset = this->fileOffset;
+        const std::uint8_t type = this->encodeFrame(slot);
+        const bool written = this->writeBytes(this->buffer.data(), this->buffer.size());
+
+        const std::uint64_t keyframe = type == 0 ? this->index.size() : this->index.back().keyframe;
+        this->index.push_back({ slot.step, slot.time, frameOffset, keyframe });
+
+        // the slot may be refilled as soon as it is released
+        lock.lock();
+        this->tail = (this->tail + 1) % this->slots.size();
+        --this->filledCount;
+        if (written)
+        {
+            ++this->statistics.writtenFrames;
+            this->statistics.writtenBytes += this->buffer.size();
+            this->statistics.rawBytes += 3 * sizeof(float) * particleCount;
+        }
+        else if (!this->failed)
+        {
+            this->failed = true;
+            this->ioError = "cannot write trajectory frame " + std::to_string(slot.step);
+        }
+        lock.unlock();
+        this->slotFreed.notify_one();
+    }
+}
+
+std::uint8_t TrajectoryWriter::encodeFrame(const Slot& slot)
+{
+    const std::size_t n = slot.x.size();
+    this->currentX.resize(n);
+    this->currentY.resize(n);
+    this->currentMass.resize(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        const float mass = slot.active[i] ? slot.mass[i] : 0.f;
+        this->currentX[i] = quantize(slot.x[i], this->quantum);
+        this->currentY[i] = quantize(slot.y[i], this->quantum);
+        std::memcpy(&this->currentMass[i], &mass, sizeof(mass));
+    }
+
+    // differences to the previous frame only help while the particles keep their indices
+    const bool keyframe = this->index.empty() || this->previousX.size() != n
+        || this->index.size() - this->index.back().keyframe >= this->keyframeInterval;
+
+    const std::size_t payloadStart = this->buffer.size() + frameHeaderSize;
+    this->buffer.resize(payloadStart);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        const std::int64_t referenceX = keyframe ? (i > 0 ? this->currentX[i - 1] : 0) : this->previousX[i];
+        const std::int64_t referenceY = keyframe ? (i > 0 ? this->currentY[i - 1] : 0) : this->previousY[i];
+        const std::uint32_t referenceMass = keyframe ? (i > 0 ? this->currentMass[i - 1] : 0) : this->previousMass[i];
+        putSignedVarint(this->buffer, this->currentX[i] - referenceX);
+        putSignedVarint(this->buffer, this->currentY[i] - referenceY);
+        putVarint(this->buffer, this->currentMass[i] ^ referenceMass);
+    }
+
+    std::vector<unsigned char> frameHeader;
+    frameHeader.reserve(frameHeaderSize);
+    frameHeader.push_back(keyframe ? 0 : 1);
+    putU64(frameHeader, slot.step);
+    putF64(frameHeader, slot.time);
+    putU64(frameHeader, n);
+    putU64(frameHeader, this->buffer.size() - payloadStart);
+    std::copy(frameHeader.begin(), frameHeader.end(), this->buffer.begin() + (payloadStart - frameHeaderSize));
+
+    this->previousX.swap(this->currentX);
+    this->previousY.swap(this->currentY);
+    this->previousMass.swap(this->currentMass);
+    return keyframe ? 0 : 1;
+}
+
+bool TrajectoryWriter::writeBytes(const unsigned char* bytes, const std::size_t count)
+{
+    if (std::fwrite(bytes, 1, count, this->file) != count) return false;
+    this->fileOffset += count;
+    return true;
+}
+
+bool TrajectoryWriter::close(std::string& error)
+{
+    if (!this->file) return true;
+
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->slotFilled.notify_one();
+    this->ioThread.join();
+
+    // the index lets readers seek without scanning every frame
+    bool written = !this->failed;
+    if (written)
+    {
+        this->buffer.clear();
+        const std::uint64_t indexOffset = this->fileOffset;
+        for (const IndexEntry& entry : this->index)
+        {
+            putU64(this->buffer, entry.step);
+            putF64(this->buffer, entry.time);
+            putU64(this->buffer, entry.offset);
+            putU64(this->buffer, entry.keyframe);
+        }
+        putU64(this->buffer, indexOffset);
+        putU64(this->buffer, this->index.size());
+        this->buffer.insert(this->buffer.end(), indexMagic, indexMagic + sizeof(indexMagic));
+        written = this->writeBytes(this->buffer.data(), this->buffer.size());
+    }
+    written = std::fclose(this->file) == 0 && written;
+    this->file = nullptr;
+
+    if (!written)
+    {
+        error = this->ioError.empty() ? "cannot write the trajectory index" : this->ioError;
+        return false;
+    }
+    return true;
+}
+
+TrajectoryWriter::Statistics TrajectoryWriter::getStatistics() const
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    return this->statistics;
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+#include <SFML/System.hpp>
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "ParticleStore.h"
+
+// streams the positions and masses of every step to a file from a background thread
+// submit only copies the arrays into a free slot of a small ring, the I/O thread encodes and writes the slots in order
+//
+// file layout (little-endian):
+//     header: "NBODYTRJ", u32 version, u32 0, f64 quantum, u64 keyframe interval
+//     frames: u8 type (0 keyframe, 1 delta), u64 step, f64 time, u64 particle count, u64 payload size, payload
+//     index:  per frame u64 step, f64 time, u64 file offset, u64 frame number of its keyframe,
+//             then u64 index offset, u64 frame count, "NBODYIDX"
+// positions are rounded to multiples of quantum; a keyframe stores every coordinate as the zigzag varint difference
+// to the previous particle, a delta frame as the difference to the same particle in the previous frame
+// masses are the float bits xor the previous particle / frame as a varint (inactive particles have mass 0)
+// keyframes are written every keyframe interval frames and whenever the particle count changes,
+// so any frame can be decoded from its keyframe; files without an index (interrupted writers) can be scanned
+class TrajectoryWriter
+{
+public:
+
+    static const std::uint32_t version = 1;
+    static const std::size_t headerSize = 32;
+    static const std::size_t frameHeaderSize = 33;
+    static const std::size_t indexEntrySize = 32;
+    static const std::size_t trailerSize = 24;
+    static const char fileMagic[8];
+    static const char indexMagic[8];
+
+    struct Statistics
+    {
+        std::size_t submittedFrames = 0;
+        std::size_t writtenFrames = 0;
+        // frames lost because every slot was still waiting to be written
+        std::size_t droppedFrames = 0;
+        // submits that had to wait for a free slot (blocking writers only) and the time spent waiting
+        std::size_t blockedFrames = 0;
+        sf::Time blockedTime;
+
+        // encoded bytes on disk vs the float positions and masses handed in
+        std::uint64_t writtenBytes = 0;
+        std::uint64_t rawBytes = 0;
+    };
+
+private:
+
+    struct Slot
+    {
+        std::uint64_t step = 0;
+        double time = 0.0;
+        std::vector<float> x;
+        std::vector<float> y;
+        std::vector<float> mass;
+        std::vector<std::uint8_t> active;
+    };
+
+    struct IndexEntry
+    {
+        std::uint64_t step;
+        double time;
+        std::uint64_t offset;
+        std::uint64_t keyframe;
+    };
+
+    // ring of slots: [tail, tail + filledCount) wait for the I/O thread, head is the next one to fill
+    std::vector<Slot> slots;
+    std::size_t head;
+    std::size_t tail;
+    std::size_t filledCount;
+
+    bool blocking;
+    bool stopping;
+    bool failed;
+
+    mutable std::mutex mutex;
+    std::condition_variable slotFilled;
+    std::condition_variable slotFreed;
+    std::thread ioThread;
+
+    Statistics statistics;
+    std::string ioError;
+
+    // only touched by the I/O thread while it runs
+    std::FILE* file;
+    double quantum;
+    std::size_t keyframeInterval;
+    std::uint64_t fileOffset;
+    std::vector<std::int64_t> previousX;
+    std::vector<std::int64_t> previousY;
+    std::vector<std::uint32_t> previousMass;
+    std::vector<std::int64_t> currentX;
+    std::vector<std::int64_t> currentY;
+    std::vector<std::uint32_t> currentMass;
+    std::vector<unsigned char> buffer;
+    std::vector<IndexEntry> index;
+
+    void ioLoop();
+    // appends the frame of the slot to buffer and returns its type
+    std::uint8_t encodeFrame(const Slot& slot);
+    bool writeBytes(const unsigned char* bytes, std::size_t count);
+
+public:
+
+    TrajectoryWriter();
+    // closes the file if it is still open
+    ~TrajectoryWriter();
+
+    TrajectoryWriter(const TrajectoryWriter&) = delete;
+    TrajectoryWriter& operator=(const TrajectoryWriter&) = delete;
+
+    // creates path and starts the I/O thread; slotCount >= 2 frames can be in flight
+    // a blocking writer makes submit wait for a free slot, otherwise the frame is dropped
+    bool open(const std::string& path, std::size_t slotCount, double newQuantum, std::size_t newKeyframeInterval,
+        bool newBlocking, std::string& error);
+    bool isOpen() const;
+
+    // copies the positions, masses and active flags of particles into the next free slot
+    // returns false if the frame was dropped
+    bool submit(const ParticleStore& particles, std::uint64_t step, double time);
+
+    // writes the remaining frames and the index, then stops the I/O thread
+    bool close(std::string& error);
+
+    Statistics getStatistics() const;
+};
\ No newline at end of file
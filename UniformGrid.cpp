@@ -0,0 +1,79 @@
+#include "UniformGrid.h"
+
+#include <cmath>
+#include <algorithm>
+
+UniformGrid::UniformGrid()
+    : cellSize{ 1.f }, bucketMask{ 0 }, bucketStart{}, entries{}, bucketFill{}, cellX{}, cellY{}, inserted{} {}
+
+std::size_t UniformGrid::getBucket(const std::int64_t x, const std::int64_t y) const
+{
+    // large primes spread neighbouring cells over the table
+    const std::uint64_t hash = static_cast<std::uint64_t>(x) * 73856093ull ^ static_cast<std::uint64_t>(y) * 19349663ull;
+    return static_cast<std::size_t>(hash) & this->bucketMask;
+}
+
+void UniformGrid::build(const float* x, const float* y, const std::uint8_t* active, const std::size_t n, const float newCellSize)
+{
+    this->cellSize = std::max(newCellSize, 1e-6f);
+
+    // power of two table with about two buckets per particle
+    std::size_t bucketCount = 1;
+    while (bucketCount < 2 * n) bucketCount *= 2;
+    this->bucketMask = bucketCount - 1;
+
+    this->cellX.resize(n);
+    this->cellY.resize(n);
+    this->inserted.resize(n);
+    this->bucketStart.assign(bucketCount + 1, 0);
+
+    // counting sort of the particles by bucket: count, prefix sum, scatter
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        this->inserted[i] = active[i] && std::isfinite(x[i]) && std::isfinite(y[i]);
+        if (!this->inserted[i]) continue;
+
+        this->cellX[i] = static_cast<std::int64_t>(std::floor(x[i] / this->cellSize));
+        this->cellY[i] = static_cast<std::int64_t>(std::floor(y[i] / this->cellSize));
+        ++this->bucketStart[this->getBucket(this->cellX[i], this->cellY[i]) + 1];
+    }
+
+    for (std::size_t b = 0; b < bucketCount; ++b)
+        this->bucketStart[b + 1] += this->bucketStart[b];
+
+    this->entries.resize(this->bucketStart[bucketCount]);
+    std::vector<std::size_t>& fill = this->bucketFill;
+    fill.assign(this->bucketStart.begin(), this->bucketStart.end() - 1);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        if (!this->inserted[i]) continue;
+        this->entries[fill[this->getBucket(this->cellX[i], this->cellY[i])]++] = i;
+    }
+}
+
+void UniformGrid::collectCandidatePairs(const std::size_t begin, const std::size_t end,
+    std::pmr::vector<std::pair<std::size_t, std::size_t>>& pairs) const
+{
+    for (std::size_t i = begin; i < end; ++i)
+    {
+        if (!this->inserted[i]) continue;
+
+        for (std::int64_t offsetY = -1; offsetY <= 1; ++offsetY)
+        {
+            for (std::int64_t offsetX = -1; offsetX <= 1; ++offsetX)
+            {
+                const std::int64_t neighbourX = this->cellX[i] + offsetX;
+                const std::int64_t neighbourY = this->cellY[i] + offsetY;
+                const std::size_t bucket = this->getBucket(neighbourX, neighbourY);
+
+                for (std::size_t k = this->bucketStart[bucket]; k < this->bucketStart[bucket + 1]; ++k)
+                {
+                    // skip other cells that collide in the same bucket; j > i emits every pair once
+                    const std::size_t j = this->entries[k];
+                    if (j > i && this->cellX[j] == neighbourX && this->cellY[j] == neighbourY)
+                        pairs.push_back({ i, j });
+                }
+            }
+        }
+    }
+}
\ No newline at end of file
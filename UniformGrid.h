@@ -0,0 +1,40 @@
+#pragma once
+#include <vector>
+#include <memory_resource>
+#include <cstdint>
+#include <utility>
+
+// spatial hash over a uniform grid, rebuilt every frame
+// with a cell size of at least the largest diameter, two touching circles always sit in the same or in neighbouring cells
+class UniformGrid
+{
+private:
+
+    float cellSize;
+
+    // hash table of cells: entries[bucketStart[b], bucketStart[b + 1]) are the particles hashed into bucket b
+    std::size_t bucketMask;
+    std::vector<std::size_t> bucketStart;
+    std::vector<std::size_t> entries;
+    // next free entry of every bucket during the scatter
+    std::vector<std::size_t> bucketFill;
+
+    // cell of every particle (only meaningful for the ones that were inserted)
+    std::vector<std::int64_t> cellX;
+    std::vector<std::int64_t> cellY;
+    std::vector<std::uint8_t> inserted;
+
+    std::size_t getBucket(const std::int64_t x, const std::int64_t y) const;
+
+public:
+
+    UniformGrid();
+
+    // inserts every active particle into the cell containing its center
+    void build(const float* x, const float* y, const std::uint8_t* active, const std::size_t n, const float newCellSize);
+
+    // appends the pairs (i, j), i < j, for every inserted particle i in [begin, end) and every inserted particle j
+    // in the same or one of the 8 neighbouring cells; these are candidates only, the circles may not touch
+    void collectCandidatePairs(const std::size_t begin, const std::size_t end,
+        std::pmr::vector<std::pair<std::size_t, std::size_t>>& pairs) const;
+};
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include <cstdio>
+#include <cmath>
+#include <sstream>
+
+#include "HeadlessRunner.h"
+
+// scaling benchmark suite built on the headless runner, prints one json document
+// strong scaling: fixed particle count, thread count doubled up to --max-threads
+// every strong scaling run must end in the same state as its single thread run ("deterministic"), the exit code is 2
+// if one does not
+// weak scaling: particle count grown with the thread count so the work per thread stays constant
+//               (n ~ sqrt(threads) for the O(n^2) direct sum, n ~ threads for Barnes-Hut and the FMM)
+// usage: benchmark [--sizes N1,N2,...] [--max-threads T] [--weak-base N] plus any headless option
+int main(int argc, char** argv)
+{
+    std::vector<std::size_t> sizes{ 1000, 2000, 4000 };
+    std::size_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    std::size_t weakBase = 2000;
+
+    HeadlessRunner::Config baseConfig;
+    baseConfig.stepCount = 20;
+
+    // pull out the suite options, the rest goes to the headless parser
+    std::vector<std::string> arguments(argv + 1, argv + argc);
+    std::vector<std::string> runnerArguments;
+    for (std::size_t i = 0; i < arguments.size(); ++i)
+    {
+        if (i + 1 < arguments.size() && arguments[i] == "--sizes")
+        {
+            sizes.clear();
+            std::stringstream list(arguments[++i]);
+            std::string size;
+            while (std::getline(list, size, ','))
+                sizes.push_back(std::strtoull(size.c_str(), nullptr, 10));
+        }
+        else if (i + 1 < arguments.size() && arguments[i] == "--max-threads")
+            maxThreads = std::max<std::size_t>(std::strtoull(arguments[++i].c_str(), nullptr, 10), 1);
+        else if (i + 1 < arguments.size() && arguments[i] == "--weak-base")
+            weakBase = std::strtoull(arguments[++i].c_str(), nullptr, 10);
+        else
+            runnerArguments.push_back(arguments[i]);
+    }
+
+    std::string error;
+    if (!HeadlessRunner::parseArguments(runnerArguments, baseConfig, error))
+    {
+        std::fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+
+    std::vector<std::size_t> threadCounts;
+    for (std::size_t threads = 1; threads < maxThreads; threads *= 2) threadCounts.push_back(threads);
+    threadCounts.push_back(maxThreads);
+
+    bool deterministic = true;
+    std::printf("{\"strong\": [");
+    for (std::size_t s = 0; s < sizes.size(); ++s)
+    {
+        double baseline = 0.0;
+        std::uint64_t baselineHash = 0;
+        for (std::size_t t = 0; t < threadCounts.size(); ++t)
+        {
+            HeadlessRunner::Config config = baseConfig;
+            config.particleCount = sizes[s];
+            config.threadCount = threadCounts[t];
+
+            HeadlessRunner::Result result = HeadlessRunner::run(config);
+            const double seconds = result.totalTime.asMicroseconds() / 1e6;
+            if (t == 0)
+            {
+                baseline = seconds;
+                baselineHash = result.stateHash;
+            }
+            const bool matches = result.stateHash == baselineHash;
+            deterministic = deterministic && matches;
+
+            const double speedup = seconds > 0.0 ? baseline / seconds : 0.0;
+            std::printf("%s\n  {\"speedup\": %g, \"efficiency\": %g, \"deterministic\": %s, \"run\": %s}",
+                s + t == 0 ? "" : ",", speedup, speedup / config.threadCount, matches ? "true" : "false",
+                HeadlessRunner::toJson(result).c_str());
+            std::fflush(stdout);
+        }
+    }
+
+    std::printf("\n], \"weak\": [");
+    double baseline = 0.0;
+    for (std::size_t t = 0; t < threadCounts.size(); ++t)
+    {
+        HeadlessRunner::Config config = baseConfig;
+        const double scale = baseConfig.forceEngine == ParticleSystem::ForceEngine::DirectSum
+            ? std::sqrt(static_cast<double>(threadCounts[t]))
+            : static_cast<double>(threadCounts[t]);
+        config.particleCount = static_cast<std::size_t>(weakBase * scale);
+        config.threadCount = threadCounts[t];
+
+        HeadlessRunner::Result result = HeadlessRunner::run(config);
+        const double seconds = result.totalTime.asMicroseconds() / 1e6;
+        if (t == 0) baseline = seconds;
+
+        // ideal weak scaling keeps the time constant
+        std::printf("%s\n  {\"efficiency\": %g, \"run\": %s}",
+            t == 0 ? "" : ",", seconds > 0.0 ? baseline / seconds : 0.0, HeadlessRunner::toJson(result).c_str());
+        std::fflush(stdout);
+    }
+    std::printf("\n]}\n");
+
+    return deterministic ? 0 : 2;
+}
\ No newline at end of file
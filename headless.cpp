@@ -0,0 +1,46 @@
+#include <cstdio>
+#include <mpi.h>
+
+#include "HeadlessRunner.h"
+
+// runs the simulation without a window and prints the timings as json
+// usage: headless [--particles N] [--distribution disc|uniform-disc|plummer|exponential-disc|galaxies] [--scale L]
+//                 [--steps S] [--dt DT] [--threads T] [--engine direct|barnes-hut|fmm|pm]
+//                 [--theta THETA] [--order P] [--mesh-size M] [--mesh-assignment cic|tsc] [--mesh-softening CELLS]
+//                 [--error-samples K] [--timestep-bins B] [--timestep-accuracy ETA]
+//                 [--integrator euler|leapfrog|yoshida4] [--collisions 0|1] [--energy 0|1] [--simd scalar|avx2|avx512]
+//                 [--precision single|double] [--softening clamp|plummer|spline] [--softening-length EPS]
+//                 [--gravitational-constant G]
+//                 [--broad-phase sweep|grid] [--seed SEED] [--restart CHECKPOINT] [--checkpoint CHECKPOINT]
+//                 [--trajectory FILE] [--trajectory-slots N] [--trajectory-quantum Q] [--trajectory-blocking 0|1]
+//                 [--trace TRACE.json] [--summary-interval N] [--ensemble SYSTEMS]
+// under "mpirun -np K headless ..." the ranks split the particles and rank 0 prints the report
+// with --ensemble, SYSTEMS independent systems of N bodies (seeds SEED, SEED + 1, ...) are stepped together and the
+// report adds the system-steps per second and the diagnostics of every member
+int main(int argc, char** argv)
+{
+    MPI_Init(&argc, &argv);
+    int rank = 0;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    HeadlessRunner::Config config;
+    std::string error;
+    if (!HeadlessRunner::parseArguments(std::vector<std::string>(argv + 1, argv + argc), config, error))
+    {
+        if (rank == 0) std::fprintf(stderr, "%s\n", error.c_str());
+        MPI_Finalize();
+        return 1;
+    }
+
+    HeadlessRunner::Result result = HeadlessRunner::run(config);
+    if (!result.error.empty())
+    {
+        if (rank == 0) std::fprintf(stderr, "%s\n", result.error.c_str());
+        MPI_Finalize();
+        return 1;
+    }
+    if (rank == 0) std::printf("%s\n", HeadlessRunner::toJson(result).c_str());
+
+    MPI_Finalize();
+    return 0;
+}
\ No newline at end of file
@@ -1,15 +1,46 @@
 #include <SFML/Graphics.hpp>
 #include <mpi.h>
+#include <thread>
 
 #include "ParticleSystem.h"
+#include "Profiler.h"
+#include "SimulationThread.h"
 
 #define particleCount 5000
 
 std::string timeToString(sf::Time time)
 {
-    char c[15];
-    sprintf_s(c, "%dms", time.asMilliseconds());
-    return std::string(c);
+    return std::to_string(time.asMilliseconds()) + "ms";
+}
+
+// overlay text for the step shown in frame
+std::string frameToString(const SimulationThread::Frame& frame, sf::Time elapsed, bool pipelined)
+{
+    std::string performanceString = "";
+    int fps = std::floor(1.f / elapsed.asSeconds());
+    performanceString += "FPS: " + std::to_string(fps) + (pipelined ? " (pipelined)" : "") + '\n';
+    performanceString += "Collision time: " + timeToString(frame.collisionTime) + '\n';
+    performanceString += "Physics time: " + timeToString(frame.physicsTime) + '\n';
+    performanceString += "Particle count: " + std::to_string(frame.particles.getParticleCount()) + '\n';
+    // allocations of the step; the counter is process wide, so when pipelined the render thread's count too
+    const ParticleSystem::StepStatistics& statistics = frame.statistics;
+    performanceString += "Heap allocations: " + std::to_string(statistics.collisionAllocationCount + statistics.updateAllocationCount)
+        + " (arena " + std::to_string(statistics.frameArenaCapacity / 1024) + " KiB)\n";
+    if (frame.forceEngine == ParticleSystem::ForceEngine::BarnesHut)
+        performanceString += "Force engine: Barnes-Hut (theta " + std::to_string(frame.openingAngle).substr(0, 4) + ")";
+    else if (frame.forceEngine == ParticleSystem::ForceEngine::FastMultipole)
+        performanceString += "Force engine: FMM (order " + std::to_string(frame.expansionOrder)
+            + ", theta " + std::to_string(frame.openingAngle).substr(0, 4) + ")";
+    else if (frame.forceEngine == ParticleSystem::ForceEngine::ParticleMesh)
+        performanceString += "Force engine: particle-mesh (" + std::to_string(frame.meshSize) + "^2, "
+            + ParticleMesh::getAssignmentName(frame.meshAssignment) + ")";
+    else
+        performanceString += "Force engine: direct sum";
+    performanceString += std::string("\nIntegrator: ") + ParticleSystem::getIntegratorName(frame.integrator);
+    performanceString += std::string("\nDraw mode: ") + ParticleSnapshot::getDrawModeName(frame.particles.getDrawMode());
+    if (Profiler::isEnabled())
+        performanceString += std::string("\n") + (Profiler::isTracing() ? "[tracing]\n" : "") + Profiler::getSummary();
+    return performanceString;
 }
 
 int main()
@@ -54,6 +85,24 @@ int main()
     particleSystem.setParticlesVertexCount(15);
     particleSystem.distributeParticles(particleCount);
 
+    // one worker per hardware thread, the pool is created once and reused every frame
+    const std::size_t nrThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    particleSystem.setThreadCount(nrThreads);
+
+    // S toggles the pipelined mode: physics on its own thread (leaving a hardware thread to the rendering) while this
+    // one draws the last completed step
+    SimulationThread simulation(particleSystem);
+    const std::size_t nrPipelinedThreads = std::max<std::size_t>(nrThreads - 1, 1);
+    SimulationThread::Frame serialFrame;
+
+    // changes of the particle system go through the simulation thread while it runs, so none lands in the middle of a step
+    auto modify = [&](const SimulationThread::Command& command) {
+        if (simulation.isRunning())
+            simulation.post(command);
+        else
+            command(particleSystem);
+    };
+
     // create a clock to track the elapsed time
     sf::Clock clock;
 
@@ -76,41 +125,145 @@ int main()
                 // move text in right position
                 performance.setPosition({ -1 * static_cast<float>(size.x) / 2, -1 * static_cast<float>(size.y) / 2 });
             }
+            if (event.type == sf::Event::KeyPressed)
+            {
+                // B cycles direct summation -> Barnes-Hut -> FMM -> particle-mesh, up/down change the opening angle,
+                // left/right the FMM order, M the particle-mesh assignment
+                if (event.key.code == sf::Keyboard::B)
+                {
+                    modify([](ParticleSystem& particleSystem) {
+                        switch (particleSystem.getForceEngine())
+                        {
+                        case ParticleSystem::ForceEngine::DirectSum: particleSystem.setForceEngine(ParticleSystem::ForceEngine::BarnesHut); break;
+                        case ParticleSystem::ForceEngine::BarnesHut: particleSystem.setForceEngine(ParticleSystem::ForceEngine::FastMultipole); break;
+                        case ParticleSystem::ForceEngine::FastMultipole: particleSystem.setForceEngine(ParticleSystem::ForceEngine::ParticleMesh); break;
+                        default: particleSystem.setForceEngine(ParticleSystem::ForceEngine::DirectSum); break;
+                        }
+                    });
+                }
+                if (event.key.code == sf::Keyboard::M)
+                    modify([](ParticleSystem& particleSystem) {
+                        particleSystem.setMeshAssignment(
+                            particleSystem.getMeshAssignment() == ParticleMesh::Assignment::CloudInCell
+                            ? ParticleMesh::Assignment::TriangularShapedCloud
+                            : ParticleMesh::Assignment::CloudInCell);
+                    });
+                // G switches the collision broad phase between sweep and prune and the uniform grid
+                if (event.key.code == sf::Keyboard::G)
+                    modify([](ParticleSystem& particleSystem) {
+                        particleSystem.setCollisionBroadPhase(
+                            particleSystem.getCollisionBroadPhase() == ParticleSystem::CollisionBroadPhase::UniformGrid
+                            ? ParticleSystem::CollisionBroadPhase::SweepAndPrune
+                            : ParticleSystem::CollisionBroadPhase::UniformGrid);
+                    });
+                // I cycles the integrator: euler -> leapfrog -> yoshida
+                if (event.key.code == sf::Keyboard::I)
+                {
+                    modify([](ParticleSystem& particleSystem) {
+                        switch (particleSystem.getIntegrator())
+                        {
+                        case ParticleSystem::Integrator::SemiImplicitEuler: particleSystem.setIntegrator(ParticleSystem::Integrator::Leapfrog); break;
+                        case ParticleSystem::Integrator::Leapfrog: particleSystem.setIntegrator(ParticleSystem::Integrator::Yoshida); break;
+                        default: particleSystem.setIntegrator(ParticleSystem::Integrator::SemiImplicitEuler); break;
+                        }
+                    });
+                }
+                // D switches between drawing circles and the density of the particles
+                if (event.key.code == sf::Keyboard::D)
+                    modify([](ParticleSystem& particleSystem) {
+                        particleSystem.setDrawMode(
+                            particleSystem.getDrawMode() == ParticleSnapshot::DrawMode::Circles
+                            ? ParticleSnapshot::DrawMode::Density
+                            : ParticleSnapshot::DrawMode::Circles);
+                    });
+                if (event.key.code == sf::Keyboard::S)
+                {
+                    if (simulation.isRunning())
+                    {
+                        simulation.stop();
+                        // the serial loop steps by the frame time, which would include the whole pipelined run
+                        clock.restart();
+                    }
+                    else
+                    {
+                        simulation.start(nrPipelinedThreads);
+                    }
+                }
+                // P toggles the profiler and its rolling summary in the overlay
+                if (event.key.code == sf::Keyboard::P)
+                {
+                    Profiler::reset();
+                    Profiler::setEnabled(!Profiler::isEnabled());
+                }
+                // T starts a chrome trace capture, pressing it again writes trace.json
+                if (event.key.code == sf::Keyboard::T)
+                {
+                    if (Profiler::isTracing())
+                    {
+                        std::string error;
+                        if (!Profiler::writeTrace("trace.json", error)) printf("%s\n", error.c_str());
+                        Profiler::setTracing(false);
+                    }
+                    else
+                    {
+                        Profiler::reset();
+                        Profiler::setEnabled(true);
+                        Profiler::setTracing(true);
+                    }
+                }
+                if (event.key.code == sf::Keyboard::Up)
+                    modify([](ParticleSystem& particleSystem) { particleSystem.setOpeningAngle(particleSystem.getOpeningAngle() + 0.1f); });
+                if (event.key.code == sf::Keyboard::Down)
+                    modify([](ParticleSystem& particleSystem) { particleSystem.setOpeningAngle(particleSystem.getOpeningAngle() - 0.1f); });
+                if (event.key.code == sf::Keyboard::Right)
+                    modify([](ParticleSystem& particleSystem) { particleSystem.setExpansionOrder(particleSystem.getExpansionOrder() + 1); });
+                if (event.key.code == sf::Keyboard::Left)
+                    modify([](ParticleSystem& particleSystem) {
+                        if (particleSystem.getExpansionOrder() > 1) particleSystem.setExpansionOrder(particleSystem.getExpansionOrder() - 1);
+                    });
+            }
             if (event.type == sf::Event::MouseButtonReleased)
             {
                 // add particle when mouse button (any) clicked
                 sf::Vector2i position{ event.mouseButton.x, event.mouseButton.y };
-                particleSystem.addParticle(window.mapPixelToCoords(position), 10.f);
+                const sf::Vector2f coordinates = window.mapPixelToCoords(position);
+                modify([coordinates](ParticleSystem& particleSystem) { particleSystem.addParticle(coordinates, 10.f); });
             }
         }
 
         // update
         sf::Time elapsed = clock.restart();
 
-        particleSystem.handleCollisions();
-        sf::Time collisionTime = clock.getElapsedTime();
+        if (!simulation.isRunning())
+        {
+            particleSystem.handleCollisions();
+            sf::Time collisionTime = clock.getElapsedTime();
 
-        //particleSystem.update(elapsed);
-        particleSystem.update(elapsed, 16);
-        sf::Time physicsTime = clock.getElapsedTime() - collisionTime;
+            //particleSystem.update(elapsed);
+            particleSystem.update(elapsed, nrThreads);
+            sf::Time physicsTime = clock.getElapsedTime() - collisionTime;
 
-        // change performance text
-        std::string performanceString = "";
-        int fps = std::floor(1.f / elapsed.asSeconds());
-        performanceString += "FPS: " + std::to_string(fps) + '\n';
-        performanceString += "Collision time: " + timeToString(collisionTime) + '\n';
-        performanceString += "Physics time: " + timeToString(physicsTime) + '\n';
-        performanceString += "Particle count: " + std::to_string(particleSystem.getParticleCount());
+            SimulationThread::captureFrame(particleSystem, collisionTime, physicsTime, serialFrame);
+        }
+
+        // the newest step the simulation thread completed, it already works on the next one
+        const SimulationThread::Frame& frame = simulation.isRunning() ? simulation.acquireFrame() : serialFrame;
 
+        // change performance text
+        std::string performanceString = frameToString(frame, elapsed, simulation.isRunning());
         performance.setString(sf::String(performanceString));
 
 
         // draw
         window.clear();
         window.draw(performance);
-        window.draw(particleSystem);
+        window.draw(frame.particles);
         window.display();
+
+        Profiler::endFrame();
     }
 
+    simulation.stop();
+
     return 0;
 }
\ No newline at end of file